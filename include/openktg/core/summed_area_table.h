@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <openktg/core/texture.h>
+
+namespace openktg::inline core
+{
+// Summed-area table of a texture. at(x, y) holds the per-channel sums of all
+// pixels in [0,x) x [0,y), for 0 <= x <= width and 0 <= y <= height, so the
+// sum over any rectangle takes four lookups.
+class summed_area_table
+{
+  public:
+    using sums = std::array<std::int64_t, 4>; // r, g, b, a
+
+    summed_area_table() = default;
+    explicit summed_area_table(const texture &tex);
+
+    [[nodiscard]] auto width() const noexcept -> uint32_t;
+    [[nodiscard]] auto height() const noexcept -> uint32_t;
+
+    [[nodiscard]] auto at(uint32_t x, uint32_t y) const -> const sums &;
+
+    // Sums over [x0,x1) x [y0,y1)
+    [[nodiscard]] auto sum(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const -> sums;
+
+  private:
+    uint32_t width_ = 0;  // texture width
+    uint32_t height_ = 0; // texture height
+
+    std::vector<sums> data_; // (width + 1) * (height + 1) entries, first row and column are zero
+};
+} // namespace openktg::inline core
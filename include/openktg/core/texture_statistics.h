@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <openktg/core/texture.h>
+
+namespace openktg::inline core
+{
+// Per-channel statistics of a texture: full 16-bit histograms plus min, max,
+// mean and variance derived from them. Computed in one parallel pass over the
+// pixels.
+class texture_statistics
+{
+  public:
+    static constexpr uint32_t channels = 4;  // r, g, b, a
+    static constexpr uint32_t bins = 65536; // one bin per 16-bit value
+
+    struct channel_stats
+    {
+        uint16_t min = 0;
+        uint16_t max = 0;
+        double mean = 0.0;
+        double variance = 0.0; // population variance
+    };
+
+    texture_statistics() = default;
+    explicit texture_statistics(const texture &tex);
+
+    [[nodiscard]] auto pixel_count() const noexcept -> uint32_t;
+
+    [[nodiscard]] auto stats(uint32_t channel) const -> const channel_stats &;
+    [[nodiscard]] auto histogram(uint32_t channel) const -> std::span<const uint32_t>;
+
+    // Smallest value v such that more than rank pixels of the channel are <= v
+    [[nodiscard]] auto value_at_rank(uint32_t channel, uint32_t rank) const -> uint16_t;
+
+  private:
+    uint32_t pixel_count_ = 0;
+
+    std::array<channel_stats, channels> stats_;
+    std::vector<uint32_t> histograms_; // channels * bins entries
+};
+} // namespace openktg::inline core
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <openktg/graph/cache.h>
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+// Parameter word index of node set to value, as recipe::set_param
+struct param_override
+{
+    node_id node;
+    uint32_t index;
+    uint32_t value;
+
+    static auto of_int(node_id node, uint32_t index, int32_t value) -> param_override
+    {
+        return {node, index, static_cast<uint32_t>(value)};
+    }
+    static auto of_float(node_id node, uint32_t index, float value) -> param_override
+    {
+        return {node, index, std::bit_cast<uint32_t>(value)};
+    }
+};
+
+// One variant of a recipe: the parameters it changes
+struct variant
+{
+    std::vector<param_override> overrides;
+};
+
+// Evaluates the given nodes of r for every variant; results[v][i] is node outputs[i] of variant v.
+// Each distinct computation runs once: nodes whose operator, parameters and inputs come out the
+// same in several variants (the shared prefix, and also variants that happen to agree) are
+// computed once and their results shared. Nodes go in recipe order, and the distinct versions
+// of a node are computed in parallel. Results are released after their last reader.
+auto evaluate_batch(const recipe &r, std::span<const node_id> outputs, std::span<const variant> variants) -> std::vector<std::vector<texture_ptr>>;
+} // namespace openktg::graph
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <openktg/core/texture.h>
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+// A recipe together with the nodes it is run for, as bytecode carries it
+struct program
+{
+    recipe nodes;
+    std::vector<node_id> outputs;
+};
+
+// Compact binary form of a recipe and its outputs. After a 4-byte magic and a version byte come
+// the node and output counts, then one instruction per node: the operator byte, the size as
+// log2(width) | log2(height) << 4 for operators that do not take it from an input, the inputs as
+// distances back to the nodes they reference (0 for an absent optional one), and the parameters.
+// Integers are LEB128 varints (zigzag for signed ones), colors and floats 4 little-endian bytes.
+// Outputs follow as node indices. A 200-node recipe is a few kilobytes.
+auto encode(const recipe &r, std::span<const node_id> outputs) -> std::vector<uint8_t>;
+
+// Reads bytecode back; nothing if it is malformed (truncated, unknown operators, references to
+// later nodes, wrong input counts or sizes, trailing bytes) or out of range: sides beyond 8192,
+// enum and flag values the operators do not define, voronoi counts outside 1..256, noise
+// frequencies and octaves that overflow its lattice, blur orders beyond 16, non-finite floats,
+// and positions or matrix entries beyond +-64
+auto decode(std::span<const uint8_t> code) -> std::optional<program>;
+
+// Decodes code and evaluates its outputs with planned buffers; element i is output i
+auto interpret(std::span<const uint8_t> code) -> std::optional<std::vector<texture>>;
+} // namespace openktg::graph
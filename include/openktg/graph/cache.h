@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <vector>
+
+#include <openktg/core/texture.h>
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+// Results shared between the cache and its users; never modified once cached
+using texture_ptr = std::shared_ptr<const texture>;
+
+// 128-bit content address of a node result: a hash of its operator, size and parameters
+// together with the addresses of its inputs and the operator revision, so equal keys mean equal
+// computations
+struct cache_key
+{
+    uint64_t lo = 0, hi = 0;
+
+    auto operator==(const cache_key &) const -> bool = default;
+};
+
+// Revision of the operators' output bits, hashed into every key. Bump it with any change to the
+// results of an operator, so that results persisted by older builds are no longer found.
+inline constexpr uint32_t operator_revision = 1;
+
+// Content addresses of all nodes of r
+auto node_keys(const recipe &r) -> std::vector<cache_key>;
+
+// Memory-bounded map from content addresses to results, safe to share between threads.
+// Lookups take no cache-wide lock: the table is a fixed array of slots, each an atomic shared
+// pointer to an immutable entry, probed linearly (std::atomic<std::shared_ptr> is not lock-free in
+// libstdc++, which guards each access with a small internal lock). Inserts and evictions
+// serialize on a mutex. Evictions shift the following entries of the probe run back instead of
+// leaving tombstones, so misses stop at the first empty slot however much the cache churned; a
+// lookup racing with an eviction may miss. When full, it evicts the entry of lowest priority,
+// where an entry's priority on insert and on every hit is its compute cost per byte plus the
+// priority of the last evicted entry (GreedyDual-Size). Among entries of equal priority that is
+// the least recently used one; costly results per byte stay longer. Priorities only grow, so a
+// heap ordered by the priority each entry had when pushed finds the victim: entries whose
+// priority has grown since are pushed again as they come up.
+class result_cache
+{
+  public:
+    // Holds at most maxBytes of textures in at most maxEntries entries
+    explicit result_cache(uint64_t maxBytes, uint32_t maxEntries = 4096);
+
+    // The result cached under key, or null
+    auto find(const cache_key &key) -> texture_ptr;
+
+    // Caches t under key, as cost nanoseconds of work, and returns the cached result: the one
+    // another thread cached first, or t unless it is larger than the whole cache
+    auto insert(const cache_key &key, texture t, double cost) -> texture_ptr;
+
+    [[nodiscard]] auto bytes() const noexcept -> uint64_t;
+    [[nodiscard]] auto size() const noexcept -> uint32_t;
+    [[nodiscard]] auto hits() const noexcept -> uint64_t;
+    [[nodiscard]] auto misses() const noexcept -> uint64_t;
+
+  private:
+    struct entry
+    {
+        cache_key key;
+        texture_ptr result;
+        uint64_t bytes = 0;
+        double weight = 0.0; // cost per byte
+        mutable std::atomic<double> priority = 0.0;
+        mutable std::atomic<uint64_t> last_use = 0;
+    };
+
+    // An entry as the eviction heap has it
+    struct ranked
+    {
+        double priority;
+        uint64_t last_use;
+        std::shared_ptr<const entry> e;
+    };
+
+    // Heap order: whether a is to be evicted after b
+    static auto later(const ranked &a, const ranked &b) -> bool;
+
+    auto evict_one() -> bool;
+    void remove_slot(uint32_t hole);
+
+    uint64_t max_bytes_;
+    uint32_t max_entries_;
+    uint32_t mask_;
+    std::unique_ptr<std::atomic<std::shared_ptr<const entry>>[]> slots_;
+
+    std::mutex write_;
+    std::vector<ranked> heap_; // every entry once, lowest priority on top; guarded by write_
+    std::atomic<uint64_t> bytes_ = 0;
+    std::atomic<uint32_t> size_ = 0;
+    std::atomic<uint64_t> hits_ = 0, misses_ = 0;
+    std::atomic<double> inflation_ = 0.0; // priority of the last evicted entry
+    std::atomic<uint64_t> clock_ = 0;      // orders uses
+};
+
+class disk_cache;
+
+// Hit and miss counts per node of a recipe, summed over evaluate_cached calls. Misses of
+// the memory cache that the disk cache had count as disk hits too.
+struct cache_counters
+{
+    std::vector<uint64_t> hits, misses, disk_hits;
+};
+
+// Evaluates the given nodes of r, taking results from cache where it has them and caching the
+// ones computed; results[i] is node outputs[i]. Inputs of cached nodes are not looked up nor
+// computed. Same results as evaluate. counters, if given, count the lookups per node. With a
+// disk cache, memory misses are looked up there next, and computed results are stored there too.
+// Operators and the memory cache hold textures that own their pixels, so a disk hit is copied
+// once out of its mapping into the memory cache (a memcpy, against recomputing the node); later
+// hits of the same node share that copy. Zero-copy reads go through disk_cache::find directly.
+void evaluate_cached(const recipe &r, std::span<const node_id> outputs, std::span<texture_ptr> results, result_cache &cache,
+                     cache_counters *counters = nullptr, disk_cache *disk = nullptr);
+} // namespace openktg::graph
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <span>
+
+#include <openktg/core/texture.h>
+#include <openktg/graph/cache.h>
+
+namespace openktg::graph
+{
+// A cached result file mapped read-only; the pixels point into the mapping
+class mapped_texture
+{
+  public:
+    mapped_texture(const mapped_texture &) = delete;
+    mapped_texture(mapped_texture &&other) noexcept;
+    ~mapped_texture();
+
+    auto operator=(const mapped_texture &) -> mapped_texture & = delete;
+    auto operator=(mapped_texture &&other) noexcept -> mapped_texture &;
+
+    [[nodiscard]] auto width() const noexcept -> uint32_t;
+    [[nodiscard]] auto height() const noexcept -> uint32_t;
+    [[nodiscard]] auto pixels() const noexcept -> std::span<const pixel>;
+    [[nodiscard]] auto cost() const noexcept -> double; // nanoseconds it took to compute
+
+    // A texture with a copy of the pixels, for the operators, which read textures that own theirs
+    [[nodiscard]] auto to_texture() const -> texture;
+
+  private:
+    friend class disk_cache;
+    mapped_texture(void *base, uint64_t length);
+
+    void *base_ = nullptr;
+    uint64_t length_ = 0;
+};
+
+// Directory of node results that persists across runs, keyed by cache_key. Each result is one file:
+// a 64-byte header (magic, format version, size, key, cost) followed by the raw pixels, in the byte
+// order of the machine that wrote it, so a hit maps the file and reads the pixels in place;
+// evaluate_cached copies them once into its memory cache. Keys carry operator_revision, so results
+// of other revisions of the operators are never found, and age out. Files are written under a
+// temporary name, synced, renamed over their final name and the directory synced, so readers and
+// crashes never see a partial file. Temporaries untouched for an hour are taken for crash leftovers
+// and removed when a cache is opened on the directory; younger ones may belong to a live writer.
+// Hits refresh the file time, and when the files grow past maxBytes the least recently used go
+// until they are back under 90% of it, so a full cache rescans the directory once per tenth of
+// maxBytes stored, not on every store. Several processes may share a directory; each keeps its own
+// estimate of its size and rescans it when trimming, one thread at a time.
+class disk_cache
+{
+  public:
+    disk_cache(std::filesystem::path directory, uint64_t maxBytes);
+
+    // The result stored under key, or nothing; files that do not hold a valid result are removed
+    auto find(const cache_key &key) -> std::optional<mapped_texture>;
+
+    // Stores t under key, as cost nanoseconds of work, then trims the directory if it grew past the bound
+    void store(const cache_key &key, const texture &t, double cost);
+
+    // Removes the least recently used results until the directory fits 90% of maxBytes
+    void trim();
+
+    [[nodiscard]] auto bytes() const noexcept -> uint64_t;
+
+  private:
+    [[nodiscard]] auto path_of(const cache_key &key) const -> std::filesystem::path;
+    void trim_locked();
+
+    std::filesystem::path directory_;
+    uint64_t max_bytes_;
+    std::mutex trim_mutex_; // held while scanning and removing
+    std::atomic<uint64_t> bytes_ = 0;
+    std::atomic<uint64_t> temporaries_ = 0; // names temporaries apart within the process
+};
+} // namespace openktg::graph
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <openktg/core/texture.h>
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+// Runs the operator of node id of r into out, resized to the node size. inputs holds the
+// textures of the node inputs in order (null for absent optional ones).
+void run_node(const recipe &r, node_id id, std::span<const texture *const> inputs, texture &out);
+
+// Evaluates every node of r, one full texture after the other; element i of the result is node i
+auto evaluate(const recipe &r) -> std::vector<texture>;
+
+// Evaluates the given nodes of r tile by tile; results[i] is node outputs[i]. For every tileSize x tileSize
+// tile of an output, each node it depends on is computed on just the pixels the tile needs (the tile grown by
+// the footprints of the operators downstream: Blur radius, Derive +-1, CoordMatrixTransform source bounds) in
+// scratch buffers, so intermediates stay in cache. Full textures are computed first for inputs that are
+// sampled anywhere (gradients, Paste snippets, Noise/GlowRect/ColorRemap/Bump gradients), for voronoi and
+// LinearCombine with inputs, for inputs of Blurs wider than half a tile and of minifying or rotating
+// CoordMatrixTransforms (whose halos would mostly be recomputed per tile), and for everything those depend on.
+// Same results as evaluate.
+void evaluate_tiled(const recipe &r, std::span<const node_id> outputs, std::span<texture> results, int32_t tileSize = 64);
+} // namespace openktg::graph
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <openktg/core/texture.h>
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+// Pixels [x0,x1] x [y0,y1] of a texture, empty if x1 < x0
+struct rect
+{
+    int32_t x0 = 0, y0 = 0, x1 = -1, y1 = -1;
+
+    [[nodiscard]] auto empty() const -> bool
+    {
+        return x1 < x0 || y1 < y0;
+    }
+};
+
+// Keeps the results of every node of a recipe and brings them up to date with edited versions of it,
+// recomputing only what changed. Each node has a parameter version, bumped when its parameters differ
+// from the last update, and a result version, bumped when it is recomputed; a node reruns when its
+// parameters or the result version of an input moved. Spatially local operators rerun on dirty
+// rectangles only: per-pixel ones on the union of their inputs' rectangles, Derive and Blur on those
+// grown by their reach, GlowRect and Paste also on the old and new bounds of the glow or snippet when
+// just their placement changed. Everything else, and nodes whose inputs or size changed, rerun whole.
+class incremental_evaluator
+{
+  public:
+    // Evaluates r, reusing the results of the last update where r still matches it. Node i of r
+    // takes over node i of the previous recipe. Results are the same as evaluate(r).
+    void update(const recipe &r);
+
+    [[nodiscard]] auto result(node_id id) const -> const texture &;
+    [[nodiscard]] auto param_version(node_id id) const -> uint64_t;
+    [[nodiscard]] auto version(node_id id) const -> uint64_t;
+    [[nodiscard]] auto dirty(node_id id) const -> rect; // pixels recomputed by the last update
+
+  private:
+    recipe recipe_;
+    std::vector<texture> results_;
+    std::vector<uint64_t> param_versions_, versions_;
+    std::vector<std::vector<uint64_t>> seen_; // result versions of the inputs each node was computed from
+    std::vector<rect> dirty_;
+    uint64_t counter_ = 0;
+};
+} // namespace openktg::graph
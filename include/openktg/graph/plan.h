@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <openktg/core/texture.h>
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+// Marks a node that gets no buffer because no output depends on it
+inline constexpr uint32_t no_buffer = ~uint32_t(0);
+
+// Size of one physical texture of a plan
+struct buffer_size
+{
+    uint32_t width, height;
+};
+
+// Physical textures for evaluating a recipe. Nodes share a buffer when their results are not
+// needed at the same time; see plan_buffers.
+struct buffer_plan
+{
+    std::vector<uint32_t> buffer_of;  // buffer each node writes, no_buffer for nodes not needed
+    std::vector<bool> in_place;       // node writes over the buffer of its first input
+    std::vector<buffer_size> buffers; // physical textures, allocated when first written
+    uint64_t peak_bytes = 0;          // pixel memory of all buffers, the most the plan ever holds
+    uint64_t unplanned_bytes = 0;     // pixel memory of one texture per needed node, as evaluate holds
+};
+
+// Assigns buffers for computing the given nodes of r in recipe order. A buffer is free again once
+// the last node reading it has run, and goes to the next node of the same size. A node overwrites
+// its first input in place if that is the input's last read and the operator allows it: the
+// per-pixel ones, Blur, and the background of GlowRect and Paste or the surface of Bump.
+// Outputs keep their buffers to the end.
+auto plan_buffers(const recipe &r, std::span<const node_id> outputs) -> buffer_plan;
+
+// Evaluates the given nodes of r with the buffers of plan (made by plan_buffers for the same
+// outputs); results[i] is node outputs[i]. Same results as evaluate.
+void evaluate_planned(const recipe &r, const buffer_plan &plan, std::span<const node_id> outputs, std::span<texture> results);
+} // namespace openktg::graph
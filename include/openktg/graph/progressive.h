@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <span>
+
+#include <openktg/graph/cache.h>
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+// Copy of r at lower resolution: all sizes are divided by the same power of two, so that no side
+// exceeds maxSide (gradients keep theirs). Positions, radii and frequencies are relative to the
+// texture size and carry over; derive strengths, which apply per pixel, are divided too, and noise
+// drops the octaves above the Nyquist frequency of its new size. r itself if it already fits.
+auto scale_recipe(const recipe &r, uint32_t maxSide) -> recipe;
+
+// Called with the side limit of a level and its results; returns whether to go on
+using level_callback = std::function<bool(uint32_t maxSide, std::span<const texture_ptr> results)>;
+
+// Evaluates the given nodes of r at each of levels (side limits, ascending) and then at full
+// size, handing each level's results to deliver as soon as they are ready. All levels go through
+// cache, so nodes that come out the same at several levels (gradients, nodes already small
+// enough, whole recipes below a level) are computed once, and so are the levels of a recipe
+// evaluated before. Levels at least as large as r are skipped; the last call has the full-size
+// results, the same as evaluate.
+void evaluate_progressive(const recipe &r, std::span<const node_id> outputs, std::span<const uint32_t> levels, result_cache &cache,
+                          const level_callback &deliver);
+} // namespace openktg::graph
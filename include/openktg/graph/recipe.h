@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <openktg/core/matrix.h>
+#include <openktg/core/pixel.h>
+#include <openktg/tex/composite.h>
+#include <openktg/tex/filters.h>
+
+namespace openktg::graph
+{
+using node_id = uint32_t;
+
+// Marks an absent optional input
+inline constexpr node_id no_node = ~node_id(0);
+
+// Operators a recipe node runs; each stands for the library call of the same name
+enum class op : uint8_t
+{
+    gradient,       // LinearGradient
+    noise,          // Noise
+    voronoi,        // RandomVoronoi
+    glow_rect,      // GlowRect
+    linear_combine, // LinearCombine
+    colorize,       // Colorize
+    color_matrix,   // ColorMatrixTransform
+    color_remap,    // ColorRemap
+    coord_matrix,   // CoordMatrixTransform
+    derive,         // Derive
+    blur,           // Blur
+    ternary,        // Ternary
+    paste,          // Paste
+    bump,           // Bump
+};
+
+// One operator call. Inputs and params follow the argument order of the library call;
+// params are 32 bits each, floats stored as their bits and pixels as two words.
+struct node
+{
+    op kind;
+    uint32_t width, height;      // size of the result
+    std::vector<node_id> inputs; // textures read (no_node for absent optional ones)
+    std::vector<uint32_t> params;
+
+    [[nodiscard]] auto param_int(uint32_t i) const -> int32_t;
+    [[nodiscard]] auto param_float(uint32_t i) const -> float;
+    [[nodiscard]] auto param_pixel(uint32_t i) const -> pixel;
+    [[nodiscard]] auto param_matrix(uint32_t i) const -> matrix44<float>;
+};
+
+// One input of linear_combine, as LinearInput
+struct linear_term
+{
+    node_id tex;
+    float weight;
+    float ushift, vshift;
+    int32_t filter_mode;
+};
+
+// A texture graph: nodes in the order they were added, so every node comes after its inputs
+class recipe
+{
+  public:
+    auto gradient(uint32_t startCol, uint32_t endCol) -> node_id;
+    auto noise(uint32_t width, uint32_t height, node_id grad, int32_t freqX, int32_t freqY, int32_t oct, float fadeoff, int32_t seed, int32_t mode) -> node_id;
+    auto voronoi(uint32_t width, uint32_t height, node_id grad, int32_t intensity, int32_t maxCount, float minDist, int32_t seed) -> node_id;
+    auto glow_rect(node_id background, node_id grad, float orgx, float orgy, float ux, float uy, float vx, float vy, float rectu, float rectv) -> node_id;
+    auto linear_combine(uint32_t width, uint32_t height, const pixel &color, float constWeight, const linear_term *terms, int32_t nTerms) -> node_id;
+    auto colorize(node_id in, uint32_t startCol, uint32_t endCol) -> node_id;
+    auto color_matrix(node_id in, const matrix44<float> &matrix, bool clampPremult) -> node_id;
+    auto color_remap(node_id in, node_id mapR, node_id mapG, node_id mapB) -> node_id;
+    auto coord_matrix(node_id in, const matrix44<float> &matrix, int32_t filterMode) -> node_id;
+    auto derive(node_id in, DeriveOp deriveOp, float strength, DeriveStencil stencil = DeriveCentral) -> node_id;
+    auto blur(node_id in, float sizex, float sizey, int32_t order, int32_t mode, bool srgb = false) -> node_id; // BlurSRGB with srgb
+    auto ternary(node_id in1, node_id in2, node_id in3, TernaryOp ternaryOp) -> node_id;
+    auto paste(node_id background, node_id snippet, float orgx, float orgy, float ux, float uy, float vx, float vy, CombineOp combineOp, int32_t mode)
+        -> node_id;
+    auto bump(node_id surface, node_id normals, node_id specular, node_id falloff, float px, float py, float pz, float dx, float dy, float dz,
+              const pixel &ambient, const pixel &diffuse, bool directional) -> node_id;
+
+    // Adds a node built elsewhere, such as decoded bytecode; its inputs must come before it
+    auto append(node n) -> node_id;
+
+    // Sets parameter word index of node id, keeping everything else
+    void set_param(node_id id, uint32_t index, uint32_t value);
+
+    [[nodiscard]] auto size() const noexcept -> uint32_t;
+    [[nodiscard]] auto operator[](node_id id) const -> const node &;
+
+  private:
+    auto add(op kind, uint32_t width, uint32_t height, std::vector<node_id> inputs) -> node &;
+
+    std::vector<node> nodes_;
+};
+} // namespace openktg::graph
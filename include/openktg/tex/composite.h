@@ -2,10 +2,11 @@
 
 #include <cstdint>
 
+#include <openktg/core/pixel.h>
+
 // fwd
 namespace openktg::inline core
 {
-class pixel;
 class texture;
 } // namespace openktg::inline core
 
@@ -17,6 +18,17 @@ struct LinearInput
     int32_t FilterMode;          // filtering mode (as in CoordMatrixTransform)
 };
 
+// One light of BumpMulti; fields have the meaning of the Bump parameters of the same name
+struct BumpLight
+{
+    float Px, Py, Pz;                 // light position (point lights)
+    float Dx, Dy, Dz;                 // light direction
+    openktg::pixel Ambient, Diffuse;  // light colors
+    const openktg::texture *Specular; // specular gradient (may be null)
+    const openktg::texture *Falloff;  // spot falloff gradient (may be null)
+    bool Directional;                 // directional or point light
+};
+
 // Ternary operations
 enum TernaryOp
 {
@@ -43,10 +55,31 @@ enum CombineOp
     CombineLighten,
 };
 
+// One layer of CompositeStack; fields have the meaning of the Paste parameters of the same name
+struct CompositeLayer
+{
+    const openktg::texture *Tex; // the snippet
+    float OrgX, OrgY;            // origin of the snippet
+    float UX, UY, VX, VY;        // snippet u/v axes
+    CombineOp Op;                // how the snippet combines with what is below
+    int32_t Mode;                // filtering mode (as in Paste)
+};
+
 void Ternary(openktg::texture &input, const openktg::texture &in1, const openktg::texture &in2, const openktg::texture &in3, TernaryOp op);
 void Paste(openktg::texture &input, const openktg::texture &background, const openktg::texture &snippet, float orgx, float orgy, float ux, float uy, float vx,
            float vy, CombineOp op, int32_t mode);
+// Pastes all layers onto the background in order, walking the destination once in tiles;
+// same result as one Paste per layer. Layer textures must not be the destination.
+void CompositeStack(openktg::texture &input, const openktg::texture &background, const CompositeLayer *layers, int32_t nLayers);
 void Bump(openktg::texture &input, const openktg::texture &surface, const openktg::texture &normals, const openktg::texture *specular,
           const openktg::texture *falloff, float px, float py, float pz, float dx, float dy, float dz, const openktg::pixel &ambient,
           const openktg::pixel &diffuse, bool directional);
+// Bump with normals derived from the red channel of a height map on the fly;
+// same result as Derive(normals, height, DeriveNormals, strength) followed by Bump.
+void BumpFromHeight(openktg::texture &input, const openktg::texture &surface, const openktg::texture &height, float strength, const openktg::texture *specular,
+                    const openktg::texture *falloff, float px, float py, float pz, float dx, float dy, float dz, const openktg::pixel &ambient,
+                    const openktg::pixel &diffuse, bool directional);
+// Sum of the Bump results of all lights, accumulated in one sweep over surface and normals;
+// same result as Bump per light followed by Paste(..., CombineAdd, ...) into the first one.
+void BumpMulti(openktg::texture &input, const openktg::texture &surface, const openktg::texture &normals, const BumpLight *lights, int32_t nLights);
 void LinearCombine(openktg::texture &input, const openktg::pixel &color, float constWeight, const LinearInput *inputs, int32_t nInputs);
\ No newline at end of file
@@ -18,9 +18,53 @@ enum DeriveOp
     DeriveNormals,
 };
 
+// Derive difference stencils
+enum DeriveStencil
+{
+    DeriveCentral = 0, // 2-tap central difference
+    DeriveSobel,       // 3x3 Sobel
+    DeriveScharr,      // 3x3 Scharr
+};
+
+// Resample filters
+enum ResampleFilter
+{
+    ResampleMitchell = 0, // Mitchell-Netravali cubic (B = C = 1/3)
+    ResampleLanczos3,     // 3-lobe Lanczos
+};
+
 void ColorMatrixTransform(openktg::texture &input, const openktg::texture &in, const openktg::matrix44<float> &matrix, bool clampPremult);
 void CoordMatrixTransform(openktg::texture &input, const openktg::texture &in, const openktg::matrix44<float> &matrix, int32_t filterMode);
 void ColorRemap(openktg::texture &input, const openktg::texture &in, const openktg::texture &mapR, const openktg::texture &mapG, const openktg::texture &mapB);
 void CoordRemap(openktg::texture &input, const openktg::texture &in, const openktg::texture &remap, float strengthU, float strengthV, int32_t filterMode);
-void Derive(openktg::texture &input, const openktg::texture &in, DeriveOp op, float strength);
-void Blur(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t order, int32_t mode);
\ No newline at end of file
+void Derive(openktg::texture &input, const openktg::texture &in, DeriveOp op, float strength, DeriveStencil stencil = DeriveCentral);
+void Blur(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t order, int32_t mode);
+// Blur of sRGB-encoded colors in linear light: pixels are decoded as the first pass loads them and encoded as the last
+// one stores them. Same result as ToLinear, Blur and ToSRGB whenever it blurs at all; otherwise a copy.
+void BlurSRGB(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t order, int32_t mode);
+// Box blur with a per-pixel half size of control.r/65535 times sizex/sizey (relative to the texture size, as in Blur),
+// rounded to whole pixels. Constant time per pixel for any size.
+void VariableBlur(openktg::texture &input, const openktg::texture &in, const openktg::texture &control, float sizex, float sizey, int32_t mode);
+// Per-channel minimum (Erode) / maximum (Dilate) over a box of half size sizex/sizey (relative to the texture size,
+// truncated to whole pixels). Constant time per pixel for any size.
+void Erode(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t mode);
+void Dilate(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t mode);
+// Per-channel rank order filter over a box of half size sizex/sizey (as in Erode/Dilate); rank=0 is the minimum,
+// rank=1 the maximum and rank=0.5 the median. Constant time per pixel for windows up to 447 pixels wide,
+// whose column histograms fit 64 MB; wider ones take time linear in the window height.
+void RankFilter(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, float rank, int32_t mode);
+void Median(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t mode);
+// Stretches r, g and b so the given fraction of pixels at either end of each channel's histogram
+// maps to 0 and 65535. Alpha is kept; colors are clamped to it.
+void AutoLevels(openktg::texture &input, const openktg::texture &in, float clip);
+// Histogram equalization of r, g and b; alpha is kept and colors are clamped to it.
+void Equalize(openktg::texture &input, const openktg::texture &in);
+// Resamples in to the size of each of the nOutputs textures in outputs (which must not include in). Outputs of the
+// same width share the horizontal pass.
+void Resample(openktg::texture *outputs, int32_t nOutputs, const openktg::texture &in, ResampleFilter filter, int32_t mode);
+// Color space conversions of premultiplied textures through 16-bit tables.
+void ToLinear(openktg::texture &input, const openktg::texture &in);
+void ToSRGB(openktg::texture &input, const openktg::texture &in);
+// Edge-preserving smoothing with a bilateral grid: spatial cells of sizex/sizey (relative to the texture size, as in
+// Blur, rounded down to a power of two pixels) and luminance cells of range (relative to full scale).
+void BilateralSmooth(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, float range, int32_t mode);
\ No newline at end of file
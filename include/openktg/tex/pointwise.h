@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include <openktg/tex/composite.h>
+#include <openktg/util/concepts.h>
+
+// fwd
+namespace openktg::inline core
+{
+class texture;
+template <arithmetic T> struct matrix44;
+} // namespace openktg::inline core
+
+// Pointwise stages
+enum PointwiseOp
+{
+    PointwiseColorMatrix = 0, // ColorMatrixTransform(x, Matrix, ClampPremult)
+    PointwiseColorRemap,      // ColorRemap(x, *Tex[0], *Tex[1], *Tex[2])
+    PointwiseTernary,         // Ternary(x, *Tex[0], *Tex[1], Ternary)
+    PointwiseCombine,         // Paste(x, x, *Tex[0], 0, 0, 1, 0, 0, 1, Combine, 0)
+    PointwiseClampPremult,    // x.clamp_premult()
+};
+
+// One stage of a Pointwise chain; x is the value produced by the previous stage
+struct PointwiseStage
+{
+    PointwiseOp Op;
+    const openktg::matrix44<float> *Matrix; // PointwiseColorMatrix: the color matrix
+    bool ClampPremult;                      // PointwiseColorMatrix: clamp colors to alpha
+    const openktg::texture *Tex[3];         // remap gradients (r, g, b), ternary operands 2 and 3, or the combined texture
+    TernaryOp Ternary;                      // PointwiseTernary: the operation
+    CombineOp Combine;                      // PointwiseCombine: the operation
+};
+
+// Runs the stages in order on in, one block of pixels at a time while it is in cache; same result as
+// the chain of operators the stages describe. input may be in; stage textures must not be input and,
+// except for remap gradients, must match the size of in.
+void Pointwise(openktg::texture &input, const openktg::texture &in, const PointwiseStage *stages, int32_t nStages);
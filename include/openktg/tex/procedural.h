@@ -79,8 +79,8 @@ static void RandomVoronoi(openktg::texture &dest, const openktg::texture &grad,
     Cells(dest, grad, centers, maxCount, 0.0f, CellInner);
 }
 
-// Transforms a grayscale image to a colored one with a matrix transform
-static void Colorize(openktg::texture &img, uint32_t startCol, uint32_t endCol)
+// Color matrix of Colorize: maps black to startCol and white to endCol
+static auto ColorizeMatrix(uint32_t startCol, uint32_t endCol) -> openktg::matrix44<float>
 {
     openktg::matrix44<float> m;
     openktg::pixel s{static_cast<openktg::color32_t>(startCol)};
@@ -96,6 +96,11 @@ static void Colorize(openktg::texture &img, uint32_t startCol, uint32_t endCol)
     m(1, 3) = s.g() / 65535.0f;
     m(2, 3) = s.b() / 65535.0f;
 
-    // transform
-    ColorMatrixTransform(img, img, m, true);
+    return m;
+}
+
+// Transforms a grayscale image to a colored one with a matrix transform
+static void Colorize(openktg::texture &img, uint32_t startCol, uint32_t endCol)
+{
+    ColorMatrixTransform(img, img, ColorizeMatrix(startCol, endCol), true);
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <latch>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace openktg::util
+{
+
+// Number of threads parallel loops spread their work over
+inline auto worker_count() noexcept -> std::uint32_t
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+namespace detail
+{
+
+// Set while a thread runs a chunk of a parallel loop; loops nested in it run inline
+inline thread_local bool in_parallel_loop = false;
+
+// worker_count() - 1 threads running the chunks of parallel loops, started on first use
+class thread_pool
+{
+  public:
+    static auto instance() -> thread_pool &
+    {
+        static thread_pool pool(worker_count() - 1);
+        return pool;
+    }
+
+    void submit(std::function<void()> task)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            tasks_.push_back(std::move(task));
+        }
+        ready_.notify_one();
+    }
+
+  private:
+    explicit thread_pool(std::uint32_t threads)
+    {
+        threads_.reserve(threads);
+        for (std::uint32_t i = 0; i < threads; i++)
+            threads_.emplace_back([this](std::stop_token stop) { run(stop); });
+    }
+
+    void run(std::stop_token stop)
+    {
+        in_parallel_loop = true;
+        for (;;)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock lock(mutex_);
+                ready_.wait(lock, stop, [&] { return !tasks_.empty(); });
+                if (tasks_.empty())
+                    return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable_any ready_;
+    std::deque<std::function<void()>> tasks_;
+    std::vector<std::jthread> threads_;
+};
+
+} // namespace detail
+
+// Number of chunks parallel_chunks splits [first, last) into; one inside another parallel loop
+inline auto chunk_count(std::uint32_t first, std::uint32_t last, std::uint32_t grain) noexcept -> std::uint32_t
+{
+    if (last <= first)
+        return 0;
+    if (detail::in_parallel_loop)
+        return 1;
+
+    grain = std::max(grain, 1u);
+    return std::min(worker_count(), (last - first + grain - 1) / grain);
+}
+
+// Calls fn(chunk, begin, end) for contiguous chunks of [first, last), in parallel on a shared
+// pool. Chunks hold at least grain elements (except possibly the last one); the calling
+// thread processes chunk 0 itself. Chunk indices are in [0, chunk_count(...)). Loops nested in
+// a chunk run inline as a single chunk, so they never wait on the pool nor oversubscribe it.
+template <class F> void parallel_chunks(std::uint32_t first, std::uint32_t last, std::uint32_t grain, F &&fn)
+{
+    const std::uint32_t chunks = chunk_count(first, last, grain);
+    if (chunks == 0)
+        return;
+    if (chunks == 1)
+    {
+        fn(0u, first, last);
+        return;
+    }
+
+    const std::uint32_t count = last - first;
+    auto bound = [&](std::uint32_t chunk) { return first + static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * chunk / chunks); };
+
+    std::latch done(chunks - 1);
+    for (std::uint32_t chunk = 1; chunk < chunks; chunk++)
+    {
+        detail::thread_pool::instance().submit([&fn, &done, chunk, begin = bound(chunk), end = bound(chunk + 1)] {
+            fn(chunk, begin, end);
+            done.count_down();
+        });
+    }
+
+    detail::in_parallel_loop = true;
+    fn(0u, bound(0), bound(1));
+    detail::in_parallel_loop = false;
+
+    done.wait();
+}
+
+// Calls fn(begin, end) for contiguous chunks of [first, last) in parallel
+template <class F> void parallel_for(std::uint32_t first, std::uint32_t last, std::uint32_t grain, F &&fn)
+{
+    parallel_chunks(first, last, grain, [&fn](std::uint32_t, std::uint32_t begin, std::uint32_t end) { fn(begin, end); });
+}
+
+} // namespace openktg::util
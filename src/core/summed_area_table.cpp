@@ -0,0 +1,72 @@
+#include <cassert>
+
+#include <openktg/core/summed_area_table.h>
+#include <openktg/util/parallel.h>
+
+namespace openktg::inline core
+{
+
+summed_area_table::summed_area_table(const texture &tex) : width_(tex.width()), height_(tex.height()), data_((width_ + 1) * (height_ + 1))
+{
+    const uint32_t stride = width_ + 1;
+
+    // prefix sums along rows, rows in parallel
+    util::parallel_for(0, height_, 64, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t y = begin; y < end; y++)
+        {
+            const pixel *src = &tex.at(0, y);
+            sums *dst = &data_[(y + 1) * stride];
+            sums acc = {};
+
+            dst[0] = acc;
+            for (uint32_t x = 0; x < width_; x++)
+            {
+                acc[0] += src[x].r();
+                acc[1] += src[x].g();
+                acc[2] += src[x].b();
+                acc[3] += src[x].a();
+                dst[x + 1] = acc;
+            }
+        }
+    });
+
+    // prefix sums down columns, column ranges in parallel
+    util::parallel_for(0, stride, 256, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t y = 1; y < height_; y++)
+        {
+            const sums *prev = &data_[y * stride];
+            sums *cur = &data_[(y + 1) * stride];
+
+            for (uint32_t x = begin; x < end; x++)
+                for (uint32_t c = 0; c < 4; c++)
+                    cur[x][c] += prev[x][c];
+        }
+    });
+}
+
+[[nodiscard]] auto summed_area_table::width() const noexcept -> uint32_t
+{
+    return width_;
+}
+[[nodiscard]] auto summed_area_table::height() const noexcept -> uint32_t
+{
+    return height_;
+}
+
+[[nodiscard]] auto summed_area_table::at(uint32_t x, uint32_t y) const -> const sums &
+{
+    assert(x <= width_ && y <= height_);
+    return data_[y * (width_ + 1) + x];
+}
+
+[[nodiscard]] auto summed_area_table::sum(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1) const -> sums
+{
+    const sums &a = at(x0, y0);
+    const sums &b = at(x1, y0);
+    const sums &c = at(x0, y1);
+    const sums &d = at(x1, y1);
+
+    return {d[0] - b[0] - c[0] + a[0], d[1] - b[1] - c[1] + a[1], d[2] - b[2] - c[2] + a[2], d[3] - b[3] - c[3] + a[3]};
+}
+
+} // namespace openktg::inline core
@@ -0,0 +1,114 @@
+#include <cassert>
+
+#include <openktg/core/texture_statistics.h>
+#include <openktg/util/parallel.h>
+
+namespace openktg::inline core
+{
+
+texture_statistics::texture_statistics(const texture &tex) : pixel_count_(tex.pixel_count()), histograms_(channels * bins)
+{
+    const uint32_t width = tex.width();
+    const uint32_t height = tex.height();
+    const uint32_t grain = 16;
+    const uint32_t size = channels * bins;
+
+    // every chunk but the first counts into its own partial histograms
+    const uint32_t chunks = util::chunk_count(0, height, grain);
+    std::vector<uint32_t> partial(chunks > 1 ? (chunks - 1) * size : 0);
+
+    util::parallel_chunks(0, height, grain, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+        uint32_t *hr = chunk == 0 ? histograms_.data() : &partial[(chunk - 1) * size];
+        uint32_t *hg = hr + bins;
+        uint32_t *hb = hg + bins;
+        uint32_t *ha = hb + bins;
+
+        for (uint32_t y = begin; y < end; y++)
+        {
+            const pixel *src = &tex.at(0, y);
+            for (uint32_t x = 0; x < width; x++)
+            {
+                hr[src[x].r()]++;
+                hg[src[x].g()]++;
+                hb[src[x].b()]++;
+                ha[src[x].a()]++;
+            }
+        }
+    });
+
+    // merge partial histograms, bin ranges in parallel
+    if (chunks > 1)
+    {
+        util::parallel_for(0, size, 4096, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t c = 0; c + 1 < chunks; c++)
+            {
+                const uint32_t *src = &partial[c * size];
+                for (uint32_t i = begin; i < end; i++)
+                    histograms_[i] += src[i];
+            }
+        });
+    }
+
+    if (pixel_count_ == 0)
+        return;
+
+    // moments from the histograms
+    for (uint32_t c = 0; c < channels; c++)
+    {
+        const uint32_t *h = &histograms_[c * bins];
+        channel_stats &s = stats_[c];
+
+        uint64_t sum = 0;
+        for (uint32_t v = 0; v < bins; v++)
+            sum += uint64_t(h[v]) * v;
+
+        s.mean = double(sum) / pixel_count_;
+
+        double var = 0.0;
+        for (uint32_t v = 0; v < bins; v++)
+            var += h[v] * ((v - s.mean) * (v - s.mean));
+
+        s.variance = var / pixel_count_;
+
+        uint32_t lo = 0, hi = bins - 1;
+        while (h[lo] == 0)
+            lo++;
+        while (h[hi] == 0)
+            hi--;
+
+        s.min = static_cast<uint16_t>(lo);
+        s.max = static_cast<uint16_t>(hi);
+    }
+}
+
+[[nodiscard]] auto texture_statistics::pixel_count() const noexcept -> uint32_t
+{
+    return pixel_count_;
+}
+
+[[nodiscard]] auto texture_statistics::stats(uint32_t channel) const -> const channel_stats &
+{
+    assert(channel < channels);
+    return stats_[channel];
+}
+
+[[nodiscard]] auto texture_statistics::histogram(uint32_t channel) const -> std::span<const uint32_t>
+{
+    assert(channel < channels && !histograms_.empty());
+    return {&histograms_[channel * bins], bins};
+}
+
+[[nodiscard]] auto texture_statistics::value_at_rank(uint32_t channel, uint32_t rank) const -> uint16_t
+{
+    assert(rank < pixel_count_);
+
+    std::span<const uint32_t> h = histogram(channel);
+    uint64_t count = 0;
+    uint32_t v = 0;
+    while ((count += h[v]) <= rank)
+        v++;
+
+    return static_cast<uint16_t>(v);
+}
+
+} // namespace openktg::inline core
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <memory>
+
+#include <openktg/graph/batch.h>
+#include <openktg/graph/evaluate.h>
+#include <openktg/util/parallel.h>
+
+namespace openktg::graph
+{
+
+auto evaluate_batch(const recipe &r, std::span<const node_id> outputs, std::span<const variant> variants) -> std::vector<std::vector<texture_ptr>>
+{
+    const node_id count = r.size();
+    const uint32_t variantCount = variants.size();
+
+    // overrides change parameters only, so all variants share the shape of r
+    std::vector<recipe> recipes(variantCount, r);
+    std::vector<std::vector<cache_key>> keys(variantCount);
+    for (uint32_t v = 0; v < variantCount; v++)
+    {
+        for (const param_override &o : variants[v].overrides)
+            recipes[v].set_param(o.node, o.index, o.value);
+        keys[v] = node_keys(recipes[v]);
+    }
+
+    // nodes the outputs depend on, and the last node reading each; outputs are kept to the end
+    std::vector<bool> needed(count, false);
+    std::vector<node_id> lastUse(count, 0);
+    for (node_id out : outputs)
+    {
+        needed[out] = true;
+        lastUse[out] = count;
+    }
+    for (node_id id = count; id-- > 0;)
+    {
+        if (!needed[id])
+            continue;
+
+        for (node_id in : r[id].inputs)
+        {
+            if (in == no_node)
+                continue;
+
+            needed[in] = true;
+            lastUse[in] = std::max(lastUse[in], id);
+        }
+    }
+
+    std::vector<std::vector<texture_ptr>> found(variantCount, std::vector<texture_ptr>(count));
+    std::vector<uint32_t> order(variantCount), firstOf, distinctOf(variantCount);
+    std::vector<texture_ptr> computed;
+
+    for (node_id id = 0; id < count; id++)
+    {
+        if (!needed[id])
+            continue;
+
+        // group the variants by what this node computes in them
+        for (uint32_t v = 0; v < variantCount; v++)
+            order[v] = v;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+            const cache_key &ka = keys[a][id], &kb = keys[b][id];
+            return ka.hi != kb.hi ? ka.hi < kb.hi : ka.lo != kb.lo ? ka.lo < kb.lo : a < b;
+        });
+
+        firstOf.clear();
+        for (uint32_t v : order)
+        {
+            if (firstOf.empty() || keys[firstOf.back()][id] != keys[v][id])
+                firstOf.push_back(v);
+            distinctOf[v] = firstOf.size() - 1;
+        }
+
+        // compute each distinct version once, in the first variant that has it; several versions
+        // run side by side with the operators' own loops inline, a single one spreads its loops
+        computed.assign(firstOf.size(), nullptr);
+        util::parallel_for(0, firstOf.size(), 1, [&](uint32_t begin, uint32_t end) {
+            std::vector<const texture *> inputs;
+            for (uint32_t k = begin; k < end; k++)
+            {
+                const uint32_t v = firstOf[k];
+
+                inputs.clear();
+                for (node_id in : r[id].inputs)
+                    inputs.push_back(in == no_node ? nullptr : found[v][in].get());
+
+                texture t;
+                run_node(recipes[v], id, inputs, t);
+                computed[k] = std::make_shared<const texture>(std::move(t));
+            }
+        });
+
+        for (uint32_t v = 0; v < variantCount; v++)
+            found[v][id] = computed[distinctOf[v]];
+
+        for (node_id in : r[id].inputs)
+        {
+            if (in != no_node && lastUse[in] == id)
+            {
+                for (uint32_t v = 0; v < variantCount; v++)
+                    found[v][in].reset();
+            }
+        }
+    }
+
+    std::vector<std::vector<texture_ptr>> results(variantCount);
+    for (uint32_t v = 0; v < variantCount; v++)
+    {
+        for (node_id out : outputs)
+            results[v].push_back(found[v][out]);
+    }
+
+    return results;
+}
+
+} // namespace openktg::graph
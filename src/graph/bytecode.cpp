@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <string_view>
+
+#include <openktg/graph/bytecode.h>
+#include <openktg/graph/plan.h>
+#include <openktg/tex/generators.h>
+#include <openktg/tex/sampling.h>
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+constexpr uint8_t magic[4] = {'O', 'K', 'T', 'R'};
+constexpr uint8_t format_version = 1;
+
+// Limits decode enforces beyond what the operators themselves assert
+constexpr uint32_t max_side_log2 = 13; // 8192 pixels
+constexpr int32_t max_blur_order = 16;
+constexpr float max_fixed = 64.0f; // keeps 8.24 fixed point conversions within 31 bits
+
+// Parameter words of each operator: 'i' for integers (zigzag varints), 'c' for colors, 'f' for
+// floats and 'x' for floats the operators turn into fixed point (raw words); linear_combine
+// repeats its term signature once per input
+auto signature(op kind) -> std::string_view
+{
+    switch (kind)
+    {
+    case op::gradient:
+    case op::colorize:
+        return "cc";
+    case op::noise:
+        return "iiifii";
+    case op::voronoi:
+        return "iifi";
+    case op::glow_rect:
+        return "xxxxxxxx";
+    case op::linear_combine:
+        return "ccx";
+    case op::color_matrix:
+    case op::coord_matrix:
+        return "xxxxxxxxxxxxxxxxi";
+    case op::color_remap:
+        return "";
+    case op::derive:
+        return "ifi";
+    case op::blur:
+        return "ffiii";
+    case op::ternary:
+        return "i";
+    case op::paste:
+        return "xxxxxxii";
+    case op::bump:
+        return "ffffffcccci";
+    }
+
+    return "";
+}
+
+constexpr std::string_view linear_term_signature = "xxxi";
+
+// Whether a raw parameter word is a value of its type: floats are finite, fixed point ones small
+auto word_valid(char type, uint32_t v) -> bool
+{
+    const float f = std::bit_cast<float>(v);
+    switch (type)
+    {
+    case 'f':
+        return std::isfinite(f);
+    case 'x':
+        return std::isfinite(f) && std::fabs(f) <= max_fixed;
+    default:
+        return true;
+    }
+}
+
+// Inputs of each operator; linear_combine has one per term
+auto input_count(op kind) -> uint32_t
+{
+    switch (kind)
+    {
+    case op::gradient:
+        return 0;
+    case op::glow_rect:
+    case op::paste:
+        return 2;
+    case op::ternary:
+        return 3;
+    case op::color_remap:
+    case op::bump:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+// Operators whose size is not that of their first input
+auto sized(op kind) -> bool
+{
+    return kind == op::noise || kind == op::voronoi || kind == op::linear_combine;
+}
+
+struct writer
+{
+    std::vector<uint8_t> bytes;
+
+    void byte(uint8_t v)
+    {
+        bytes.push_back(v);
+    }
+
+    void varint(uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            bytes.push_back(uint8_t(v) | 0x80);
+            v >>= 7;
+        }
+        bytes.push_back(uint8_t(v));
+    }
+
+    void word(uint32_t v)
+    {
+        for (int32_t i = 0; i < 4; i++)
+            bytes.push_back(uint8_t(v >> (8 * i)));
+    }
+
+    void param(char type, uint32_t v)
+    {
+        if (type == 'i')
+        {
+            const int32_t s = static_cast<int32_t>(v);
+            varint((uint32_t(s) << 1) ^ uint32_t(s >> 31));
+        }
+        else
+            word(v);
+    }
+};
+
+// Reads from a byte range; any read past its end clears ok and returns 0
+struct reader
+{
+    const uint8_t *p, *end;
+    bool ok = true;
+
+    auto remaining() const -> uint64_t
+    {
+        return end - p;
+    }
+
+    auto byte() -> uint8_t
+    {
+        if (p == end)
+        {
+            ok = false;
+            return 0;
+        }
+
+        return *p++;
+    }
+
+    auto varint() -> uint64_t
+    {
+        uint64_t v = 0;
+        for (int32_t shift = 0; shift < 64; shift += 7)
+        {
+            const uint8_t b = byte();
+            v |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+
+        ok = false;
+        return 0;
+    }
+
+    auto word() -> uint32_t
+    {
+        if (remaining() < 4)
+        {
+            ok = false;
+            p = end;
+            return 0;
+        }
+
+        uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+        p += 4;
+        return v;
+    }
+
+    auto param(char type) -> uint32_t
+    {
+        if (type == 'i')
+        {
+            const uint64_t z = varint();
+            if (z > 0xffffffffu)
+            {
+                ok = false;
+                return 0;
+            }
+
+            return uint32_t(z >> 1) ^ -uint32_t(z & 1);
+        }
+
+        const uint32_t v = word();
+        ok = ok && word_valid(type, v);
+        return v;
+    }
+};
+
+// Whether the integer parameters of n are in the ranges its operator handles: values of its
+// enums, flags it knows, counts its buffers hold and shifts that stay within 32 bits
+auto params_valid(const node &n) -> bool
+{
+    auto within = [&](uint32_t i, int32_t lo, int32_t hi) { return n.param_int(i) >= lo && n.param_int(i) <= hi; };
+    auto flags = [&](uint32_t i, uint32_t known) { return (n.params[i] & ~known) == 0; };
+    constexpr uint32_t sampling = ClampU | ClampV | FilterBilinear;
+
+    switch (n.kind)
+    {
+    case op::noise:
+        // every octave doubles the 16.16 lattice coordinates
+        return within(0, 0, 15) && within(1, 0, 15) && within(2, 1, 16 - std::max(n.param_int(0), n.param_int(1))) &&
+               flags(5, NoiseAbs | NoiseNormalize | NoiseBandlimit);
+    case op::voronoi:
+        return within(0, 0, 255) && within(1, 1, 256);
+    case op::linear_combine:
+        for (uint32_t k = 0; k < n.inputs.size(); k++)
+        {
+            if (!flags(6 + 4 * k, sampling))
+                return false;
+        }
+        return true;
+    case op::color_matrix:
+        return within(16, 0, 1);
+    case op::coord_matrix:
+        return flags(16, sampling);
+    case op::derive:
+        return within(0, DeriveGradient, DeriveNormals) && within(2, DeriveCentral, DeriveScharr);
+    case op::blur:
+        return within(2, 0, max_blur_order) && flags(3, ClampU | ClampV) && within(4, 0, 1);
+    case op::ternary:
+        return within(0, TernaryLerp, TernarySelect);
+    case op::paste:
+        return within(6, CombineAdd, CombineLighten) && flags(7, sampling);
+    case op::bump:
+        return within(10, 0, 1);
+    default:
+        return true;
+    }
+}
+
+// Whether n can run: input sizes agree where the operator requires it
+auto sizes_match(const recipe &r, const node &n) -> bool
+{
+    auto same = [&](node_id in) { return r[in].width == n.width && r[in].height == n.height; };
+
+    switch (n.kind)
+    {
+    case op::ternary:
+        return same(n.inputs[1]) && same(n.inputs[2]);
+    case op::bump:
+        return same(n.inputs[1]);
+    default:
+        return true;
+    }
+}
+
+} // namespace
+
+auto encode(const recipe &r, std::span<const node_id> outputs) -> std::vector<uint8_t>
+{
+    writer w;
+    for (uint8_t b : magic)
+        w.byte(b);
+    w.byte(format_version);
+    w.varint(r.size());
+    w.varint(outputs.size());
+
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        const node &n = r[id];
+        w.byte(uint8_t(n.kind));
+
+        if (sized(n.kind))
+            w.byte(uint8_t(std::countr_zero(n.width) | (std::countr_zero(n.height) << 4)));
+        if (n.kind == op::linear_combine)
+            w.varint(n.inputs.size());
+
+        for (node_id in : n.inputs)
+            w.varint(in == no_node ? 0 : id - in);
+
+        const std::string_view sig = signature(n.kind);
+        for (uint32_t i = 0; i < n.params.size(); i++)
+            w.param(i < sig.size() ? sig[i] : linear_term_signature[(i - sig.size()) % 4], n.params[i]);
+    }
+
+    for (node_id out : outputs)
+        w.varint(out);
+
+    return std::move(w.bytes);
+}
+
+auto decode(std::span<const uint8_t> code) -> std::optional<program>
+{
+    reader in{code.data(), code.data() + code.size()};
+
+    for (uint8_t b : magic)
+    {
+        if (in.byte() != b)
+            return std::nullopt;
+    }
+    if (in.byte() != format_version)
+        return std::nullopt;
+
+    // every node takes a byte at least, so counts beyond the code size are malformed
+    const uint64_t count = in.varint();
+    const uint64_t outputCount = in.varint();
+    if (!in.ok || count > in.remaining() || outputCount > in.remaining() - count)
+        return std::nullopt;
+
+    program prog;
+    for (node_id id = 0; id < count; id++)
+    {
+        node n;
+        const uint8_t kind = in.byte();
+        if (kind > uint8_t(op::bump))
+            return std::nullopt;
+        n.kind = op(kind);
+
+        if (n.kind == op::gradient)
+            n.width = 2, n.height = 1;
+        else if (sized(n.kind))
+        {
+            const uint8_t size = in.byte();
+            if ((size & 15) > max_side_log2 || (size >> 4) > max_side_log2)
+                return std::nullopt;
+
+            n.width = 1u << (size & 15);
+            n.height = 1u << (size >> 4);
+        }
+
+        uint64_t inputs = input_count(n.kind);
+        if (n.kind == op::linear_combine)
+            inputs = in.varint();
+        if (!in.ok || inputs > in.remaining())
+            return std::nullopt;
+
+        n.inputs.reserve(inputs);
+        for (uint32_t k = 0; k < inputs; k++)
+        {
+            const uint64_t distance = in.varint();
+            const bool optional = n.kind == op::bump && k >= 2;
+            if (distance > id || (distance == 0 && !optional))
+                return std::nullopt;
+
+            n.inputs.push_back(distance == 0 ? no_node : id - distance);
+        }
+
+        if (!in.ok)
+            return std::nullopt;
+
+        if (!sized(n.kind) && n.kind != op::gradient)
+        {
+            n.width = prog.nodes[n.inputs[0]].width;
+            n.height = prog.nodes[n.inputs[0]].height;
+        }
+
+        const std::string_view sig = signature(n.kind);
+        n.params.reserve(sig.size() + (n.kind == op::linear_combine ? inputs * linear_term_signature.size() : 0));
+        for (char type : sig)
+            n.params.push_back(in.param(type));
+        for (uint32_t k = 0; n.kind == op::linear_combine && k < inputs; k++)
+        {
+            for (char type : linear_term_signature)
+                n.params.push_back(in.param(type));
+        }
+
+        if (!in.ok || !params_valid(n) || !sizes_match(prog.nodes, n))
+            return std::nullopt;
+
+        prog.nodes.append(std::move(n));
+    }
+
+    for (uint64_t i = 0; i < outputCount; i++)
+    {
+        const uint64_t out = in.varint();
+        if (out >= count)
+            return std::nullopt;
+        prog.outputs.push_back(out);
+    }
+
+    if (!in.ok || in.remaining() != 0)
+        return std::nullopt;
+
+    return prog;
+}
+
+auto interpret(std::span<const uint8_t> code) -> std::optional<std::vector<texture>>
+{
+    std::optional<program> prog = decode(code);
+    if (!prog)
+        return std::nullopt;
+
+    std::vector<texture> results(prog->outputs.size());
+    evaluate_planned(prog->nodes, plan_buffers(prog->nodes, prog->outputs), prog->outputs, results);
+    return results;
+}
+
+} // namespace openktg::graph
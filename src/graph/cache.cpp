@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <chrono>
+
+#include <openktg/graph/cache.h>
+#include <openktg/graph/disk_cache.h>
+#include <openktg/graph/evaluate.h>
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+// splitmix64 finalizer
+auto mix(uint64_t x) -> uint64_t
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Two independently seeded 64-bit hashes of a word stream
+struct key_hasher
+{
+    cache_key key{0x243f6a8885a308d3ull, 0x13198a2e03707344ull};
+
+    void add(uint64_t v)
+    {
+        key.lo = mix(key.lo ^ v);
+        key.hi = mix(key.hi + v * 0x9e3779b97f4a7c15ull);
+    }
+};
+
+auto texture_bytes(const texture &t) -> uint64_t
+{
+    return sizeof(texture) + uint64_t(t.pixel_count()) * sizeof(pixel);
+}
+
+} // namespace
+
+auto node_keys(const recipe &r) -> std::vector<cache_key>
+{
+    std::vector<cache_key> keys(r.size());
+
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        const node &n = r[id];
+        key_hasher h;
+
+        h.add(operator_revision);
+        h.add(uint64_t(n.kind) | (uint64_t(n.inputs.size()) << 8) | (uint64_t(n.params.size()) << 16));
+        h.add(uint64_t(n.width) | (uint64_t(n.height) << 32));
+        for (uint32_t p : n.params)
+            h.add(p);
+        for (node_id in : n.inputs)
+        {
+            const cache_key k = in == no_node ? cache_key{} : keys[in];
+            h.add(k.lo);
+            h.add(k.hi);
+        }
+
+        keys[id] = h.key;
+    }
+
+    return keys;
+}
+
+result_cache::result_cache(uint64_t maxBytes, uint32_t maxEntries)
+    : max_bytes_(maxBytes), max_entries_(maxEntries), mask_(std::bit_ceil(2 * std::max(maxEntries, 1u)) - 1),
+      slots_(std::make_unique<std::atomic<std::shared_ptr<const entry>>[]>(mask_ + 1))
+{
+}
+
+auto result_cache::find(const cache_key &key) -> texture_ptr
+{
+    for (uint32_t i = key.lo & mask_;; i = (i + 1) & mask_)
+    {
+        std::shared_ptr<const entry> e = slots_[i].load(std::memory_order_acquire);
+        if (!e)
+            break;
+
+        if (e->key == key)
+        {
+            e->priority.store(inflation_.load(std::memory_order_relaxed) + e->weight, std::memory_order_relaxed);
+            e->last_use.store(clock_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return e->result;
+        }
+    }
+
+    misses_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+auto result_cache::insert(const cache_key &key, texture t, double cost) -> texture_ptr
+{
+    auto e = std::make_shared<entry>();
+    e->key = key;
+    e->bytes = texture_bytes(t);
+    e->result = std::make_shared<const texture>(std::move(t));
+    e->weight = cost / e->bytes;
+
+    if (e->bytes > max_bytes_ || max_entries_ == 0)
+        return e->result;
+
+    std::lock_guard lock(write_);
+
+    // someone may have cached it while we computed it
+    for (uint32_t i = key.lo & mask_;; i = (i + 1) & mask_)
+    {
+        std::shared_ptr<const entry> other = slots_[i].load(std::memory_order_relaxed);
+        if (!other)
+            break;
+        if (other->key == key)
+            return other->result;
+    }
+
+    while (bytes_.load(std::memory_order_relaxed) + e->bytes > max_bytes_ || size_.load(std::memory_order_relaxed) >= max_entries_)
+    {
+        if (!evict_one())
+            break;
+    }
+
+    // evictions moved entries, so look for the free slot only now; there are more slots than entries
+    uint32_t free = key.lo & mask_;
+    while (slots_[free].load(std::memory_order_relaxed))
+        free = (free + 1) & mask_;
+
+    e->priority.store(inflation_.load(std::memory_order_relaxed) + e->weight, std::memory_order_relaxed);
+    e->last_use.store(clock_.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    bytes_.fetch_add(e->bytes, std::memory_order_relaxed);
+    size_.fetch_add(1, std::memory_order_relaxed);
+
+    heap_.push_back({e->priority.load(std::memory_order_relaxed), e->last_use.load(std::memory_order_relaxed), e});
+    std::push_heap(heap_.begin(), heap_.end(), later);
+
+    texture_ptr result = e->result;
+    slots_[free].store(std::move(e), std::memory_order_release);
+    return result;
+}
+
+auto result_cache::later(const ranked &a, const ranked &b) -> bool
+{
+    return a.priority != b.priority ? a.priority > b.priority : a.last_use > b.last_use;
+}
+
+auto result_cache::evict_one() -> bool
+{
+    while (!heap_.empty())
+    {
+        std::pop_heap(heap_.begin(), heap_.end(), later);
+        ranked top = std::move(heap_.back());
+        heap_.pop_back();
+
+        // hit since it was pushed: back in with its current priority
+        const double priority = top.e->priority.load(std::memory_order_relaxed);
+        const uint64_t lastUse = top.e->last_use.load(std::memory_order_relaxed);
+        if (priority != top.priority || lastUse != top.last_use)
+        {
+            heap_.push_back({priority, lastUse, std::move(top.e)});
+            std::push_heap(heap_.begin(), heap_.end(), later);
+            continue;
+        }
+
+        uint32_t slot = top.e->key.lo & mask_;
+        while (slots_[slot].load(std::memory_order_relaxed) != top.e)
+            slot = (slot + 1) & mask_;
+
+        remove_slot(slot);
+        bytes_.fetch_sub(top.e->bytes, std::memory_order_relaxed);
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        inflation_.store(priority, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+void result_cache::remove_slot(uint32_t hole)
+{
+    // move back every later entry of the run that may live in the hole, so no probe for it
+    // crosses an empty slot; entries are copied before their old slot is reused or cleared
+    for (uint32_t i = (hole + 1) & mask_;; i = (i + 1) & mask_)
+    {
+        std::shared_ptr<const entry> e = slots_[i].load(std::memory_order_relaxed);
+        if (!e)
+            break;
+
+        const uint32_t home = e->key.lo & mask_;
+        if (((i - home) & mask_) >= ((i - hole) & mask_))
+        {
+            slots_[hole].store(std::move(e), std::memory_order_release);
+            hole = i;
+        }
+    }
+
+    slots_[hole].store(nullptr, std::memory_order_release);
+}
+
+[[nodiscard]] auto result_cache::bytes() const noexcept -> uint64_t
+{
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+[[nodiscard]] auto result_cache::size() const noexcept -> uint32_t
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+[[nodiscard]] auto result_cache::hits() const noexcept -> uint64_t
+{
+    return hits_.load(std::memory_order_relaxed);
+}
+
+[[nodiscard]] auto result_cache::misses() const noexcept -> uint64_t
+{
+    return misses_.load(std::memory_order_relaxed);
+}
+
+void evaluate_cached(const recipe &r, std::span<const node_id> outputs, std::span<texture_ptr> results, result_cache &cache, cache_counters *counters,
+                     disk_cache *disk)
+{
+    assert(outputs.size() == results.size());
+
+    const node_id count = r.size();
+    const std::vector<cache_key> keys = node_keys(r);
+
+    if (counters)
+    {
+        counters->hits.resize(std::max<size_t>(counters->hits.size(), count), 0);
+        counters->misses.resize(std::max<size_t>(counters->misses.size(), count), 0);
+        counters->disk_hits.resize(std::max<size_t>(counters->disk_hits.size(), count), 0);
+    }
+
+    // look nodes up from the outputs back; only misses need their inputs
+    std::vector<texture_ptr> found(count);
+    std::vector<bool> needed(count, false), missed(count, false);
+    for (node_id out : outputs)
+        needed[out] = true;
+
+    for (node_id id = count; id-- > 0;)
+    {
+        if (!needed[id])
+            continue;
+
+        found[id] = cache.find(keys[id]);
+        if (counters)
+            (found[id] ? counters->hits : counters->misses)[id]++;
+
+        if (!found[id] && disk)
+        {
+            if (std::optional<mapped_texture> stored = disk->find(keys[id]))
+            {
+                // operators read owning textures: the one copy a disk hit takes, then shared from memory
+                found[id] = cache.insert(keys[id], stored->to_texture(), stored->cost());
+                if (counters)
+                    counters->disk_hits[id]++;
+            }
+        }
+
+        if (found[id])
+            continue;
+
+        missed[id] = true;
+        for (node_id in : r[id].inputs)
+        {
+            if (in != no_node)
+                needed[in] = true;
+        }
+    }
+
+    // then compute the misses, inputs first
+    std::vector<const texture *> inputs;
+    for (node_id id = 0; id < count; id++)
+    {
+        if (!missed[id])
+            continue;
+
+        inputs.clear();
+        for (node_id in : r[id].inputs)
+            inputs.push_back(in == no_node ? nullptr : found[in].get());
+
+        const auto start = std::chrono::steady_clock::now();
+        texture t;
+        run_node(r, id, inputs, t);
+        const std::chrono::duration<double, std::nano> cost = std::chrono::steady_clock::now() - start;
+
+        if (disk)
+            disk->store(keys[id], t, cost.count());
+        found[id] = cache.insert(keys[id], std::move(t), cost.count());
+    }
+
+    for (uint32_t i = 0; i < outputs.size(); i++)
+        results[i] = found[outputs[i]];
+}
+
+} // namespace openktg::graph
@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openktg/graph/disk_cache.h>
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+constexpr char magic[8] = {'O', 'K', 'T', 'G', 'N', 'O', 'D', 'E'};
+constexpr uint32_t format_version = 1;
+
+struct file_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t reserved0;
+    uint64_t key_lo, key_hi;
+    uint64_t pixel_bytes;
+    double cost;
+    uint8_t reserved1[8];
+};
+static_assert(sizeof(file_header) == 64);
+
+auto header_of(const void *base) -> const file_header &
+{
+    return *static_cast<const file_header *>(base);
+}
+
+// Writes all of data, retrying short writes
+auto write_all(int fd, const void *data, uint64_t size) -> bool
+{
+    const char *p = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t written = ::write(fd, p, size);
+        if (written <= 0)
+            return false;
+
+        p += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+} // namespace
+
+mapped_texture::mapped_texture(void *base, uint64_t length) : base_(base), length_(length)
+{
+}
+
+mapped_texture::mapped_texture(mapped_texture &&other) noexcept : base_(other.base_), length_(other.length_)
+{
+    other.base_ = nullptr;
+    other.length_ = 0;
+}
+
+mapped_texture::~mapped_texture()
+{
+    if (base_)
+        ::munmap(base_, length_);
+}
+
+auto mapped_texture::operator=(mapped_texture &&other) noexcept -> mapped_texture &
+{
+    std::swap(base_, other.base_);
+    std::swap(length_, other.length_);
+    return *this;
+}
+
+[[nodiscard]] auto mapped_texture::width() const noexcept -> uint32_t
+{
+    return header_of(base_).width;
+}
+
+[[nodiscard]] auto mapped_texture::height() const noexcept -> uint32_t
+{
+    return header_of(base_).height;
+}
+
+[[nodiscard]] auto mapped_texture::pixels() const noexcept -> std::span<const pixel>
+{
+    const pixel *first = reinterpret_cast<const pixel *>(static_cast<const char *>(base_) + sizeof(file_header));
+    return {first, uint64_t(width()) * height()};
+}
+
+[[nodiscard]] auto mapped_texture::cost() const noexcept -> double
+{
+    return header_of(base_).cost;
+}
+
+[[nodiscard]] auto mapped_texture::to_texture() const -> texture
+{
+    texture t(width(), height());
+    std::memcpy(t.data(), pixels().data(), pixels().size_bytes());
+    return t;
+}
+
+disk_cache::disk_cache(std::filesystem::path directory, uint64_t maxBytes) : directory_(std::move(directory)), max_bytes_(maxBytes)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory_, ec);
+
+    // sum up the results, and drop temporaries no writer has touched for an hour
+    const auto stale = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+    uint64_t total = 0;
+    for (const auto &file : std::filesystem::directory_iterator(directory_, ec))
+    {
+        if (!file.is_regular_file(ec))
+            continue;
+
+        if (file.path().extension() == ".okt")
+            total += file.file_size(ec);
+        else if (file.path().extension() == ".tmp" && file.last_write_time(ec) < stale)
+            std::filesystem::remove(file.path(), ec);
+    }
+
+    bytes_ = total;
+}
+
+auto disk_cache::find(const cache_key &key) -> std::optional<mapped_texture>
+{
+    const std::filesystem::path path = path_of(key);
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return std::nullopt;
+
+    struct stat info;
+    const bool sized = ::fstat(fd, &info) == 0;
+    void *base = sized && uint64_t(info.st_size) >= sizeof(file_header) ? ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+
+    std::error_code ec;
+    if (base == MAP_FAILED)
+    {
+        if (sized && uint64_t(info.st_size) < sizeof(file_header))
+            std::filesystem::remove(path, ec);
+        return std::nullopt;
+    }
+
+    mapped_texture mapped(base, info.st_size);
+
+    // renames make partial files impossible, but the directory may hold anything
+    const file_header &h = header_of(base);
+    const uint64_t pixelBytes = uint64_t(h.width) * h.height * sizeof(pixel);
+    if (std::memcmp(h.magic, magic, sizeof(magic)) != 0 || h.version != format_version || h.key_lo != key.lo || h.key_hi != key.hi ||
+        !std::has_single_bit(h.width) || !std::has_single_bit(h.height) || h.pixel_bytes != pixelBytes || uint64_t(info.st_size) != sizeof(file_header) + pixelBytes)
+    {
+        std::filesystem::remove(path, ec);
+        return std::nullopt;
+    }
+
+    // the file time orders results for eviction
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+    return mapped;
+}
+
+void disk_cache::store(const cache_key &key, const texture &t, double cost)
+{
+    const std::filesystem::path path = path_of(key);
+
+    std::error_code ec;
+    if (std::filesystem::exists(path, ec))
+        return;
+
+    file_header h{};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = format_version;
+    h.width = t.width();
+    h.height = t.height();
+    h.key_lo = key.lo;
+    h.key_hi = key.hi;
+    h.pixel_bytes = uint64_t(t.pixel_count()) * sizeof(pixel);
+    h.cost = cost;
+
+    std::filesystem::path temporary = path;
+    temporary += "." + std::to_string(::getpid()) + "." + std::to_string(temporaries_++) + ".tmp";
+
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return;
+
+    bool written = write_all(fd, &h, sizeof(h)) && write_all(fd, t.data(), h.pixel_bytes) && ::fsync(fd) == 0;
+    written = ::close(fd) == 0 && written;
+
+    if (written)
+        std::filesystem::rename(temporary, path, ec);
+    if (!written || ec)
+    {
+        std::filesystem::remove(temporary, ec);
+        return;
+    }
+
+    // the rename itself only survives a crash once the directory is synced
+    int dir = ::open(directory_.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir >= 0)
+    {
+        ::fsync(dir);
+        ::close(dir);
+    }
+
+    if ((bytes_ += sizeof(h) + h.pixel_bytes) > max_bytes_)
+    {
+        // another store may have trimmed while this one waited
+        std::lock_guard lock(trim_mutex_);
+        if (bytes_ > max_bytes_)
+            trim_locked();
+    }
+}
+
+void disk_cache::trim()
+{
+    std::lock_guard lock(trim_mutex_);
+    trim_locked();
+}
+
+void disk_cache::trim_locked()
+{
+    struct result
+    {
+        std::filesystem::file_time_type time;
+        uint64_t size;
+        std::filesystem::path path;
+    };
+
+    std::error_code ec;
+    std::vector<result> results;
+    uint64_t total = 0;
+    for (const auto &file : std::filesystem::directory_iterator(directory_, ec))
+    {
+        if (!file.is_regular_file(ec) || file.path().extension() != ".okt")
+            continue;
+
+        results.push_back({file.last_write_time(ec), file.file_size(ec), file.path()});
+        total += results.back().size;
+    }
+
+    // down to 90% of the bound, so that the next stores do not trim again
+    const uint64_t target = max_bytes_ - max_bytes_ / 10;
+    std::sort(results.begin(), results.end(), [](const result &a, const result &b) { return a.time < b.time; });
+    for (const result &r : results)
+    {
+        if (total <= target)
+            break;
+
+        if (std::filesystem::remove(r.path, ec))
+            total -= r.size;
+    }
+
+    bytes_ = total;
+}
+
+[[nodiscard]] auto disk_cache::bytes() const noexcept -> uint64_t
+{
+    return bytes_.load(std::memory_order_relaxed);
+}
+
+[[nodiscard]] auto disk_cache::path_of(const cache_key &key) const -> std::filesystem::path
+{
+    char name[40];
+    std::snprintf(name, sizeof(name), "%016llx%016llx.okt", static_cast<unsigned long long>(key.hi), static_cast<unsigned long long>(key.lo));
+    return directory_ / name;
+}
+
+} // namespace openktg::graph
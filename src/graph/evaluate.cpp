@@ -0,0 +1,104 @@
+#include <cassert>
+
+#include <openktg/graph/evaluate.h>
+#include <openktg/tex/composite.h>
+#include <openktg/tex/filters.h>
+#include <openktg/tex/generators.h>
+#include <openktg/tex/procedural.h>
+
+namespace openktg::graph
+{
+
+void run_node(const recipe &r, node_id id, std::span<const texture *const> inputs, texture &out)
+{
+    const node &n = r[id];
+    assert(inputs.size() == n.inputs.size());
+
+    out.resize(n.width, n.height);
+
+    switch (n.kind)
+    {
+    case op::gradient:
+        out = LinearGradient(n.params[0], n.params[1]);
+        break;
+
+    case op::noise:
+        Noise(out, *inputs[0], n.param_int(0), n.param_int(1), n.param_int(2), n.param_float(3), n.param_int(4), n.param_int(5));
+        break;
+
+    case op::voronoi:
+        RandomVoronoi(out, *inputs[0], n.param_int(0), n.param_int(1), n.param_float(2), n.param_int(3));
+        break;
+
+    case op::glow_rect:
+        GlowRect(out, *inputs[0], *inputs[1], n.param_float(0), n.param_float(1), n.param_float(2), n.param_float(3), n.param_float(4), n.param_float(5),
+                 n.param_float(6), n.param_float(7));
+        break;
+
+    case op::linear_combine: {
+        std::vector<LinearInput> terms(inputs.size());
+        for (uint32_t i = 0; i < inputs.size(); i++)
+            terms[i] = LinearInput{inputs[i], n.param_float(3 + 4 * i), n.param_float(4 + 4 * i), n.param_float(5 + 4 * i), n.param_int(6 + 4 * i)};
+
+        LinearCombine(out, n.param_pixel(0), n.param_float(2), terms.data(), terms.size());
+        break;
+    }
+
+    case op::colorize:
+        ColorMatrixTransform(out, *inputs[0], ColorizeMatrix(n.params[0], n.params[1]), true);
+        break;
+
+    case op::color_matrix:
+        ColorMatrixTransform(out, *inputs[0], n.param_matrix(0), n.params[16] != 0);
+        break;
+
+    case op::color_remap:
+        ColorRemap(out, *inputs[0], *inputs[1], *inputs[2], *inputs[3]);
+        break;
+
+    case op::coord_matrix:
+        CoordMatrixTransform(out, *inputs[0], n.param_matrix(0), n.param_int(16));
+        break;
+
+    case op::derive:
+        Derive(out, *inputs[0], DeriveOp(n.param_int(0)), n.param_float(1), DeriveStencil(n.param_int(2)));
+        break;
+
+    case op::blur:
+        (n.param_int(4) ? BlurSRGB : Blur)(out, *inputs[0], n.param_float(0), n.param_float(1), n.param_int(2), n.param_int(3));
+        break;
+
+    case op::ternary:
+        Ternary(out, *inputs[0], *inputs[1], *inputs[2], static_cast<TernaryOp>(n.param_int(0)));
+        break;
+
+    case op::paste:
+        Paste(out, *inputs[0], *inputs[1], n.param_float(0), n.param_float(1), n.param_float(2), n.param_float(3), n.param_float(4), n.param_float(5),
+              static_cast<CombineOp>(n.param_int(6)), n.param_int(7));
+        break;
+
+    case op::bump:
+        Bump(out, *inputs[0], *inputs[1], inputs[2], inputs[3], n.param_float(0), n.param_float(1), n.param_float(2), n.param_float(3), n.param_float(4),
+             n.param_float(5), n.param_pixel(6), n.param_pixel(8), n.params[10] != 0);
+        break;
+    }
+}
+
+auto evaluate(const recipe &r) -> std::vector<texture>
+{
+    std::vector<texture> results(r.size());
+    std::vector<const texture *> inputs;
+
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        inputs.clear();
+        for (node_id in : r[id].inputs)
+            inputs.push_back(in == no_node ? nullptr : &results[in]);
+
+        run_node(r, id, inputs, results[id]);
+    }
+
+    return results;
+}
+
+} // namespace openktg::graph
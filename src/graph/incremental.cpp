@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <cassert>
+
+#include <openktg/graph/evaluate.h>
+#include <openktg/graph/incremental.h>
+#include <openktg/util/parallel.h>
+
+#include "../tex/kernels.h"
+#include "stage.h"
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+void unite(rect &a, const rect &b)
+{
+    if (b.empty())
+        return;
+    if (a.empty())
+    {
+        a = b;
+        return;
+    }
+
+    a = {std::min(a.x0, b.x0), std::min(a.y0, b.y0), std::max(a.x1, b.x1), std::max(a.y1, b.y1)};
+}
+
+auto whole(const node &n) -> rect
+{
+    return {0, 0, int32_t(n.width) - 1, int32_t(n.height) - 1};
+}
+
+// a grown by rx, ry pixels on either side; axes it would wrap around become whole
+auto grow(const rect &a, int32_t rx, int32_t ry, const node &n) -> rect
+{
+    if (a.empty())
+        return a;
+
+    rect g{a.x0 - rx, a.y0 - ry, a.x1 + rx, a.y1 + ry};
+    if (g.x0 < 0 || g.x1 >= int32_t(n.width))
+        g.x0 = 0, g.x1 = n.width - 1;
+    if (g.y0 < 0 || g.y1 >= int32_t(n.height))
+        g.y0 = 0, g.y1 = n.height - 1;
+
+    return g;
+}
+
+// Pixels a GlowRect or Paste node draws over its background
+auto placement(const node &n, const std::vector<texture> &results) -> rect
+{
+    const kernels::Extent extent(n.width, n.height);
+
+    if (n.kind == op::glow_rect)
+    {
+        const kernels::GlowSetup s = kernels::SetupGlow(extent, n.param_float(0), n.param_float(1), n.param_float(2), n.param_float(3), n.param_float(4),
+                                                        n.param_float(5), n.param_float(6), n.param_float(7));
+        return {s.minX, s.minY, s.maxX, s.maxY};
+    }
+
+    assert(n.kind == op::paste);
+    const kernels::PasteSetup s = kernels::SetupPaste(extent, results[n.inputs[1]], n.param_float(0), n.param_float(1), n.param_float(2), n.param_float(3),
+                                                      n.param_float(4), n.param_float(5));
+    return {s.minX, s.minY, s.maxX, s.maxY};
+}
+
+// Pixels of node n that change when input slot changes on pixels d
+auto reach(const node &n, uint32_t slot, const rect &d, const std::vector<texture> &results) -> rect
+{
+    switch (n.kind)
+    {
+    case op::colorize:
+    case op::color_matrix:
+    case op::ternary:
+        return d;
+
+    case op::color_remap:
+        return slot == 0 ? d : whole(n);
+
+    case op::bump:
+        return slot <= 1 ? d : whole(n); // surface and normals per pixel, gradients anywhere
+
+    case op::glow_rect:
+    case op::paste:
+        return slot == 0 ? d : placement(n, results);
+
+    case op::derive:
+        return grow(d, 1, 1, n);
+
+    case op::blur:
+        return grow(d, blur_radius(n.param_float(0), n.width, n.param_int(2)), blur_radius(n.param_float(1), n.height, n.param_int(2)), n);
+
+    default: // noise, voronoi, linear_combine, coord_matrix
+        return whole(n);
+    }
+}
+
+auto same_shape(const node &a, const node &b) -> bool
+{
+    return a.kind == b.kind && a.width == b.width && a.height == b.height && a.inputs == b.inputs;
+}
+
+} // namespace
+
+void incremental_evaluator::update(const recipe &r)
+{
+    const node_id count = r.size();
+    const node_id kept = std::min(count, recipe_.size());
+
+    results_.resize(count);
+    param_versions_.resize(count, 0);
+    versions_.resize(count, 0);
+    seen_.resize(count);
+    dirty_.assign(count, rect{});
+
+    std::vector<const texture *> inputs;
+    for (node_id id = 0; id < count; id++)
+    {
+        const node &n = r[id];
+        const bool known = id < kept && same_shape(recipe_[id], n);
+
+        // pixels to recompute: what the parameters move, then what changed inputs reach
+        rect area;
+        if (!known)
+            area = whole(n);
+        else if (recipe_[id].params != n.params)
+        {
+            if (n.kind == op::glow_rect || n.kind == op::paste)
+            {
+                area = placement(recipe_[id], results_);
+                unite(area, placement(n, results_));
+            }
+            else
+                area = whole(n);
+        }
+
+        if (!known || recipe_[id].params != n.params)
+            param_versions_[id] = ++counter_;
+
+        for (uint32_t k = 0; known && k < n.inputs.size(); k++)
+        {
+            const node_id in = n.inputs[k];
+            if (in != no_node && versions_[in] != seen_[id][k])
+                unite(area, reach(n, k, dirty_[in], results_));
+        }
+
+        if (area.empty())
+            continue;
+
+        inputs.clear();
+        seen_[id].clear();
+        for (node_id in : n.inputs)
+        {
+            inputs.push_back(in == no_node ? nullptr : &results_[in]);
+            seen_[id].push_back(in == no_node ? 0 : versions_[in]);
+        }
+
+        texture &out = results_[id];
+        const rect all = whole(n);
+        if (runs_whole(n) || (area.x0 == all.x0 && area.y0 == all.y0 && area.x1 == all.x1 && area.y1 == all.y1))
+        {
+            run_node(r, id, inputs, out);
+            area = all;
+        }
+        else
+        {
+            const stage s = prepare(n, results_, uint64_t(area.x1 - area.x0 + 1) * (area.y1 - area.y0 + 1));
+
+            kernels::Region in[4];
+            assert(n.inputs.size() <= 4);
+            for (uint32_t k = 0; k < n.inputs.size(); k++)
+            {
+                if (n.inputs[k] != no_node)
+                    in[k] = kernels::Region(results_[n.inputs[k]]);
+            }
+
+            util::parallel_for(area.y0, area.y1 + 1, 16, [&](uint32_t begin, uint32_t end) {
+                part_scratch scratch;
+                run_part(n, s, results_, in, &out.at(area.x0, begin), out.width(), area.x0, begin, area.x1, end - 1, scratch);
+            });
+        }
+
+        versions_[id] = ++counter_;
+        dirty_[id] = area;
+    }
+
+    recipe_ = r;
+}
+
+[[nodiscard]] auto incremental_evaluator::result(node_id id) const -> const texture &
+{
+    assert(id < results_.size());
+    return results_[id];
+}
+
+[[nodiscard]] auto incremental_evaluator::param_version(node_id id) const -> uint64_t
+{
+    assert(id < param_versions_.size());
+    return param_versions_[id];
+}
+
+[[nodiscard]] auto incremental_evaluator::version(node_id id) const -> uint64_t
+{
+    assert(id < versions_.size());
+    return versions_[id];
+}
+
+[[nodiscard]] auto incremental_evaluator::dirty(node_id id) const -> rect
+{
+    assert(id < dirty_.size());
+    return dirty_[id];
+}
+
+} // namespace openktg::graph
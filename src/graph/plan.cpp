@@ -0,0 +1,172 @@
+#include <algorithm>
+#include <cassert>
+
+#include <openktg/graph/evaluate.h>
+#include <openktg/graph/plan.h>
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+// Whether the operator of n may write its result over its first input: every pixel of that input
+// is read before (or as) the same pixel is written, or the operator copies it over first anyway
+auto writes_over_first(const node &n) -> bool
+{
+    switch (n.kind)
+    {
+    case op::glow_rect: // background
+    case op::colorize:
+    case op::color_matrix:
+    case op::color_remap: // image, not the maps
+    case op::blur:        // goes through row and column buffers
+    case op::ternary:
+    case op::paste: // background
+    case op::bump:  // surface
+        return true;
+
+    default: // Derive would copy its input anyway, the rest sample anywhere or have no same-size input
+        return false;
+    }
+}
+
+auto bytes(uint32_t width, uint32_t height) -> uint64_t
+{
+    return uint64_t(width) * height * sizeof(pixel);
+}
+
+} // namespace
+
+auto plan_buffers(const recipe &r, std::span<const node_id> outputs) -> buffer_plan
+{
+    const node_id end = r.size();
+    buffer_plan plan;
+    plan.buffer_of.assign(end, no_buffer);
+    plan.in_place.assign(end, false);
+
+    // last node reading each result; outputs are read after the last node
+    std::vector<node_id> lastUse(end, no_node);
+    std::vector<bool> needed(end, false);
+    for (node_id out : outputs)
+    {
+        assert(out < end);
+        needed[out] = true;
+        lastUse[out] = end;
+    }
+
+    for (node_id id = end; id-- > 0;)
+    {
+        if (!needed[id])
+            continue;
+
+        for (node_id in : r[id].inputs)
+        {
+            if (in == no_node)
+                continue;
+
+            needed[in] = true;
+            if (lastUse[in] == no_node)
+                lastUse[in] = id;
+        }
+    }
+
+    std::vector<node_id> holder;    // node whose result each buffer currently holds
+    std::vector<uint32_t> freeList; // buffers whose result has been read for the last time
+
+    for (node_id id = 0; id < end; id++)
+    {
+        if (!needed[id])
+            continue;
+
+        const node &n = r[id];
+        plan.unplanned_bytes += bytes(n.width, n.height);
+
+        // overwrite the first input if nothing reads it afterwards, and this node reads it just once
+        if (writes_over_first(n))
+        {
+            const node_id in = n.inputs[0];
+            if (lastUse[in] == id && std::count(n.inputs.begin(), n.inputs.end(), in) == 1 && r[in].width == n.width && r[in].height == n.height)
+            {
+                plan.buffer_of[id] = plan.buffer_of[in];
+                plan.in_place[id] = true;
+                holder[plan.buffer_of[id]] = id;
+            }
+        }
+
+        // otherwise the most recently freed buffer of the same size, or a new one
+        if (!plan.in_place[id])
+        {
+            auto it = std::find_if(freeList.rbegin(), freeList.rend(), [&](uint32_t b) {
+                return plan.buffers[b].width == n.width && plan.buffers[b].height == n.height;
+            });
+
+            if (it != freeList.rend())
+            {
+                plan.buffer_of[id] = *it;
+                freeList.erase(std::next(it).base());
+            }
+            else
+            {
+                plan.buffer_of[id] = plan.buffers.size();
+                plan.buffers.push_back({n.width, n.height});
+                plan.peak_bytes += bytes(n.width, n.height);
+                holder.push_back(no_node);
+            }
+
+            holder[plan.buffer_of[id]] = id;
+        }
+
+        // inputs read for the last time free their buffers for the nodes after this one
+        for (node_id in : n.inputs)
+        {
+            if (in == no_node || lastUse[in] != id)
+                continue;
+
+            const uint32_t b = plan.buffer_of[in];
+            if (holder[b] == in) // not yet freed (inputs may repeat) nor taken over in place
+            {
+                holder[b] = no_node;
+                freeList.push_back(b);
+            }
+        }
+    }
+
+    return plan;
+}
+
+void evaluate_planned(const recipe &r, const buffer_plan &plan, std::span<const node_id> outputs, std::span<texture> results)
+{
+    assert(outputs.size() == results.size());
+    assert(plan.buffer_of.size() == r.size());
+
+    std::vector<texture> buffers(plan.buffers.size());
+    std::vector<const texture *> inputs;
+
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        if (plan.buffer_of[id] == no_buffer)
+            continue;
+
+        inputs.clear();
+        for (node_id in : r[id].inputs)
+        {
+            assert(in == no_node || plan.buffer_of[in] != no_buffer);
+            inputs.push_back(in == no_node ? nullptr : &buffers[plan.buffer_of[in]]);
+        }
+
+        run_node(r, id, inputs, buffers[plan.buffer_of[id]]);
+    }
+
+    // outputs hold their buffers to the end; the last request for each one takes it over
+    for (uint32_t i = outputs.size(); i-- > 0;)
+    {
+        auto later = std::find(outputs.begin() + i + 1, outputs.end(), outputs[i]);
+        if (later != outputs.end())
+            results[i] = results[later - outputs.begin()];
+        else
+            results[i] = std::move(buffers[plan.buffer_of[outputs[i]]]);
+    }
+}
+
+} // namespace openktg::graph
@@ -0,0 +1,88 @@
+#include <algorithm>
+#include <bit>
+
+#include <openktg/graph/progressive.h>
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+// Largest side of any texture of r
+auto largest_side(const recipe &r) -> uint32_t
+{
+    uint32_t side = 1;
+    for (node_id id = 0; id < r.size(); id++)
+        side = std::max({side, r[id].width, r[id].height});
+
+    return side;
+}
+
+} // namespace
+
+auto scale_recipe(const recipe &r, uint32_t maxSide) -> recipe
+{
+    const uint32_t full = largest_side(r);
+    if (full <= maxSide)
+        return r;
+
+    const int32_t shift = std::countr_zero(full) - std::bit_width(std::max(maxSide, 1u)) + 1;
+
+    recipe scaled;
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        node n = r[id];
+        switch (n.kind)
+        {
+        case op::gradient:
+            break;
+        case op::noise:
+        case op::voronoi:
+        case op::linear_combine:
+            n.width = std::max(n.width >> shift, 1u);
+            n.height = std::max(n.height >> shift, 1u);
+            break;
+        default:
+            n.width = scaled[n.inputs[0]].width;
+            n.height = scaled[n.inputs[0]].height;
+            break;
+        }
+
+        if (n.kind == op::derive)
+            n.params[1] = std::bit_cast<uint32_t>(n.param_float(1) / float(1 << shift));
+
+        // octave i has 2^(freq + i) periods across the texture; keep those above two pixels each
+        if (n.kind == op::noise)
+        {
+            const int32_t below = std::min(std::countr_zero(n.width) - n.param_int(0), std::countr_zero(n.height) - n.param_int(1)) - 1;
+            n.params[2] = std::clamp(below, 1, n.param_int(2));
+        }
+
+        scaled.append(std::move(n));
+    }
+
+    return scaled;
+}
+
+void evaluate_progressive(const recipe &r, std::span<const node_id> outputs, std::span<const uint32_t> levels, result_cache &cache,
+                          const level_callback &deliver)
+{
+    const uint32_t full = largest_side(r);
+    std::vector<texture_ptr> results(outputs.size());
+
+    for (uint32_t side : levels)
+    {
+        if (side >= full)
+            break;
+
+        evaluate_cached(scale_recipe(r, side), outputs, results, cache);
+        if (!deliver(side, results))
+            return;
+    }
+
+    evaluate_cached(r, outputs, results, cache);
+    deliver(full, results);
+}
+
+} // namespace openktg::graph
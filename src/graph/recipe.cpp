@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+#include <openktg/graph/recipe.h>
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+void push_float(std::vector<uint32_t> &params, float value)
+{
+    params.push_back(std::bit_cast<uint32_t>(value));
+}
+
+void push_pixel(std::vector<uint32_t> &params, const pixel &value)
+{
+    params.push_back(value.r() | (uint32_t(value.g()) << 16));
+    params.push_back(value.b() | (uint32_t(value.a()) << 16));
+}
+
+void push_matrix(std::vector<uint32_t> &params, const matrix44<float> &value)
+{
+    for (float v : value.data)
+        push_float(params, v);
+}
+
+} // namespace
+
+[[nodiscard]] auto node::param_int(uint32_t i) const -> int32_t
+{
+    assert(i < params.size());
+    return static_cast<int32_t>(params[i]);
+}
+
+[[nodiscard]] auto node::param_float(uint32_t i) const -> float
+{
+    assert(i < params.size());
+    return std::bit_cast<float>(params[i]);
+}
+
+[[nodiscard]] auto node::param_pixel(uint32_t i) const -> pixel
+{
+    assert(i + 1 < params.size());
+    return pixel{static_cast<red16_t>(params[i] & 0xffff), static_cast<green16_t>(params[i] >> 16), static_cast<blue16_t>(params[i + 1] & 0xffff),
+                 static_cast<alpha16_t>(params[i + 1] >> 16)};
+}
+
+[[nodiscard]] auto node::param_matrix(uint32_t i) const -> matrix44<float>
+{
+    assert(i + 16 <= params.size());
+
+    matrix44<float> m;
+    for (uint32_t j = 0; j < 16; j++)
+        m.data[j] = param_float(i + j);
+
+    return m;
+}
+
+auto recipe::add(op kind, uint32_t width, uint32_t height, std::vector<node_id> inputs) -> node &
+{
+    assert(std::ranges::all_of(inputs, [&](node_id in) { return in == no_node || in < nodes_.size(); }));
+
+    nodes_.push_back(node{kind, width, height, std::move(inputs), {}});
+    return nodes_.back();
+}
+
+auto recipe::gradient(uint32_t startCol, uint32_t endCol) -> node_id
+{
+    node &n = add(op::gradient, 2, 1, {});
+    n.params = {startCol, endCol};
+    return size() - 1;
+}
+
+auto recipe::noise(uint32_t width, uint32_t height, node_id grad, int32_t freqX, int32_t freqY, int32_t oct, float fadeoff, int32_t seed, int32_t mode)
+    -> node_id
+{
+    node &n = add(op::noise, width, height, {grad});
+    n.params = {uint32_t(freqX), uint32_t(freqY), uint32_t(oct)};
+    push_float(n.params, fadeoff);
+    n.params.push_back(seed);
+    n.params.push_back(mode);
+    return size() - 1;
+}
+
+auto recipe::voronoi(uint32_t width, uint32_t height, node_id grad, int32_t intensity, int32_t maxCount, float minDist, int32_t seed) -> node_id
+{
+    node &n = add(op::voronoi, width, height, {grad});
+    n.params = {uint32_t(intensity), uint32_t(maxCount)};
+    push_float(n.params, minDist);
+    n.params.push_back(seed);
+    return size() - 1;
+}
+
+auto recipe::glow_rect(node_id background, node_id grad, float orgx, float orgy, float ux, float uy, float vx, float vy, float rectu, float rectv) -> node_id
+{
+    node &n = add(op::glow_rect, nodes_[background].width, nodes_[background].height, {background, grad});
+    for (float v : {orgx, orgy, ux, uy, vx, vy, rectu, rectv})
+        push_float(n.params, v);
+    return size() - 1;
+}
+
+auto recipe::linear_combine(uint32_t width, uint32_t height, const pixel &color, float constWeight, const linear_term *terms, int32_t nTerms) -> node_id
+{
+    std::vector<node_id> inputs;
+    for (int32_t i = 0; i < nTerms; i++)
+        inputs.push_back(terms[i].tex);
+
+    node &n = add(op::linear_combine, width, height, std::move(inputs));
+    push_pixel(n.params, color);
+    push_float(n.params, constWeight);
+    for (int32_t i = 0; i < nTerms; i++)
+    {
+        push_float(n.params, terms[i].weight);
+        push_float(n.params, terms[i].ushift);
+        push_float(n.params, terms[i].vshift);
+        n.params.push_back(terms[i].filter_mode);
+    }
+    return size() - 1;
+}
+
+auto recipe::colorize(node_id in, uint32_t startCol, uint32_t endCol) -> node_id
+{
+    node &n = add(op::colorize, nodes_[in].width, nodes_[in].height, {in});
+    n.params = {startCol, endCol};
+    return size() - 1;
+}
+
+auto recipe::color_matrix(node_id in, const matrix44<float> &matrix, bool clampPremult) -> node_id
+{
+    node &n = add(op::color_matrix, nodes_[in].width, nodes_[in].height, {in});
+    push_matrix(n.params, matrix);
+    n.params.push_back(clampPremult);
+    return size() - 1;
+}
+
+auto recipe::color_remap(node_id in, node_id mapR, node_id mapG, node_id mapB) -> node_id
+{
+    add(op::color_remap, nodes_[in].width, nodes_[in].height, {in, mapR, mapG, mapB});
+    return size() - 1;
+}
+
+auto recipe::coord_matrix(node_id in, const matrix44<float> &matrix, int32_t filterMode) -> node_id
+{
+    node &n = add(op::coord_matrix, nodes_[in].width, nodes_[in].height, {in});
+    push_matrix(n.params, matrix);
+    n.params.push_back(filterMode);
+    return size() - 1;
+}
+
+auto recipe::derive(node_id in, DeriveOp deriveOp, float strength, DeriveStencil stencil) -> node_id
+{
+    node &n = add(op::derive, nodes_[in].width, nodes_[in].height, {in});
+    n.params = {uint32_t(deriveOp)};
+    push_float(n.params, strength);
+    n.params.push_back(uint32_t(stencil));
+    return size() - 1;
+}
+
+auto recipe::blur(node_id in, float sizex, float sizey, int32_t order, int32_t mode, bool srgb) -> node_id
+{
+    node &n = add(op::blur, nodes_[in].width, nodes_[in].height, {in});
+    push_float(n.params, sizex);
+    push_float(n.params, sizey);
+    n.params.push_back(order);
+    n.params.push_back(mode);
+    n.params.push_back(srgb);
+    return size() - 1;
+}
+
+auto recipe::ternary(node_id in1, node_id in2, node_id in3, TernaryOp ternaryOp) -> node_id
+{
+    node &n = add(op::ternary, nodes_[in1].width, nodes_[in1].height, {in1, in2, in3});
+    n.params = {uint32_t(ternaryOp)};
+    return size() - 1;
+}
+
+auto recipe::paste(node_id background, node_id snippet, float orgx, float orgy, float ux, float uy, float vx, float vy, CombineOp combineOp, int32_t mode)
+    -> node_id
+{
+    node &n = add(op::paste, nodes_[background].width, nodes_[background].height, {background, snippet});
+    for (float v : {orgx, orgy, ux, uy, vx, vy})
+        push_float(n.params, v);
+    n.params.push_back(combineOp);
+    n.params.push_back(mode);
+    return size() - 1;
+}
+
+auto recipe::bump(node_id surface, node_id normals, node_id specular, node_id falloff, float px, float py, float pz, float dx, float dy, float dz,
+                  const pixel &ambient, const pixel &diffuse, bool directional) -> node_id
+{
+    node &n = add(op::bump, nodes_[surface].width, nodes_[surface].height, {surface, normals, specular, falloff});
+    for (float v : {px, py, pz, dx, dy, dz})
+        push_float(n.params, v);
+    push_pixel(n.params, ambient);
+    push_pixel(n.params, diffuse);
+    n.params.push_back(directional);
+    return size() - 1;
+}
+
+auto recipe::append(node n) -> node_id
+{
+    node &added = add(n.kind, n.width, n.height, std::move(n.inputs));
+    added.params = std::move(n.params);
+    return size() - 1;
+}
+
+void recipe::set_param(node_id id, uint32_t index, uint32_t value)
+{
+    assert(id < nodes_.size() && index < nodes_[id].params.size());
+    nodes_[id].params[index] = value;
+}
+
+[[nodiscard]] auto recipe::size() const noexcept -> uint32_t
+{
+    return nodes_.size();
+}
+
+[[nodiscard]] auto recipe::operator[](node_id id) const -> const node &
+{
+    assert(id < nodes_.size());
+    return nodes_[id];
+}
+
+} // namespace openktg::graph
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <openktg/tex/procedural.h>
+
+#include "stage.h"
+
+namespace openktg::graph
+{
+
+auto blur_radius(float size, int32_t extent, int32_t order) -> int32_t
+{
+    const int32_t sizeFixed = kernels::BlurSizeFixed(size, extent);
+    return (order >= 1 && sizeFixed > 32) ? order * ((sizeFixed + 32) >> 6) : 0;
+}
+
+auto runs_whole(const node &n) -> bool
+{
+    return n.kind == op::gradient || n.kind == op::voronoi || (n.kind == op::linear_combine && !n.inputs.empty());
+}
+
+auto prepare(const node &n, const std::vector<texture> &whole, uint64_t pixels) -> stage
+{
+    stage s;
+    s.extent = kernels::Extent(n.width, n.height);
+
+    switch (n.kind)
+    {
+    case op::linear_combine: {
+        // constant color, through the operator for the exact rounding
+        texture one(1, 1);
+        LinearCombine(one, n.param_pixel(0), n.param_float(2), nullptr, 0);
+        s.constant = one.at(0, 0);
+        break;
+    }
+
+    case op::noise:
+        s.noise = kernels::SetupNoise(s.extent, n.param_int(0), n.param_int(1), n.param_int(2), n.param_float(3), n.param_int(4), n.param_int(5));
+        break;
+
+    case op::glow_rect:
+        s.glow = kernels::SetupGlow(s.extent, n.param_float(0), n.param_float(1), n.param_float(2), n.param_float(3), n.param_float(4), n.param_float(5),
+                                    n.param_float(6), n.param_float(7));
+        break;
+
+    case op::colorize:
+        s.matrix = kernels::ColorMatrixFixed(ColorizeMatrix(n.params[0], n.params[1]));
+        s.clampPremult = true;
+        break;
+
+    case op::color_matrix:
+        s.matrix = kernels::ColorMatrixFixed(n.param_matrix(0));
+        s.clampPremult = n.params[16] != 0;
+        break;
+
+    case op::color_remap:
+        s.remap = std::make_unique<kernels::ColorRemapTables>(whole[n.inputs[1]], whole[n.inputs[2]], whole[n.inputs[3]], pixels);
+        break;
+
+    case op::coord_matrix:
+        s.coord = kernels::SetupCoordTransform(s.extent, n.param_matrix(0));
+        break;
+
+    case op::blur:
+        s.radiusX = blur_radius(n.param_float(0), n.width, n.param_int(2));
+        s.radiusY = blur_radius(n.param_float(1), n.height, n.param_int(2));
+        break;
+
+    case op::paste:
+        s.paste = kernels::SetupPaste(s.extent, whole[n.inputs[1]], n.param_float(0), n.param_float(1), n.param_float(2), n.param_float(3), n.param_float(4),
+                                      n.param_float(5));
+        break;
+
+    case op::bump: {
+        const texture *specular = n.inputs[2] == no_node ? nullptr : &whole[n.inputs[2]];
+        const texture *falloff = n.inputs[3] == no_node ? nullptr : &whole[n.inputs[3]];
+        s.bump = std::make_unique<kernels::BumpSetup>(kernels::SetupBump(s.extent, specular, falloff, n.param_float(0), n.param_float(1), n.param_float(2),
+                                                                         n.param_float(3), n.param_float(4), n.param_float(5), n.param_pixel(6),
+                                                                         n.param_pixel(8), n.params[10] != 0));
+        break;
+    }
+
+    default:
+        break;
+    }
+
+    return s;
+}
+
+void run_part(const node &n, const stage &s, const std::vector<texture> &whole, const kernels::Region *in, pixel *dst, int32_t stride, int32_t x0, int32_t y0,
+              int32_t x1, int32_t y1, part_scratch &scratch)
+{
+    const int32_t count = x1 - x0 + 1;
+
+    switch (n.kind)
+    {
+    case op::linear_combine:
+        for (int32_t y = y0; y <= y1; y++)
+            std::fill_n(dst + (y - y0) * stride, count, s.constant);
+        break;
+
+    case op::noise:
+        kernels::NoisePixels(s.noise, whole[n.inputs[0]], dst, stride, x0, y0, x1, y1);
+        break;
+
+    case op::glow_rect:
+        for (int32_t y = y0; y <= y1; y++)
+            std::memcpy(dst + (y - y0) * stride, in[0].row(x0, y, count), count * sizeof(pixel));
+        kernels::GlowPixels(s.glow, whole[n.inputs[1]], dst, stride, x0, y0, x1, y1);
+        break;
+
+    case op::colorize:
+    case op::color_matrix:
+        for (int32_t y = y0; y <= y1; y++)
+        {
+            const pixel *src = in[0].row(x0, y, count);
+            pixel *out = dst + (y - y0) * stride;
+            for (int32_t x = 0; x < count; x++)
+                out[x] = kernels::ColorMatrixPixel(s.matrix, src[x], s.clampPremult);
+        }
+        break;
+
+    case op::color_remap:
+        for (int32_t y = y0; y <= y1; y++)
+        {
+            const pixel *src = in[0].row(x0, y, count);
+            pixel *out = dst + (y - y0) * stride;
+            for (int32_t x = 0; x < count; x++)
+                out[x] = kernels::ColorRemapPixel(*s.remap, src[x]);
+        }
+        break;
+
+    case op::coord_matrix:
+        kernels::CoordTransformPixels(s.coord, in[0], n.param_int(16), dst, stride, x0, y0, x1, y1);
+        break;
+
+    case op::derive:
+        kernels::DerivePixels(in[0], DeriveOp(n.param_int(0)), DeriveStencil(n.param_int(2)), n.param_float(1), dst, stride, x0, y0, x1, y1);
+        break;
+
+    case op::blur:
+        kernels::BlurPixels(in[0], n.param_float(0), n.param_float(1), n.param_int(2), n.param_int(3), n.param_int(4), dst, stride, x0, y0, x1, y1);
+        break;
+
+    case op::ternary:
+        for (int32_t y = y0; y <= y1; y++)
+        {
+            const pixel *a = in[0].row(x0, y, count);
+            const pixel *b = in[1].row(x0, y, count);
+            const pixel *c = in[2].row(x0, y, count);
+            pixel *out = dst + (y - y0) * stride;
+            for (int32_t x = 0; x < count; x++)
+                out[x] = kernels::TernaryPixel(a[x], b[x], c[x], static_cast<TernaryOp>(n.param_int(0)));
+        }
+        break;
+
+    case op::paste:
+        for (int32_t y = y0; y <= y1; y++)
+            std::memcpy(dst + (y - y0) * stride, in[0].row(x0, y, count), count * sizeof(pixel));
+        kernels::PasteRect(s.paste, dst, stride, whole[n.inputs[1]], static_cast<CombineOp>(n.param_int(6)), n.param_int(7), x0, y0, x1, y1);
+        break;
+
+    case op::bump: {
+        if (!scratch.bump)
+            scratch.bump = std::make_unique<kernels::BumpScratch>(*s.bump);
+        for (int32_t y = y0; y <= y1; y++)
+            kernels::BumpSpan(*s.bump, *scratch.bump, y, x0, count, dst + (y - y0) * stride, in[0].row(x0, y, count), in[1].row(x0, y, count));
+        break;
+    }
+
+    default:
+        assert(false); // runs whole
+        break;
+    }
+}
+
+} // namespace openktg::graph
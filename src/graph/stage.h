@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <openktg/core/texture.h>
+#include <openktg/graph/recipe.h>
+
+#include "../tex/kernels.h"
+
+// Operator kernels over rectangles of a node, shared by the evaluators that compute nodes in parts
+namespace openktg::graph
+{
+
+// Pixels Blur reads on either side along an axis of the given length
+auto blur_radius(float size, int32_t extent, int32_t order) -> int32_t;
+
+// Operators without a kernel for parts of the texture
+auto runs_whole(const node &n) -> bool;
+
+// What a node computed in parts needs, set up once
+struct stage
+{
+    kernels::Extent extent{1, 1};
+    pixel constant;                     // linear_combine without inputs
+    kernels::NoiseSetup noise;          // noise
+    kernels::GlowSetup glow;            // glow_rect
+    kernels::PasteSetup paste;          // paste
+    kernels::CoordTransformSetup coord; // coord_matrix
+    matrix44<int> matrix;               // colorize, color_matrix
+    bool clampPremult = false;          // colorize, color_matrix
+    int32_t radiusX = 0, radiusY = 0;   // blur: pixels read on either side
+    std::unique_ptr<kernels::ColorRemapTables> remap;
+    std::unique_ptr<kernels::BumpSetup> bump;
+};
+
+// Working memory of run_part for one node, kept by each thread across the parts it computes
+struct part_scratch
+{
+    std::unique_ptr<kernels::BumpScratch> bump;
+};
+
+// Sets up node n to compute about the given number of pixels, over all the parts run with the
+// result; whole holds the full textures of the inputs it samples anywhere
+auto prepare(const node &n, const std::vector<texture> &whole, uint64_t pixels) -> stage;
+
+// Pixels [x0,x1] x [y0,y1] of node n; dst is pixel (x0, y0), rows stride pixels apart
+void run_part(const node &n, const stage &s, const std::vector<texture> &whole, const kernels::Region *in, pixel *dst, int32_t stride, int32_t x0, int32_t y0,
+              int32_t x1, int32_t y1, part_scratch &scratch);
+
+} // namespace openktg::graph
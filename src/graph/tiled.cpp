@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <openktg/graph/evaluate.h>
+#include <openktg/util/parallel.h>
+
+#include "../tex/kernels.h"
+#include "stage.h"
+
+namespace openktg::graph
+{
+
+namespace
+{
+
+// Pixel interval along one axis of a texture. Positions repeat with the texture size,
+// so lo is kept in [0, size) and hi may pass size (but stays below lo + size).
+struct span
+{
+    int32_t lo = 0, hi = -1; // empty if hi < lo
+
+    [[nodiscard]] auto empty() const -> bool
+    {
+        return hi < lo;
+    }
+    [[nodiscard]] auto length() const -> int32_t
+    {
+        return hi - lo + 1;
+    }
+};
+
+struct area
+{
+    span x, y;
+};
+
+// Span of the positions lo..hi, the whole axis if that is a period or more
+auto make_span(int64_t lo, int64_t hi, int32_t size) -> span
+{
+    if (hi - lo + 1 >= size)
+        return {0, size - 1};
+
+    const int64_t period = lo & ~int64_t(size - 1);
+    return {static_cast<int32_t>(lo - period), static_cast<int32_t>(hi - period)};
+}
+
+// Grows a to the smallest span that also covers b
+void unite(span &a, const span &b, int32_t size)
+{
+    if (b.empty())
+        return;
+    if (a.empty())
+    {
+        a = b;
+        return;
+    }
+
+    // both start in [0, size), so b is nearest a moved by at most one period
+    int64_t lo = 0, hi = size;
+    for (int32_t shift : {-size, 0, size})
+    {
+        int32_t l = std::min(a.lo, b.lo + shift);
+        int32_t h = std::max(a.hi, b.hi + shift);
+        if (h - l < hi - lo)
+            lo = l, hi = h;
+    }
+
+    a = make_span(lo, hi, size);
+}
+
+// Part of a span inside [0, size); offset is its position within the span
+struct piece
+{
+    int32_t lo, hi, offset;
+};
+
+auto split(const span &s, int32_t size, piece (&parts)[2]) -> int32_t
+{
+    parts[0] = {s.lo, std::min(s.hi, size - 1), 0};
+    if (s.hi < size)
+        return 1;
+
+    parts[1] = {0, s.hi - size, size - s.lo};
+    return 2;
+}
+
+// Inputs that are needed as full textures: the ones operators sample anywhere, and the ones
+// where the footprints of neighbouring tiles would overlap so much that computing the input
+// once is cheaper than recomputing most of it for every tile
+auto reads_whole(const node &n, uint32_t slot, int32_t tileSize) -> bool
+{
+    switch (n.kind)
+    {
+    case op::noise:
+    case op::voronoi:
+    case op::linear_combine:
+        return true;
+    case op::glow_rect:
+        return slot == 1; // gradient
+    case op::color_remap:
+        return slot >= 1; // maps
+    case op::paste:
+        return slot == 1; // snippet
+    case op::bump:
+        return slot >= 2; // specular and falloff gradients
+    case op::blur:
+        return 2 * blur_radius(n.param_float(0), n.width, n.param_int(2)) > tileSize ||
+               2 * blur_radius(n.param_float(1), n.height, n.param_int(2)) > tileSize;
+    case op::coord_matrix: {
+        // more than 1.25 source texels per pixel: minified or noticeably rotated lookups
+        const kernels::Extent extent(n.width, n.height);
+        const kernels::CoordTransformSetup c = kernels::SetupCoordTransform(extent, n.param_matrix(0));
+        const double texelsU = (std::abs(double(c.dudx)) + std::abs(double(c.dudy))) / (1 << (24 - extent.shiftX));
+        const double texelsV = (std::abs(double(c.dvdx)) + std::abs(double(c.dvdy))) / (1 << (24 - extent.shiftY));
+        return texelsU * texelsV > 1.25;
+    }
+    default:
+        return false;
+    }
+}
+
+// Texels along one axis that samples at coordinates c0..c1 (1.7.24 fixed point) read
+auto sample_span(int64_t c0, int64_t c1, int32_t shift, bool clamp, bool bilinear) -> span
+{
+    const int32_t size = 1 << shift;
+    const int64_t minC = 1 << (23 - shift);
+
+    // samplers step in 32 bits; outside that range the wraparound is not worth tracking
+    if (c0 < INT32_MIN || c1 > INT32_MAX)
+        return {0, size - 1};
+
+    if (clamp)
+    {
+        c0 = std::clamp(c0, minC, 0x1000000 - minC);
+        c1 = std::clamp(c1, minC, 0x1000000 - minC);
+    }
+
+    if (bilinear)
+        return make_span((c0 - minC) >> (24 - shift), ((c1 - minC) >> (24 - shift)) + 1, size);
+    else
+        return make_span(c0 >> (24 - shift), c1 >> (24 - shift), size);
+}
+
+// Pixels of input slot that node n reads to produce [x.lo,x.hi] x [y.lo,y.hi]
+auto footprint(const node &n, const stage &s, const piece &x, const piece &y) -> area
+{
+    const int32_t w = n.width, h = n.height;
+
+    switch (n.kind)
+    {
+    case op::derive:
+        return {make_span(x.lo - 1, x.hi + 1, w), make_span(y.lo - 1, y.hi + 1, h)};
+
+    case op::blur:
+        return {make_span(x.lo - s.radiusX, x.hi + s.radiusX, w), make_span(y.lo - s.radiusY, y.hi + s.radiusY, h)};
+
+    case op::coord_matrix: {
+        // coordinates are linear in x and y, so the corners bound them
+        const kernels::CoordTransformSetup &c = s.coord;
+        int64_t u[4], v[4];
+        for (int32_t i = 0; i < 4; i++)
+        {
+            int64_t px = (i & 1) ? x.hi : x.lo;
+            int64_t py = (i & 2) ? y.hi : y.lo;
+            u[i] = c.u0 + px * c.dudx + py * c.dudy;
+            v[i] = c.v0 + px * c.dvdx + py * c.dvdy;
+        }
+
+        const int32_t mode = n.param_int(16);
+        const bool bilinear = (mode & FilterBilinear) != 0;
+        return {sample_span(*std::min_element(u, u + 4), *std::max_element(u, u + 4), s.extent.shiftX, mode & ClampU, bilinear),
+                sample_span(*std::min_element(v, v + 4), *std::max_element(v, v + 4), s.extent.shiftY, mode & ClampV, bilinear)};
+    }
+
+    default: // per pixel
+        return {make_span(x.lo, x.hi, w), make_span(y.lo, y.hi, h)};
+    }
+}
+
+} // namespace
+
+void evaluate_tiled(const recipe &r, std::span<const node_id> outputs, std::span<texture> results, int32_t tileSize)
+{
+    assert(outputs.size() == results.size() && tileSize > 0);
+
+    const uint32_t count = r.size();
+
+    // nodes the outputs depend on; consumers come after their inputs, so one backward pass finds them
+    std::vector<bool> needed(count, false), whole(count, false);
+    for (node_id o : outputs)
+        needed[o] = true;
+
+    for (node_id id = count; id-- > 0;)
+    {
+        if (!needed[id])
+            continue;
+
+        const node &n = r[id];
+        whole[id] = whole[id] || runs_whole(n);
+
+        for (uint32_t k = 0; k < n.inputs.size(); k++)
+        {
+            if (n.inputs[k] == no_node)
+                continue;
+
+            needed[n.inputs[k]] = true;
+            if (whole[id] || reads_whole(n, k, tileSize))
+                whole[n.inputs[k]] = true;
+        }
+    }
+
+    // full textures first
+    std::vector<texture> full(count);
+    std::vector<const texture *> inputs;
+    for (node_id id = 0; id < count; id++)
+    {
+        if (!whole[id])
+            continue;
+
+        inputs.clear();
+        for (node_id in : r[id].inputs)
+            inputs.push_back(in == no_node ? nullptr : &full[in]);
+
+        run_node(r, id, inputs, full[id]);
+    }
+
+    std::vector<stage> stages(count);
+    for (node_id id = 0; id < count; id++)
+    {
+        if (needed[id] && !whole[id])
+            stages[id] = prepare(r[id], full, uint64_t(r[id].width) * r[id].height);
+    }
+
+    // tiled outputs, one pass per output size
+    std::vector<bool> done(outputs.size(), false);
+    for (uint32_t i = 0; i < outputs.size(); i++)
+    {
+        if (whole[outputs[i]])
+        {
+            results[i] = full[outputs[i]];
+            done[i] = true;
+        }
+    }
+
+    for (uint32_t first = 0; first < outputs.size(); first++)
+    {
+        if (done[first])
+            continue;
+
+        const int32_t width = r[outputs[first]].width;
+        const int32_t height = r[outputs[first]].height;
+        const kernels::Extent extent(width, height);
+
+        std::vector<uint32_t> group;
+        for (uint32_t i = first; i < outputs.size(); i++)
+        {
+            if (!done[i] && int32_t(r[outputs[i]].width) == width && int32_t(r[outputs[i]].height) == height)
+            {
+                group.push_back(i);
+                results[i].resize(width, height);
+                done[i] = true;
+            }
+        }
+
+        const int32_t tile = std::min({tileSize, width, height});
+        const uint32_t tilesX = (width + tile - 1) / tile;
+        const uint32_t tilesY = (height + tile - 1) / tile;
+
+        util::parallel_for(0, tilesX * tilesY, 1, [&](uint32_t begin, uint32_t end) {
+            std::vector<area> need(count);
+            std::vector<std::vector<pixel>> buffers(count);
+            std::vector<part_scratch> scratch(count);
+
+            auto region = [&](node_id id) {
+                if (whole[id])
+                    return kernels::Region(full[id]);
+
+                const area &a = need[id];
+                return kernels::Region(buffers[id].data(), a.x.length(), a.x.lo, a.y.lo, a.x.length(), a.y.length(), extent.shiftX, extent.shiftY);
+            };
+
+            for (uint32_t t = begin; t < end; t++)
+            {
+                const int32_t tx0 = (t % tilesX) * tile, tx1 = std::min(tx0 + tile, width) - 1;
+                const int32_t ty0 = (t / tilesX) * tile, ty1 = std::min(ty0 + tile, height) - 1;
+
+                // pixels each node has to provide, from the outputs back
+                std::fill(need.begin(), need.end(), area{});
+                for (uint32_t i : group)
+                    need[outputs[i]] = {make_span(tx0, tx1, width), make_span(ty0, ty1, height)};
+
+                for (node_id id = count; id-- > 0;)
+                {
+                    const node &n = r[id];
+                    if (whole[id] || need[id].x.empty())
+                        continue;
+
+                    piece px[2], py[2];
+                    const int32_t nx = split(need[id].x, width, px);
+                    const int32_t ny = split(need[id].y, height, py);
+
+                    for (node_id in : n.inputs)
+                    {
+                        if (in == no_node || whole[in])
+                            continue;
+
+                        for (int32_t j = 0; j < ny; j++)
+                        {
+                            for (int32_t i = 0; i < nx; i++)
+                            {
+                                area a = footprint(n, stages[id], px[i], py[j]);
+                                unite(need[in].x, a.x, width);
+                                unite(need[in].y, a.y, height);
+                            }
+                        }
+                    }
+                }
+
+                // then compute them, inputs first
+                for (node_id id = 0; id < count; id++)
+                {
+                    const node &n = r[id];
+                    if (whole[id] || need[id].x.empty())
+                        continue;
+
+                    kernels::Region in[4];
+                    assert(n.inputs.size() <= 4);
+                    for (uint32_t k = 0; k < n.inputs.size(); k++)
+                    {
+                        if (n.inputs[k] != no_node)
+                            in[k] = region(n.inputs[k]);
+                    }
+
+                    const area &a = need[id];
+                    const int32_t stride = a.x.length();
+                    buffers[id].resize(stride * a.y.length());
+
+                    piece px[2], py[2];
+                    const int32_t nx = split(a.x, width, px);
+                    const int32_t ny = split(a.y, height, py);
+                    for (int32_t j = 0; j < ny; j++)
+                    {
+                        for (int32_t i = 0; i < nx; i++)
+                        {
+                            pixel *dst = buffers[id].data() + py[j].offset * stride + px[i].offset;
+                            run_part(n, stages[id], full, in, dst, stride, px[i].lo, py[j].lo, px[i].hi, py[j].hi, scratch[id]);
+                        }
+                    }
+                }
+
+                for (uint32_t i : group)
+                {
+                    const kernels::Region out = region(outputs[i]);
+                    for (int32_t y = ty0; y <= ty1; y++)
+                        std::memcpy(&results[i].at(tx0, y), out.row(tx0, y, tx1 - tx0 + 1), (tx1 - tx0 + 1) * sizeof(pixel));
+                }
+            }
+        });
+    }
+}
+
+} // namespace openktg::graph
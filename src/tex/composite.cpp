@@ -1,11 +1,17 @@
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <vector>
 
 #include <openktg/core/pixel.h>
 #include <openktg/core/texture.h>
 #include <openktg/tex/composite.h>
 #include <openktg/tex/sampling.h>
+#include <openktg/util/parallel.h>
 #include <openktg/util/utility.h>
 
+#include "kernels.h"
+
 void Ternary(openktg::texture &input, const openktg::texture &in1Tex, const openktg::texture &in2Tex, const openktg::texture &in3Tex, TernaryOp op)
 {
     assert(texture_size_matches(input, in1Tex));
@@ -13,23 +19,7 @@ void Ternary(openktg::texture &input, const openktg::texture &in1Tex, const open
     assert(texture_size_matches(input, in3Tex));
 
     for (int32_t i = 0; i < input.pixel_count(); i++)
-    {
-        openktg::core::pixel &out = input.data()[i];
-        const openktg::core::pixel &in1 = in1Tex.data()[i];
-        const openktg::core::pixel &in2 = in2Tex.data()[i];
-        const openktg::core::pixel &in3 = in3Tex.data()[i];
-
-        switch (op)
-        {
-        case TernaryLerp:
-            out = (~in3.r() * in1) + (in3.r() * in2);
-            break;
-
-        case TernarySelect:
-            out = (in3.r() >= 32768) ? in2 : in1;
-            break;
-        }
-    }
+        input.data()[i] = openktg::kernels::TernaryPixel(in1Tex.data()[i], in2Tex.data()[i], in3Tex.data()[i], op);
 }
 
 void Paste(openktg::texture &input, const openktg::texture &bgTex, const openktg::texture &inTex, float orgx, float orgy, float ux, float uy, float vx,
@@ -41,115 +31,54 @@ void Paste(openktg::texture &input, const openktg::texture &bgTex, const openktg
     if (&input != &bgTex)
         input = bgTex;
 
-    // calculate bounding rect
-    int32_t minX = std::max<int32_t>(0, floor((orgx + std::min(ux, 0.0f) + std::min(vx, 0.0f)) * input.width()));
-    int32_t minY = std::max<int32_t>(0, floor((orgy + std::min(uy, 0.0f) + std::min(vy, 0.0f)) * input.height()));
-    int32_t maxX = std::min<int32_t>(input.width() - 1, ceil((orgx + std::max(ux, 0.0f) + std::max(vx, 0.0f)) * input.width()));
-    int32_t maxY = std::min<int32_t>(input.height() - 1, ceil((orgy + std::max(uy, 0.0f) + std::max(vy, 0.0f)) * input.height()));
-
-    // solve for u0,v0 and deltas (Cramer's rule)
-    float detM = ux * vy - uy * vx;
-    if (fabs(detM) * input.width() * input.height() < 0.25f) // smaller than a pixel? skip it.
-        return;
-
-    float invM = (1 << 24) / detM;
-    float rmx = (minX + 0.5f) / input.width() - orgx;
-    float rmy = (minY + 0.5f) / input.height() - orgy;
-    int32_t u0 = (rmx * vy - rmy * vx) * invM;
-    int32_t v0 = (ux * rmy - uy * rmx) * invM;
-    int32_t dudx = vy * invM / input.width();
-    int32_t dvdx = -uy * invM / input.width();
-    int32_t dudy = -vx * invM / input.height();
-    int32_t dvdy = ux * invM / input.height();
-
-    for (int32_t y = minY; y <= maxY; y++)
-    {
-        openktg::core::pixel *out = &input.at(minX, y);
-        int32_t u = u0;
-        int32_t v = v0;
-
-        for (int32_t x = minX; x <= maxX; x++)
-        {
-            if (u >= 0 && u < 0x1000000 && v >= 0 && v < 0x1000000)
-            {
-                openktg::core::pixel in;
-                int32_t transIn, transOut;
-
-                SampleFiltered(inTex, in, u, v, ClampU | ClampV | ((mode & 1) ? FilterBilinear : FilterNearest));
-
-                switch (op)
-                {
-                case CombineAdd: {
-                    *out += in;
-                    break;
-                }
-
-                case CombineSub: {
-                    *out -= in;
-                    break;
-                }
-
-                case CombineMulC: {
-                    *out *= in;
-                    break;
-                }
-
-                case CombineMin: {
-                    *out &= in;
-                    break;
-                }
-
-                case CombineMax: {
-                    *out |= in;
-                    break;
-                }
+    const openktg::kernels::PasteSetup placement = openktg::kernels::SetupPaste(input, inTex, orgx, orgy, ux, uy, vx, vy);
+    openktg::kernels::PasteRect(placement, input.data(), input.width(), inTex, op, mode, 0, 0, input.width() - 1, input.height() - 1);
+}
 
-                case CombineSetAlpha: {
-                    out->set_alpha(static_cast<openktg::alpha16_t>(in.r()));
-                    break;
-                }
+void CompositeStack(openktg::texture &input, const openktg::texture &background, const CompositeLayer *layers, int32_t nLayers)
+{
+    assert(texture_size_matches(input, background));
 
-                case CombinePreAlpha: {
-                    *out = *out * in.r();
-                    out->set_alpha(static_cast<openktg::alpha16_t>(in.g()));
-                    break;
-                }
+    std::vector<openktg::kernels::PasteSetup> placements(nLayers);
+    for (int32_t i = 0; i < nLayers; i++)
+    {
+        const CompositeLayer &l = layers[i];
+        assert(l.Tex != &input); // layers read their source while the destination changes
+        placements[i] = openktg::kernels::SetupPaste(input, *l.Tex, l.OrgX, l.OrgY, l.UX, l.UY, l.VX, l.VY);
+    }
 
-                case CombineOver: {
-                    *out = openktg::combineOver(in, *out);
-                    break;
-                }
+    // tiles small enough to stay in cache while every layer is applied
+    const int32_t tileSize = 64;
+    const int32_t width = input.width();
+    const int32_t height = input.height();
+    const int32_t tilesY = (height + tileSize - 1) / tileSize;
 
-                case CombineMultiply: {
-                    *out = openktg::combineMultiply(in, *out);
-                    break;
-                }
+    openktg::util::parallel_for(0, tilesY, 1, [&](uint32_t begin, uint32_t end) {
+        for (int32_t ty = begin; ty < end; ty++)
+        {
+            const int32_t y0 = ty * tileSize;
+            const int32_t y1 = std::min(height, y0 + tileSize) - 1;
 
-                case CombineScreen: {
-                    *out = openktg::combineScreen(in, *out);
-                    break;
-                }
+            for (int32_t x0 = 0; x0 < width; x0 += tileSize)
+            {
+                const int32_t x1 = std::min(width, x0 + tileSize) - 1;
 
-                case CombineDarken: {
-                    *out = openktg::combineDarken(in, *out);
-                    break;
+                // copy background over (if this image is not the background already)
+                if (&input != &background)
+                {
+                    for (int32_t y = y0; y <= y1; y++)
+                        std::memcpy(&input.at(x0, y), &background.at(x0, y), (x1 - x0 + 1) * sizeof(openktg::core::pixel));
                 }
 
-                case CombineLighten: {
-                    *out = openktg::combineLighten(in, *out);
-                    break;
-                }
+                for (int32_t i = 0; i < nLayers; i++)
+                {
+                    const openktg::kernels::PasteSetup &p = placements[i];
+                    if (p.minX <= x1 && p.maxX >= x0 && p.minY <= y1 && p.maxY >= y0)
+                        openktg::kernels::PasteRect(p, &input.at(x0, y0), width, *layers[i].Tex, layers[i].Op, layers[i].Mode, x0, y0, x1, y1);
                 }
             }
-
-            u += dudx;
-            v += dvdx;
-            out++;
         }
-
-        u0 += dudy;
-        v0 += dvdy;
-    }
+    });
 }
 
 void Bump(openktg::texture &input, const openktg::texture &surface, const openktg::texture &normals, const openktg::texture *specular,
@@ -159,125 +88,145 @@ void Bump(openktg::texture &input, const openktg::texture &surface, const openkt
     assert(texture_size_matches(input, normals));
     assert(texture_size_matches(input, surface));
 
-    float L[3], H[3]; // light/halfway vector
-    float invX, invY;
+    const openktg::kernels::BumpSetup light =
+        openktg::kernels::SetupBump(input, specular, falloffMap, px, py, pz, dx, dy, dz, ambient, diffuse, directional);
 
-    float scale = openktg::util::rsqrt(dx * dx + dy * dy + dz * dz);
-    dx *= scale;
-    dy *= scale;
-    dz *= scale;
+    openktg::util::parallel_for(0, input.height(), 16, [&](uint32_t begin, uint32_t end) {
+        openktg::kernels::BumpScratch scratch(light);
 
-    if (directional)
-    {
-        L[0] = -dx;
-        L[1] = -dy;
-        L[2] = -dz;
-
-        scale = openktg::util::rsqrt(2.0f + 2.0f * L[2]); // 1/sqrt((L + <0,0,1>)^2)
-        H[0] = L[0] * scale;
-        H[1] = L[1] * scale;
-        H[2] = (L[2] + 1.0f) * scale;
-    }
+        for (uint32_t y = begin; y < end; y++)
+            openktg::kernels::BumpRow(light, scratch, y, &input.at(0, y), &surface.at(0, y), &normals.at(0, y));
+    });
+}
 
-    invX = 1.0f / input.width();
-    invY = 1.0f / input.height();
-    openktg::core::pixel *out = input.data();
-    const openktg::core::pixel *surf = surface.data();
-    const openktg::core::pixel *normal = normals.data();
+void BumpMulti(openktg::texture &input, const openktg::texture &surface, const openktg::texture &normals, const BumpLight *lights, int32_t nLights)
+{
+    assert(texture_size_matches(input, normals));
+    assert(texture_size_matches(input, surface));
+    assert(nLights >= 1);
+    assert(&input != &surface && &input != &normals); // every light reads the original rows
 
-    for (int32_t y = 0; y < input.height(); y++)
+    std::vector<openktg::kernels::BumpSetup> setups;
+    setups.reserve(nLights);
+    for (int32_t i = 0; i < nLights; i++)
     {
-        for (int32_t x = 0; x < input.width(); x++)
-        {
-            // determine vectors to light
-            if (!directional)
-            {
-                L[0] = px - (x + 0.5f) * invX;
-                L[1] = py - (y + 0.5f) * invY;
-                L[2] = pz;
+        const BumpLight &l = lights[i];
+        setups.push_back(openktg::kernels::SetupBump(input, l.Specular, l.Falloff, l.Px, l.Py, l.Pz, l.Dx, l.Dy, l.Dz, l.Ambient, l.Diffuse, l.Directional));
+    }
 
-                float scale = openktg::util::rsqrt(L[0] * L[0] + L[1] * L[1] + L[2] * L[2]);
-                L[0] *= scale;
-                L[1] *= scale;
-                L[2] *= scale;
+    const int32_t width = input.width();
 
-                // determine halfway vector
-                if (specular)
-                {
-                    float scale = openktg::util::rsqrt(2.0f + 2.0f * L[2]); // 1/sqrt((L + <0,0,1>)^2)
-                    H[0] = L[0] * scale;
-                    H[1] = L[1] * scale;
-                    H[2] = (L[2] + 1.0f) * scale;
-                }
-            }
+    openktg::util::parallel_for(0, input.height(), 16, [&](uint32_t begin, uint32_t end) {
+        std::vector<openktg::kernels::BumpScratch> scratch;
+        scratch.reserve(nLights);
+        for (const openktg::kernels::BumpSetup &light : setups)
+            scratch.emplace_back(light);
 
-            // fetch normal
-            float N[3];
-            N[0] = (normal->r() - 0x8000) / 32768.0f;
-            N[1] = (normal->g() - 0x8000) / 32768.0f;
-            N[2] = (normal->b() - 0x8000) / 32768.0f;
+        std::vector<openktg::core::pixel> lit(width);
 
-            // get falloff term if specified
-            openktg::core::pixel falloff;
-            if (falloffMap)
-            {
-                float spotTerm = std::max<float>(dx * L[0] + dy * L[1] + dz * L[2], 0.0f);
-                SampleGradient(*falloffMap, falloff, spotTerm * (1 << 24));
-            }
+        for (uint32_t y = begin; y < end; y++)
+        {
+            openktg::core::pixel *out = &input.at(0, y);
+            const openktg::core::pixel *surf = &surface.at(0, y);
+            const openktg::core::pixel *normal = &normals.at(0, y);
 
-            // lighting calculation
-            float NdotL = std::max<float>(N[0] * L[0] + N[1] * L[1] + N[2] * L[2], 0.0f);
-            openktg::core::pixel ambDiffuse =
-                openktg::core::pixel{static_cast<openktg::red16_t>(NdotL * diffuse.r()), static_cast<openktg::green16_t>(NdotL * diffuse.g()),
-                                     static_cast<openktg::blue16_t>(NdotL * diffuse.b()), static_cast<openktg::alpha16_t>(NdotL * diffuse.a())};
-            if (falloffMap)
+            // first light writes the row, the others add to it
+            openktg::kernels::BumpRow(setups[0], scratch[0], y, out, surf, normal);
+            for (int32_t i = 1; i < nLights; i++)
             {
-                ambDiffuse = openktg::compositeMulC(ambDiffuse, falloff);
+                openktg::kernels::BumpRow(setups[i], scratch[i], y, lit.data(), surf, normal);
+                for (int32_t x = 0; x < width; x++)
+                    out[x] += lit[x];
             }
+        }
+    });
+}
 
-            ambDiffuse = openktg::compositeAdd(ambDiffuse, ambient);
-            *out = *surf * ambDiffuse;
+void BumpFromHeight(openktg::texture &input, const openktg::texture &surface, const openktg::texture &height, float strength,
+                    const openktg::texture *specular, const openktg::texture *falloffMap, float px, float py, float pz, float dx, float dy, float dz,
+                    const openktg::core::pixel &ambient, const openktg::core::pixel &diffuse, bool directional)
+{
+    assert(texture_size_matches(input, height));
+    assert(texture_size_matches(input, surface));
+    assert(&input != &height); // heights are read in a window around the current row
 
-            if (specular)
-            {
-                openktg::core::pixel addTerm;
-                float NdotH = std::max<float>(N[0] * H[0] + N[1] * H[1] + N[2] * H[2], 0.0f);
-                SampleGradient(*specular, addTerm, NdotH * (1 << 24));
-                if (falloffMap)
-                {
-                    addTerm = openktg::compositeMulC(addTerm, falloff);
-                }
+    const openktg::kernels::BumpSetup light =
+        openktg::kernels::SetupBump(input, specular, falloffMap, px, py, pz, dx, dy, dz, ambient, diffuse, directional);
+    const int32_t width = input.width();
+
+    openktg::util::parallel_for(0, input.height(), 16, [&](uint32_t begin, uint32_t end) {
+        openktg::kernels::BumpScratch scratch(light);
+        openktg::kernels::HeightWindow window(height, begin);
+        std::vector<openktg::core::pixel> normals(width);
 
-                auto new_alpha = out->a();
-                *out += addTerm;
-                out->set_alpha(static_cast<openktg::alpha16_t>(new_alpha));
-                out->clamp_premult();
+        for (uint32_t y = begin; y < end; y++)
+        {
+            const int32_t *above = window.above();
+            const int32_t *center = window.center();
+            const int32_t *below = window.below();
+
+            // same normals Derive(..., DeriveNormals, strength) would have stored
+            for (int32_t x = 0; x < width; x++)
+            {
+                float sx = openktg::kernels::DeriveSlope(center[x + 1] - center[x - 1], strength);
+                float sy = openktg::kernels::DeriveSlope(below[x] - above[x], strength);
+                normals[x] = openktg::kernels::DeriveNormalPixel(sx, sy);
             }
 
-            out++;
-            surf++;
-            normal++;
+            openktg::kernels::BumpRow(light, scratch, y, &input.at(0, y), &surface.at(0, y), normals.data());
+
+            if (y + 1 < end)
+                window.advance();
         }
-    }
+    });
 }
 
 void LinearCombine(openktg::texture &input, const openktg::core::pixel &color, float constWeight, const LinearInput *inputs, int32_t nInputs)
 {
-    int32_t w[256], uo[256], vo[256];
-
-    assert(nInputs <= 255);
     assert(constWeight >= -127.0f && constWeight <= 127.0f);
 
-    // convert weights and offsets to fixed point
+    const int32_t width = input.width();
+    const int32_t u0 = input.min_x();
+    const int32_t v0 = input.min_y();
+    const int32_t stepU = 1 << (24 - input.shift_x());
+    const int32_t stepV = 1 << (24 - input.shift_y());
+
+    // Fixed point weights and per-axis taps of every input; u only depends on x and v only on y,
+    // so each input is sampled a row at a time
+    struct Layer
+    {
+        const openktg::texture *tex;
+        int32_t w;
+        bool nearestU;   // horizontal taps hit texels exactly
+        bool contiguous; // ...and read a (wrapped) run of consecutive texels
+        std::vector<openktg::kernels::AxisTap> tx, ty;
+    };
+
+    std::vector<Layer> layers(nInputs);
     for (int32_t i = 0; i < nInputs; i++)
     {
-        assert(inputs[i].Weight >= -127.0f && inputs[i].Weight <= 127.0f);
-        assert(inputs[i].UShift >= -127.0f && inputs[i].UShift <= 127.0f);
-        assert(inputs[i].VShift >= -127.0f && inputs[i].VShift <= 127.0f);
-
-        w[i] = inputs[i].Weight * 65536.0f;
-        uo[i] = inputs[i].UShift * (1 << 24);
-        vo[i] = inputs[i].VShift * (1 << 24);
+        const LinearInput &in = inputs[i];
+        Layer &l = layers[i];
+
+        assert(in.Weight >= -127.0f && in.Weight <= 127.0f);
+        assert(in.UShift >= -127.0f && in.UShift <= 127.0f);
+        assert(in.VShift >= -127.0f && in.VShift <= 127.0f);
+        assert(in.Tex != &input);
+
+        l.tex = in.Tex;
+        l.w = in.Weight * 65536.0f;
+
+        bool bilinear = (in.FilterMode & FilterBilinear) != 0;
+        int32_t uo = in.UShift * (1 << 24);
+        int32_t vo = in.VShift * (1 << 24);
+        openktg::kernels::ComputeAxisTaps(l.tx, u0 + uo, stepU, width, l.tex->width(), l.tex->shift_x(), l.tex->min_x(), in.FilterMode & ClampU, bilinear);
+        openktg::kernels::ComputeAxisTaps(l.ty, v0 + vo, stepV, input.height(), l.tex->height(), l.tex->shift_y(), l.tex->min_y(), in.FilterMode & ClampV,
+                                          bilinear);
+
+        l.nearestU = std::all_of(l.tx.begin(), l.tx.end(), [](const openktg::kernels::AxisTap &t) { return t.f == 0; });
+        l.contiguous = l.nearestU && l.tex->width() == input.width();
+        for (int32_t x = 0; x < width && l.contiguous; x++)
+            l.contiguous = l.tx[x].i0 == ((l.tx[0].i0 + x) & (width - 1));
     }
 
     // compute preweighted constant color
@@ -289,55 +238,79 @@ void LinearCombine(openktg::texture &input, const openktg::core::pixel &color, f
     c_b = openktg::util::mul_shift_16(t, color.b());
     c_a = openktg::util::mul_shift_16(t, color.a());
 
-    // calculate output image
-    int32_t u0 = input.min_x();
-    int32_t v0 = input.min_y();
-    int32_t stepU = 1 << (24 - input.shift_x());
-    int32_t stepV = 1 << (24 - input.shift_y());
-    openktg::core::pixel *out = input.data();
+    // horizontally sampled source row of one input
+    auto sampleRow = [width](openktg::core::pixel *dst, const Layer &l, int32_t srcY) {
+        const openktg::core::pixel *src = &l.tex->at(0, srcY);
 
-    for (int32_t y = 0; y < input.height(); y++)
-    {
-        int32_t u = u0;
-        int32_t v = v0;
+        if (l.contiguous)
+        {
+            int32_t first = l.tx[0].i0;
+            int32_t run = width - first;
 
-        for (int32_t x = 0; x < input.width(); x++)
+            std::memcpy(dst, src + first, run * sizeof(openktg::core::pixel));
+            std::memcpy(dst + run, src, first * sizeof(openktg::core::pixel));
+        }
+        else if (l.nearestU)
+        {
+            for (int32_t x = 0; x < width; x++)
+                dst[x] = src[l.tx[x].i0];
+        }
+        else
         {
-            int32_t acc_r, acc_g, acc_b, acc_a;
+            for (int32_t x = 0; x < width; x++)
+                dst[x] = lerp(src[l.tx[x].i0], src[l.tx[x].i1], l.tx[x].f);
+        }
+    };
+
+    // calculate output image; 64 bit sums, since 256 or more inputs of weight 127 overflow 32 bits
+    openktg::util::parallel_for(0, input.height(), 16, [&](uint32_t begin, uint32_t end) {
+        std::vector<int64_t> acc(4 * width);
+        std::vector<openktg::core::pixel> row0(width), row1(width);
 
-            // initialize accumulator with start value
-            acc_r = c_r;
-            acc_g = c_g;
-            acc_b = c_b;
-            acc_a = c_a;
+        for (uint32_t y = begin; y < end; y++)
+        {
+            // initialize accumulators with start value
+            for (int32_t x = 0; x < width; x++)
+            {
+                acc[4 * x + 0] = c_r;
+                acc[4 * x + 1] = c_g;
+                acc[4 * x + 2] = c_b;
+                acc[4 * x + 3] = c_a;
+            }
 
-            // accumulate inputs
-            for (int32_t j = 0; j < nInputs; j++)
+            // accumulate inputs, one row each
+            for (const Layer &l : layers)
             {
-                const LinearInput &in = inputs[j];
-                openktg::core::pixel inPix;
+                const openktg::kernels::AxisTap &ty = l.ty[y];
 
-                SampleFiltered(*in.Tex, inPix, u + uo[j], v + vo[j], in.FilterMode);
+                sampleRow(row0.data(), l, ty.i0);
+                if (ty.f != 0)
+                {
+                    sampleRow(row1.data(), l, ty.i1);
+                    for (int32_t x = 0; x < width; x++)
+                        row0[x] = lerp(row0[x], row1[x], ty.f);
+                }
 
-                acc_r += openktg::util::mul_shift_16(w[j], inPix.r());
-                acc_g += openktg::util::mul_shift_16(w[j], inPix.g());
-                acc_b += openktg::util::mul_shift_16(w[j], inPix.b());
-                acc_a += openktg::util::mul_shift_16(w[j], inPix.a());
+                for (int32_t x = 0; x < width; x++)
+                {
+                    acc[4 * x + 0] += openktg::util::mul_shift_16(l.w, row0[x].r());
+                    acc[4 * x + 1] += openktg::util::mul_shift_16(l.w, row0[x].g());
+                    acc[4 * x + 2] += openktg::util::mul_shift_16(l.w, row0[x].b());
+                    acc[4 * x + 3] += openktg::util::mul_shift_16(l.w, row0[x].a());
+                }
             }
 
             // store (with clamping)
-            *out = openktg::core::pixel{
-                static_cast<openktg::red16_t>(std::clamp(acc_r, 0, 65535)),
-                static_cast<openktg::green16_t>(std::clamp(acc_g, 0, 65535)),
-                static_cast<openktg::blue16_t>(std::clamp(acc_b, 0, 65535)),
-                static_cast<openktg::alpha16_t>(std::clamp(acc_a, 0, 65535)),
-            };
-
-            // advance to next pixel
-            u += stepU;
-            out++;
+            openktg::core::pixel *out = &input.at(0, y);
+            for (int32_t x = 0; x < width; x++)
+            {
+                out[x] = openktg::core::pixel{
+                    static_cast<openktg::red16_t>(std::clamp<int64_t>(acc[4 * x + 0], 0, 65535)),
+                    static_cast<openktg::green16_t>(std::clamp<int64_t>(acc[4 * x + 1], 0, 65535)),
+                    static_cast<openktg::blue16_t>(std::clamp<int64_t>(acc[4 * x + 2], 0, 65535)),
+                    static_cast<openktg::alpha16_t>(std::clamp<int64_t>(acc[4 * x + 3], 0, 65535)),
+                };
+            }
         }
-
-        v0 += stepV;
-    }
+    });
 }
\ No newline at end of file
@@ -1,127 +1,173 @@
 #include <algorithm>
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <span>
+#include <vector>
 
 #include <openktg/core/matrix.h>
 #include <openktg/core/pixel.h>
+#include <openktg/core/summed_area_table.h>
 #include <openktg/core/texture.h>
+#include <openktg/core/texture_statistics.h>
 #include <openktg/tex/filters.h>
 #include <openktg/tex/sampling.h>
+#include <openktg/util/parallel.h>
 #include <openktg/util/utility.h>
 
+#include "kernels.h"
+
 void ColorMatrixTransform(openktg::texture &input, const openktg::texture &x, const openktg::matrix44<float> &matrix, bool clampPremult)
 {
     assert(texture_size_matches(input, x));
 
-    openktg::matrix44<int> m;
-    std::transform(matrix.data.begin(), matrix.data.end(), m.data.begin(), [](const auto &fv) { return fv * 65536.0f; });
+    const openktg::matrix44<int> m = openktg::kernels::ColorMatrixFixed(matrix);
 
     for (int32_t i = 0; i < input.pixel_count(); i++)
+        input.data()[i] = openktg::kernels::ColorMatrixPixel(m, x.data()[i], clampPremult);
+}
+
+// u only depends on x and v only on y: translations and axis-aligned scales.
+static void CoordTransformAxisAligned(openktg::texture &input, const openktg::texture &in, int32_t u0, int32_t v0, int32_t dudx, int32_t dvdy, int32_t mode)
+{
+    bool bilinear = (mode & FilterBilinear) != 0;
+    std::vector<openktg::kernels::AxisTap> tx, ty;
+
+    openktg::kernels::ComputeAxisTaps(tx, u0, dudx, input.width(), in.width(), in.shift_x(), in.min_x(), mode & ClampU, bilinear);
+    openktg::kernels::ComputeAxisTaps(ty, v0, dvdy, input.height(), in.height(), in.shift_y(), in.min_y(), mode & ClampV, bilinear);
+
+    if (!bilinear)
     {
-        openktg::pixel &out = input.data()[i];
-        const openktg::pixel &in = x.data()[i];
-
-        // some kind of pixel matrix multiplication
-        int32_t r = openktg::util::mul_shift_16(m(0, 0), in.r()) + openktg::util::mul_shift_16(m(0, 1), in.g()) + openktg::util::mul_shift_16(m(0, 2), in.b()) +
-                    openktg::util::mul_shift_16(m(0, 3), in.a());
-        int32_t g = openktg::util::mul_shift_16(m(1, 0), in.r()) + openktg::util::mul_shift_16(m(1, 1), in.g()) + openktg::util::mul_shift_16(m(1, 2), in.b()) +
-                    openktg::util::mul_shift_16(m(1, 3), in.a());
-        int32_t b = openktg::util::mul_shift_16(m(2, 0), in.r()) + openktg::util::mul_shift_16(m(2, 1), in.g()) + openktg::util::mul_shift_16(m(2, 2), in.b()) +
-                    openktg::util::mul_shift_16(m(2, 3), in.a());
-        int32_t a = openktg::util::mul_shift_16(m(3, 0), in.r()) + openktg::util::mul_shift_16(m(3, 1), in.g()) + openktg::util::mul_shift_16(m(3, 2), in.b()) +
-                    openktg::util::mul_shift_16(m(3, 3), in.a());
-
-        a = std::clamp<int32_t>(a, 0, 65535);
-        r = std::clamp<int32_t>(r, 0, 65535);
-        g = std::clamp<int32_t>(g, 0, 65535);
-        b = std::clamp<int32_t>(b, 0, 65535);
-
-        out = openktg::pixel{static_cast<openktg::red16_t>(r), static_cast<openktg::green16_t>(g), static_cast<openktg::blue16_t>(b),
-                             static_cast<openktg::alpha16_t>(a)};
-
-        if (clampPremult)
+        // unit steps in u without clamping read a (wrapped) contiguous run of texels
+        bool contiguous = dudx == (1 << (24 - in.shift_x())) && !(mode & ClampU);
+
+        for (int32_t y = 0; y < input.height(); y++)
         {
-            out.clamp_premult();
+            const openktg::core::pixel *src = &in.at(0, ty[y].i0);
+            openktg::core::pixel *out = &input.at(0, y);
+
+            if (contiguous)
+            {
+                int32_t first = tx[0].i0;
+                int32_t run = input.width() - first;
+
+                std::memcpy(out, src + first, run * sizeof(openktg::core::pixel));
+                std::memcpy(out + run, src, first * sizeof(openktg::core::pixel));
+            }
+            else
+            {
+                for (int32_t x = 0; x < input.width(); x++)
+                    out[x] = src[tx[x].i0];
+            }
         }
+
+        return;
     }
-}
 
-void CoordMatrixTransform(openktg::texture &input, const openktg::texture &in, const openktg::matrix44<float> &matrix, int32_t mode)
-{
-    assert(texture_size_matches(input, in));
+    // bilinear: filter source rows horizontally, then blend pairs of filtered rows.
+    // A small cache keeps the last two filtered rows, which consecutive output rows usually share.
+    std::vector<openktg::core::pixel> rowBuf[2] = {std::vector<openktg::core::pixel>(input.width()), std::vector<openktg::core::pixel>(input.width())};
+    int32_t rowTag[2] = {-1, -1};
 
-    int32_t scaleX = 1 << (24 - input.shift_x());
-    int32_t scaleY = 1 << (24 - input.shift_y());
+    auto filteredRow = [&](int32_t srcY, int32_t keep) -> const openktg::core::pixel * {
+        for (int32_t i = 0; i < 2; i++)
+            if (rowTag[i] == srcY)
+                return rowBuf[i].data();
 
-    int32_t dudx = matrix(0, 0) * scaleX;
-    int32_t dudy = matrix(0, 1) * scaleY;
-    int32_t dvdx = matrix(1, 0) * scaleX;
-    int32_t dvdy = matrix(1, 1) * scaleY;
+        int32_t slot = (rowTag[0] == keep) ? 1 : 0;
+        const openktg::core::pixel *src = &in.at(0, srcY);
+        openktg::core::pixel *dst = rowBuf[slot].data();
 
-    int32_t u0 = matrix(0, 3) * (1 << 24) + ((dudx + dudy) >> 1);
-    int32_t v0 = matrix(1, 3) * (1 << 24) + ((dvdx + dvdy) >> 1);
-    openktg::core::pixel *out = input.data();
+        for (int32_t x = 0; x < input.width(); x++)
+            dst[x] = lerp(src[tx[x].i0], src[tx[x].i1], tx[x].f);
+
+        rowTag[slot] = srcY;
+        return dst;
+    };
 
     for (int32_t y = 0; y < input.height(); y++)
     {
-        int32_t u = u0;
-        int32_t v = v0;
+        const openktg::core::pixel *t0 = filteredRow(ty[y].i0, ty[y].i1);
+        const openktg::core::pixel *t1 = filteredRow(ty[y].i1, ty[y].i0);
+        openktg::core::pixel *out = &input.at(0, y);
 
         for (int32_t x = 0; x < input.width(); x++)
-        {
-            SampleFiltered(in, *out, u, v, mode);
-
-            u += dudx;
-            v += dvdx;
-            out++;
-        }
-
-        u0 += dudy;
-        v0 += dvdy;
+            out[x] = lerp(t0[x], t1[x], ty[y].f);
     }
 }
 
-void ColorRemap(openktg::texture &input, const openktg::texture &inTex, const openktg::texture &mapR, const openktg::texture &mapG,
-                const openktg::texture &mapB)
+// u only depends on y and v only on x: multiples of 90 degree rotations (and mirrored/scaled variants).
+// Output is written in square blocks so the source columns being walked stay in cache.
+static void CoordTransformTransposed(openktg::texture &input, const openktg::texture &in, int32_t u0, int32_t v0, int32_t dudy, int32_t dvdx, int32_t mode)
 {
-    assert(texture_size_matches(input, inTex));
+    static const int32_t blockSize = 32;
 
-    for (int32_t i = 0; i < input.pixel_count(); i++)
-    {
-        const openktg::core::pixel &in = inTex.data()[i];
-        openktg::core::pixel &out = input.data()[i];
+    bool bilinear = (mode & FilterBilinear) != 0;
+    std::vector<openktg::kernels::AxisTap> tu, tv;
 
-        if (in.a() == 65535) // alpha==1, everything easy.
-        {
-            openktg::core::pixel colR, colG, colB;
+    openktg::kernels::ComputeAxisTaps(tu, u0, dudy, input.height(), in.width(), in.shift_x(), in.min_x(), mode & ClampU, bilinear);
+    openktg::kernels::ComputeAxisTaps(tv, v0, dvdx, input.width(), in.height(), in.shift_y(), in.min_y(), mode & ClampV, bilinear);
 
-            SampleGradient(mapR, colR, (in.r() << 8) + ((in.r() + 128) >> 8));
-            SampleGradient(mapG, colG, (in.g() << 8) + ((in.g() + 128) >> 8));
-            SampleGradient(mapB, colB, (in.b() << 8) + ((in.b() + 128) >> 8));
+    for (int32_t by = 0; by < input.height(); by += blockSize)
+    {
+        int32_t ey = std::min<int32_t>(by + blockSize, input.height());
 
-            out =
-                openktg::core::pixel(static_cast<openktg::red16_t>(std::min(colR.r() + colG.r() + colB.r(), 65535)),
-                                     static_cast<openktg::green16_t>(std::min(colR.g() + colG.g() + colB.g(), 65535)),
-                                     static_cast<openktg::blue16_t>(std::min(colR.b() + colG.b() + colB.b(), 65535)), static_cast<openktg::alpha16_t>(in.a()));
-        }
-        else if (in.a()) // alpha!=0
+        for (int32_t bx = 0; bx < input.width(); bx += blockSize)
         {
-            openktg::core::pixel colR, colG, colB;
-            uint32_t invA = (65535U << 16) / in.a();
+            int32_t ex = std::min<int32_t>(bx + blockSize, input.width());
 
-            SampleGradient(mapR, colR, openktg::util::unsigned_mul_shift_8(std::min(in.r(), in.a()), invA));
-            SampleGradient(mapG, colG, openktg::util::unsigned_mul_shift_8(std::min(in.g(), in.a()), invA));
-            SampleGradient(mapB, colB, openktg::util::unsigned_mul_shift_8(std::min(in.b(), in.a()), invA));
+            for (int32_t y = by; y < ey; y++)
+            {
+                const openktg::kernels::AxisTap &u = tu[y];
+                openktg::core::pixel *out = &input.at(0, y);
 
-            out = openktg::core::pixel(static_cast<openktg::red16_t>(openktg::util::mul_intens(std::min(colR.r() + colG.r() + colB.r(), 65535), in.a())),
-                                       static_cast<openktg::green16_t>(openktg::util::mul_intens(std::min(colR.g() + colG.g() + colB.g(), 65535), in.a())),
-                                       static_cast<openktg::blue16_t>(openktg::util::mul_intens(std::min(colR.b() + colG.b() + colB.b(), 65535), in.a())),
-                                       static_cast<openktg::alpha16_t>(in.a()));
+                if (bilinear)
+                {
+                    for (int32_t x = bx; x < ex; x++)
+                    {
+                        const openktg::kernels::AxisTap &v = tv[x];
+                        openktg::core::pixel t0 = lerp(in.at(u.i0, v.i0), in.at(u.i1, v.i0), u.f);
+                        openktg::core::pixel t1 = lerp(in.at(u.i0, v.i1), in.at(u.i1, v.i1), u.f);
+                        out[x] = lerp(t0, t1, v.f);
+                    }
+                }
+                else
+                {
+                    for (int32_t x = bx; x < ex; x++)
+                        out[x] = in.at(u.i0, tv[x].i0);
+                }
+            }
         }
-        else // alpha==0
-            out = in;
     }
 }
 
+void CoordMatrixTransform(openktg::texture &input, const openktg::texture &in, const openktg::matrix44<float> &matrix, int32_t mode)
+{
+    assert(texture_size_matches(input, in));
+
+    const openktg::kernels::CoordTransformSetup s = openktg::kernels::SetupCoordTransform(input, matrix);
+
+    // separable cases get dedicated kernels; they pick exactly the texels and weights the samplers would
+    if (s.dudy == 0 && s.dvdx == 0)
+        return CoordTransformAxisAligned(input, in, s.u0, s.v0, s.dudx, s.dvdy, mode);
+    if (s.dudx == 0 && s.dvdy == 0)
+        return CoordTransformTransposed(input, in, s.u0, s.v0, s.dudy, s.dvdx, mode);
+
+    openktg::kernels::CoordTransformPixels(s, in, mode, input.data(), input.width(), 0, 0, input.width() - 1, input.height() - 1);
+}
+
+void ColorRemap(openktg::texture &input, const openktg::texture &inTex, const openktg::texture &mapR, const openktg::texture &mapG,
+                const openktg::texture &mapB)
+{
+    assert(texture_size_matches(input, inTex));
+
+    const openktg::kernels::ColorRemapTables tables(mapR, mapG, mapB, input.pixel_count());
+
+    for (int32_t i = 0; i < input.pixel_count(); i++)
+        input.data()[i] = openktg::kernels::ColorRemapPixel(tables, inTex.data()[i]);
+}
+
 void CoordRemap(openktg::texture &input, const openktg::texture &in, const openktg::texture &remapTex, float strengthU, float strengthV, int32_t mode)
 {
     assert(texture_size_matches(input, remapTex));
@@ -156,144 +202,60 @@ void CoordRemap(openktg::texture &input, const openktg::texture &in, const openk
     }
 }
 
-void Derive(openktg::texture &input, const openktg::texture &in, DeriveOp op, float strength)
+// Gradient or normals from height differences: 2-tap central ones, or the 3x3 Sobel or Scharr
+// stencils, which smooth across the difference and are normalized by their total tap weight
+void Derive(openktg::texture &input, const openktg::texture &inImg, DeriveOp op, float strength, DeriveStencil stencil)
 {
-    assert(texture_size_matches(input, in));
-
-    openktg::core::pixel *out = input.data();
+    assert(texture_size_matches(input, inImg));
 
-    for (int32_t y = 0; y < input.height(); y++)
+    // rows around the current one are read after it is written
+    openktg::texture copy;
+    const openktg::texture *in = &inImg;
+    if (&input == &inImg)
     {
-        for (int32_t x = 0; x < input.width(); x++)
-        {
-            // int32_t dx2 = in.Data[y * input.width() + ((x + 1) & (input.width() - 1))].r() - in.Data[y * input.width() + ((x - 1) & (input.width() -
-            // 1))].r(); int32_t dy2 = in.Data[x + ((y + 1) & (input.height() - 1)) * input.width()].r() - in.Data[x + ((y - 1) & (input.height() - 1)) *
-            // input.width()].r();
-            int32_t dx2 = in.at((x + 1) & (input.width() - 1), y).r() - in.at((x - 1) & (input.width() - 1), y).r();
-            int32_t dy2 = in.at(x, (y + 1) & (input.height() - 1)).r() - in.at(x, (y - 1) & (input.height() - 1)).r();
-            float dx = dx2 * strength / (2 * 65535.0f);
-            float dy = dy2 * strength / (2 * 65535.0f);
-
-            switch (op)
-            {
-            case DeriveGradient: {
-                *out = openktg::core::pixel{static_cast<openktg::red16_t>(std::clamp<int32_t>(dx * 32768.0f + 32768.0f, 0, 65535)),
-                                            static_cast<openktg::green16_t>(std::clamp<int32_t>(dy * 32768.0f + 32768.0f, 0, 65535)),
-                                            static_cast<openktg::blue16_t>(0), static_cast<openktg::alpha16_t>(65535)};
-                break;
-            }
-            case DeriveNormals: {
-                // (1 0 dx)^T x (0 1 dy)^T = (-dx -dy 1)
-                float scale = 32768.0f * openktg::util::rsqrt(1.0f + dx * dx + dy * dy);
-
-                *out = openktg::core::pixel{static_cast<openktg::red16_t>(std::clamp<int32_t>(-dx * scale + 32768.0f, 0, 65535)),
-                                            static_cast<openktg::green16_t>(std::clamp<int32_t>(-dy * scale + 32768.0f, 0, 65535)),
-                                            static_cast<openktg::blue16_t>(std::clamp<int32_t>(scale + 32768.0f, 0, 65535)),
-                                            static_cast<openktg::alpha16_t>(65535)};
-                break;
-            }
-            }
-            out++;
-        }
+        copy = inImg;
+        in = &copy;
     }
-}
 
-// Wrap computation on pixel coordinates
-static auto WrapCoord(int32_t x, int32_t width, int32_t mode) -> int32_t
-{
-    if (mode == 0) // wrap
-        return x & (width - 1);
-    else
-        return std::clamp(x, 0, width - 1);
+    const int32_t width = input.width();
+
+    openktg::util::parallel_for(0, input.height(), 16, [&](uint32_t begin, uint32_t end) {
+        openktg::kernels::DerivePixels(*in, op, stencil, strength, &input.at(0, begin), width, 0, begin, width - 1, end - 1);
+    });
 }
 
-// Size is half of edge length in pixels, 26.6 fixed point
-static void Blur1DBuffer(openktg::core::pixel *dst, const openktg::core::pixel *src, int32_t width, int32_t sizeFixed, int32_t wrapMode)
+static void ConvertColorSpace(openktg::texture &input, const openktg::texture &in, const uint16_t *lut)
 {
-    assert(sizeFixed > 32); // kernel should be wider than one pixel
-    int32_t frac = (sizeFixed - 32) & 63;
-    int32_t offset = (sizeFixed + 32) >> 6;
-
-    assert(((offset - 1) * 64 + frac + 32) == sizeFixed);
-    uint32_t denom = sizeFixed * 2;
-    uint32_t bias = denom / 2;
-
-    // initialize accumulators
-    uint32_t accu[4];
-    if (wrapMode == 0) // wrap around
-    {
-        // leftmost and rightmost pixels (the partially covered ones)
-        int32_t xl = WrapCoord(-offset, width, wrapMode);
-        int32_t xr = WrapCoord(offset, width, wrapMode);
-        accu[0] = frac * (src[xl].r() + src[xr].r()) + bias;
-        accu[1] = frac * (src[xl].g() + src[xr].g()) + bias;
-        accu[2] = frac * (src[xl].b() + src[xr].b()) + bias;
-        accu[3] = frac * (src[xl].a() + src[xr].a()) + bias;
-
-        // inner part of filter kernel
-        for (int32_t x = -offset + 1; x <= offset - 1; x++)
-        {
-            int32_t xc = WrapCoord(x, width, wrapMode);
+    assert(texture_size_matches(input, in));
 
-            accu[0] += src[xc].r() << 6;
-            accu[1] += src[xc].g() << 6;
-            accu[2] += src[xc].b() << 6;
-            accu[3] += src[xc].a() << 6;
-        }
-    }
-    else // clamp on edge
-    {
-        // on the left edge, the first pixel is repeated over and over
-        accu[0] = src[0].r() * (sizeFixed + 32) + bias;
-        accu[1] = src[0].g() * (sizeFixed + 32) + bias;
-        accu[2] = src[0].b() * (sizeFixed + 32) + bias;
-        accu[3] = src[0].a() * (sizeFixed + 32) + bias;
-
-        // rightmost pixel
-        int32_t xr = WrapCoord(offset, width, wrapMode);
-        accu[0] += frac * src[xr].r();
-        accu[1] += frac * src[xr].g();
-        accu[2] += frac * src[xr].b();
-        accu[3] += frac * src[xr].a();
-
-        // inner part of filter kernel (the right half)
-        for (int32_t x = 1; x <= offset - 1; x++)
-        {
-            int32_t xc = WrapCoord(x, width, wrapMode);
+    openktg::util::parallel_for(0, in.height(), 16, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t y = begin; y < end; y++)
+            openktg::kernels::ConvertColorSpace(&input.at(0, y), &in.at(0, y), in.width(), lut);
+    });
+}
 
-            accu[0] += src[xc].r() << 6;
-            accu[1] += src[xc].g() << 6;
-            accu[2] += src[xc].b() << 6;
-            accu[3] += src[xc].a() << 6;
-        }
-    }
+void ToLinear(openktg::texture &input, const openktg::texture &in)
+{
+    ConvertColorSpace(input, in, openktg::kernels::ColorSpaceTables::get().toLinear.data());
+}
 
-    // generate output pixels
-    for (int32_t x = 0; x < width; x++)
-    {
-        // write out state of accumulator
-        dst[x] = openktg::core::pixel(static_cast<openktg::red16_t>(accu[0] / denom), static_cast<openktg::green16_t>(accu[1] / denom),
-                                      static_cast<openktg::blue16_t>(accu[2] / denom), static_cast<openktg::alpha16_t>(accu[3] / denom));
-
-        // update accumulator
-        int32_t xl0 = WrapCoord(x - offset + 0, width, wrapMode);
-        int32_t xl1 = WrapCoord(x - offset + 1, width, wrapMode);
-        int32_t xr0 = WrapCoord(x + offset + 0, width, wrapMode);
-        int32_t xr1 = WrapCoord(x + offset + 1, width, wrapMode);
-
-        accu[0] += 64 * (src[xr0].r() - src[xl1].r()) + frac * (src[xr1].r() - src[xr0].r() - src[xl0].r() + src[xl1].r());
-        accu[1] += 64 * (src[xr0].g() - src[xl1].g()) + frac * (src[xr1].g() - src[xr0].g() - src[xl0].g() + src[xl1].g());
-        accu[2] += 64 * (src[xr0].b() - src[xl1].b()) + frac * (src[xr1].b() - src[xr0].b() - src[xl0].b() + src[xl1].b());
-        accu[3] += 64 * (src[xr0].a() - src[xl1].a()) + frac * (src[xr1].a() - src[xr0].a() - src[xl0].a() + src[xl1].a());
-    }
+void ToSRGB(openktg::texture &input, const openktg::texture &in)
+{
+    ConvertColorSpace(input, in, openktg::kernels::ColorSpaceTables::get().toSRGB.data());
 }
 
-void Blur(openktg::texture &input, const openktg::texture &inImg, float sizex, float sizey, int32_t order, int32_t wrapMode)
+// Blur, and with srgb BlurSRGB
+static void Blur(openktg::texture &input, const openktg::texture &inImg, float sizex, float sizey, int32_t order, int32_t wrapMode, bool srgb)
 {
     assert(texture_size_matches(input, inImg));
 
-    int32_t sizePixX = std::clamp(sizex, 0.0f, 1.0f) * 64 * inImg.width() / 2;
-    int32_t sizePixY = std::clamp(sizey, 0.0f, 1.0f) * 64 * inImg.height() / 2;
+    int32_t sizePixX = openktg::kernels::BlurSizeFixed(sizex, inImg.width());
+    int32_t sizePixY = openktg::kernels::BlurSizeFixed(sizey, inImg.height());
+
+    // sRGB input is blurred in linear space, decoding on the first load and encoding on the last store
+    using openktg::kernels::ColorSpaceTables, openktg::kernels::ConvertColorSpace;
+    const uint16_t *toLinear = srgb ? ColorSpaceTables::get().toLinear.data() : nullptr;
+    const uint16_t *toSRGB = srgb ? ColorSpaceTables::get().toSRGB.data() : nullptr;
 
     // no blur at all? just copy!
     if (order < 1 || (sizePixX <= 32 && sizePixY <= 32))
@@ -305,6 +267,7 @@ void Blur(openktg::texture &input, const openktg::texture &inImg, float sizex, f
         openktg::core::pixel *buf1 = new openktg::core::pixel[bufSize];
         openktg::core::pixel *buf2 = new openktg::core::pixel[bufSize];
         const openktg::texture *in = &inImg;
+        bool decode = srgb; // pixels still need decoding when loaded
 
         // horizontal blur
         if (sizePixX > 32)
@@ -313,20 +276,27 @@ void Blur(openktg::texture &input, const openktg::texture &inImg, float sizex, f
             for (int32_t y = 0; y < input.height(); y++)
             {
                 // copy pixels into buffer 1
-                std::memcpy(buf1, &in->data()[y * input.width()], input.width() * sizeof(openktg::core::pixel));
+                if (srgb)
+                    ConvertColorSpace(buf1, &in->data()[y * input.width()], input.width(), toLinear);
+                else
+                    std::memcpy(buf1, &in->data()[y * input.width()], input.width() * sizeof(openktg::core::pixel));
 
                 // blur order times, ping-ponging between buffers
                 for (int32_t i = 0; i < order; i++)
                 {
-                    Blur1DBuffer(buf2, buf1, input.width(), sizePixX, (wrapMode & ClampU) ? 1 : 0);
+                    openktg::kernels::Blur1DBuffer(buf2, buf1, input.width(), sizePixX, (wrapMode & ClampU) ? 1 : 0);
                     std::swap(buf1, buf2);
                 }
 
                 // copy pixels back
-                std::memcpy(&input.data()[y * input.width()], buf1, input.width() * sizeof(openktg::core::pixel));
+                if (srgb && sizePixY <= 32)
+                    ConvertColorSpace(&input.data()[y * input.width()], buf1, input.width(), toSRGB);
+                else
+                    std::memcpy(&input.data()[y * input.width()], buf1, input.width() * sizeof(openktg::core::pixel));
             }
 
             in = &input;
+            decode = false;
         }
 
         // vertical blur
@@ -345,14 +315,20 @@ void Blur(openktg::texture &input, const openktg::texture &inImg, float sizex, f
                     src += input.width();
                 }
 
+                if (decode)
+                    ConvertColorSpace(buf1, buf1, input.height(), toLinear);
+
                 // blur order times, ping-ponging between buffers
                 for (int32_t i = 0; i < order; i++)
                 {
-                    Blur1DBuffer(buf2, buf1, input.height(), sizePixY, (wrapMode & ClampV) ? 1 : 0);
+                    openktg::kernels::Blur1DBuffer(buf2, buf1, input.height(), sizePixY, (wrapMode & ClampV) ? 1 : 0);
                     std::swap(buf1, buf2);
                 }
 
                 // copy pixels back
+                if (srgb)
+                    ConvertColorSpace(buf1, buf1, input.height(), toSRGB);
+
                 src = buf1;
                 dst = &input.data()[x];
 
@@ -368,4 +344,927 @@ void Blur(openktg::texture &input, const openktg::texture &inImg, float sizex, f
         delete[] buf1;
         delete[] buf2;
     }
-}
\ No newline at end of file
+}
+
+void Blur(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t order, int32_t wrapMode)
+{
+    Blur(input, in, sizex, sizey, order, wrapMode, false);
+}
+
+void BlurSRGB(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t order, int32_t wrapMode)
+{
+    Blur(input, in, sizex, sizey, order, wrapMode, true);
+}
+
+// coeff * G(index) term of a prefix sum over an extended (wrapped or clamped) axis
+struct PrefixTerm
+{
+    int32_t index;
+    int64_t coeff;
+};
+
+// Expresses the sum of g(ext(i)) over i < x as terms of the plain prefix sums G(k) = sum of g(i) over i < k,
+// where ext maps integer positions to [0, 1 << shift) by wrapping or clamping. Returns the number of terms.
+static auto ExtendedPrefixTerms(PrefixTerm *terms, int32_t x, int32_t shift, int32_t wrapMode) -> int32_t
+{
+    int32_t size = 1 << shift;
+
+    if (wrapMode == 0) // full periods plus remainder
+    {
+        terms[0] = {size, x >> shift};
+        terms[1] = {x & (size - 1), 1};
+        return 2;
+    }
+
+    if (x <= 0) // first pixel repeated to the left
+    {
+        terms[0] = {1, x};
+        return 1;
+    }
+
+    if (x <= size)
+    {
+        terms[0] = {x, 1};
+        return 1;
+    }
+
+    // last pixel repeated to the right: G(size) + (x - size) * (G(size) - G(size - 1))
+    terms[0] = {size, 1 + x - size};
+    terms[1] = {size - 1, size - x};
+    return 2;
+}
+
+// Sums over [0,x) x [0,y) of the infinitely extended texture
+static void ExtendedPrefixSum(int64_t *acc, int64_t sign, const openktg::summed_area_table &sat, int32_t x, int32_t y, int32_t shiftX, int32_t shiftY,
+                              int32_t wrapMode)
+{
+    PrefixTerm tx[2], ty[2];
+    int32_t nx = ExtendedPrefixTerms(tx, x, shiftX, (wrapMode & ClampU) ? 1 : 0);
+    int32_t ny = ExtendedPrefixTerms(ty, y, shiftY, (wrapMode & ClampV) ? 1 : 0);
+
+    for (int32_t j = 0; j < ny; j++)
+    {
+        for (int32_t i = 0; i < nx; i++)
+        {
+            const openktg::summed_area_table::sums &s = sat.at(tx[i].index, ty[j].index);
+            int64_t coeff = sign * tx[i].coeff * ty[j].coeff;
+
+            acc[0] += coeff * s[0];
+            acc[1] += coeff * s[1];
+            acc[2] += coeff * s[2];
+            acc[3] += coeff * s[3];
+        }
+    }
+}
+
+void VariableBlur(openktg::texture &input, const openktg::texture &inImg, const openktg::texture &control, float sizex, float sizey, int32_t wrapMode)
+{
+    assert(texture_size_matches(input, inImg));
+    assert(texture_size_matches(input, control));
+
+    // maximum half box size in pixels
+    int32_t maxX = std::clamp(sizex, 0.0f, 1.0f) * inImg.width() / 2;
+    int32_t maxY = std::clamp(sizey, 0.0f, 1.0f) * inImg.height() / 2;
+
+    // built before anything is written, so input may be the same texture as inImg
+    const openktg::summed_area_table sat(inImg);
+
+    openktg::util::parallel_for(0, input.height(), 16, [&](uint32_t begin, uint32_t end) {
+        for (int32_t y = begin; y < end; y++)
+        {
+            const openktg::core::pixel *ctrl = &control.at(0, y);
+            openktg::core::pixel *out = &input.at(0, y);
+
+            for (int32_t x = 0; x < input.width(); x++)
+            {
+                int32_t rx = (ctrl[x].r() * maxX + 32767) / 65535;
+                int32_t ry = (ctrl[x].r() * maxY + 32767) / 65535;
+                int64_t acc[4] = {0, 0, 0, 0};
+
+                // box [x-rx, x+rx] x [y-ry, y+ry] from the four corners
+                ExtendedPrefixSum(acc, 1, sat, x + rx + 1, y + ry + 1, input.shift_x(), input.shift_y(), wrapMode);
+                ExtendedPrefixSum(acc, -1, sat, x - rx, y + ry + 1, input.shift_x(), input.shift_y(), wrapMode);
+                ExtendedPrefixSum(acc, -1, sat, x + rx + 1, y - ry, input.shift_x(), input.shift_y(), wrapMode);
+                ExtendedPrefixSum(acc, 1, sat, x - rx, y - ry, input.shift_x(), input.shift_y(), wrapMode);
+
+                int64_t area = int64_t(2 * rx + 1) * (2 * ry + 1);
+                int64_t bias = area / 2;
+
+                out[x] = openktg::core::pixel{static_cast<openktg::red16_t>((acc[0] + bias) / area), static_cast<openktg::green16_t>((acc[1] + bias) / area),
+                                              static_cast<openktg::blue16_t>((acc[2] + bias) / area),
+                                              static_cast<openktg::alpha16_t>((acc[3] + bias) / area)};
+            }
+        }
+    });
+}
+
+// Pixels <-> interleaved 16 bit channel lanes (r, g, b, a)
+static void LoadLanes(uint16_t *dst, const openktg::core::pixel &p)
+{
+    dst[0] = p.r();
+    dst[1] = p.g();
+    dst[2] = p.b();
+    dst[3] = p.a();
+}
+
+static auto StoreLanes(const uint16_t *src) -> openktg::core::pixel
+{
+    return openktg::core::pixel{static_cast<openktg::red16_t>(src[0]), static_cast<openktg::green16_t>(src[1]), static_cast<openktg::blue16_t>(src[2]),
+                                static_cast<openktg::alpha16_t>(src[3])};
+}
+
+// van Herk/Gil-Werman running min/max over windows of 2r+1 elements, independent of r.
+// src holds n+2r elements of `lanes` values each (element i is at position i-r),
+// g/h are scratch buffers of the same size, dst receives n elements.
+template <class Op> static void MorphRun(uint16_t *dst, const uint16_t *src, uint16_t *g, uint16_t *h, int32_t n, int32_t r, int32_t lanes, Op op)
+{
+    int32_t k = 2 * r + 1;
+    int32_t len = n + 2 * r;
+
+    // running op from the start of each block of k elements...
+    for (int32_t i = 0; i < len; i++)
+    {
+        const uint16_t *f = src + i * lanes;
+        uint16_t *gi = g + i * lanes;
+
+        if (i % k == 0)
+            std::copy_n(f, lanes, gi);
+        else
+            for (int32_t l = 0; l < lanes; l++)
+                gi[l] = op(gi[l - lanes], f[l]);
+    }
+
+    // ...and from the end of each block
+    for (int32_t i = len - 1; i >= 0; i--)
+    {
+        const uint16_t *f = src + i * lanes;
+        uint16_t *hi = h + i * lanes;
+
+        if (i == len - 1 || (i + 1) % k == 0)
+            std::copy_n(f, lanes, hi);
+        else
+            for (int32_t l = 0; l < lanes; l++)
+                hi[l] = op(hi[l + lanes], f[l]);
+    }
+
+    // every window [x, x+2r] spans at most two blocks
+    for (int32_t x = 0; x < n; x++)
+    {
+        const uint16_t *hx = h + x * lanes;
+        const uint16_t *gx = g + (x + 2 * r) * lanes;
+        uint16_t *out = dst + x * lanes;
+
+        for (int32_t l = 0; l < lanes; l++)
+            out[l] = op(hx[l], gx[l]);
+    }
+}
+
+// Separable rectangular min/max filter
+template <class Op> static void Morphology(openktg::texture &input, const openktg::texture &inImg, float sizex, float sizey, int32_t wrapMode, Op op)
+{
+    assert(texture_size_matches(input, inImg));
+
+    static const int32_t stripWidth = 64; // columns per vertical pass strip
+
+    int32_t width = input.width();
+    int32_t height = input.height();
+    int32_t rx = std::clamp(sizex, 0.0f, 1.0f) * width / 2;
+    int32_t ry = std::clamp(sizey, 0.0f, 1.0f) * height / 2;
+    const openktg::texture *in = &inImg;
+
+    if (rx == 0 && ry == 0)
+    {
+        input = inImg;
+        return;
+    }
+
+    // horizontal pass, row by row
+    if (rx > 0)
+    {
+        int32_t clamp = (wrapMode & ClampU) ? 1 : 0;
+
+        openktg::util::parallel_for(0, height, 16, [&](uint32_t begin, uint32_t end) {
+            int32_t len = width + 2 * rx;
+            std::vector<uint16_t> src(len * 4), g(len * 4), h(len * 4), dst(width * 4);
+
+            for (int32_t y = begin; y < end; y++)
+            {
+                const openktg::core::pixel *row = &in->at(0, y);
+                for (int32_t i = 0; i < len; i++)
+                    LoadLanes(&src[i * 4], row[openktg::kernels::WrapCoord(i - rx, width, clamp)]);
+
+                MorphRun(dst.data(), src.data(), g.data(), h.data(), width, rx, 4, op);
+
+                openktg::core::pixel *out = &input.at(0, y);
+                for (int32_t x = 0; x < width; x++)
+                    out[x] = StoreLanes(&dst[x * 4]);
+            }
+        });
+
+        in = &input;
+    }
+
+    // vertical pass on strips of columns; each row of a strip is one wide element
+    if (ry > 0)
+    {
+        int32_t clamp = (wrapMode & ClampV) ? 1 : 0;
+        int32_t strips = (width + stripWidth - 1) / stripWidth;
+
+        openktg::util::parallel_for(0, strips, 1, [&](uint32_t begin, uint32_t end) {
+            int32_t len = height + 2 * ry;
+            int32_t lanes = std::min(stripWidth, width) * 4;
+            std::vector<uint16_t> src(len * lanes), g(len * lanes), h(len * lanes), dst(height * lanes);
+
+            for (int32_t strip = begin; strip < end; strip++)
+            {
+                int32_t x0 = strip * stripWidth;
+                int32_t columns = std::min(stripWidth, width - x0);
+
+                for (int32_t i = 0; i < len; i++)
+                {
+                    const openktg::core::pixel *row = &in->at(x0, openktg::kernels::WrapCoord(i - ry, height, clamp));
+                    for (int32_t x = 0; x < columns; x++)
+                        LoadLanes(&src[i * lanes + x * 4], row[x]);
+                }
+
+                MorphRun(dst.data(), src.data(), g.data(), h.data(), height, ry, lanes, op);
+
+                for (int32_t y = 0; y < height; y++)
+                {
+                    openktg::core::pixel *out = &input.at(x0, y);
+                    for (int32_t x = 0; x < columns; x++)
+                        out[x] = StoreLanes(&dst[y * lanes + x * 4]);
+                }
+            }
+        });
+    }
+}
+
+void Erode(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t wrapMode)
+{
+    Morphology(input, in, sizex, sizey, wrapMode, [](uint16_t a, uint16_t b) { return std::min(a, b); });
+}
+
+void Dilate(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t wrapMode)
+{
+    Morphology(input, in, sizex, sizey, wrapMode, [](uint16_t a, uint16_t b) { return std::max(a, b); });
+}
+
+// Column and kernel histograms of the rank filter for one strip. Histograms are two-level:
+// 256 coarse bins (high byte) and 256 fine bins per coarse bin (low byte). Column histograms
+// start out zero and RankStrip leaves them so, instead of clearing them per strip.
+struct RankHistograms
+{
+    std::vector<int32_t> texColumn;  // texture column of each histogram column
+    std::vector<uint16_t> colCoarse; // columns * 256
+    std::vector<uint16_t> colFine;   // columns * 65536
+    std::vector<uint32_t> coarse;    // window, 256
+    std::vector<uint32_t> fine;      // window, 65536 (lazily updated per coarse bin)
+    std::vector<int32_t> fineAt;     // 256, window position each fine part is valid for (-1 = stale)
+
+    explicit RankHistograms(int32_t columns)
+        : texColumn(columns), colCoarse(columns * 256), colFine(columns * 65536), coarse(256), fine(65536), fineAt(256)
+    {
+    }
+};
+
+// Perreault-Hebert constant time rank filter on one channel of output columns [x0, x0+count):
+// column histograms slide down one row at a time, the window histogram slides right one column at a time.
+static void RankStrip(openktg::texture &input, const openktg::texture &in, RankHistograms &hist, int32_t channel, int32_t x0, int32_t count, int32_t rx,
+                      int32_t ry, uint32_t rank, int32_t wrapMode)
+{
+    int32_t width = in.width();
+    int32_t height = in.height();
+    int32_t window = 2 * rx + 1;
+    int32_t columns = count + 2 * rx;
+    int32_t clampU = (wrapMode & ClampU) ? 1 : 0;
+    int32_t clampV = (wrapMode & ClampV) ? 1 : 0;
+
+    for (int32_t j = 0; j < columns; j++)
+        hist.texColumn[j] = openktg::kernels::WrapCoord(x0 - rx + j, width, clampU);
+
+    // adds (delta=1) or removes (delta=-1) a texture row to/from all column histograms
+    auto updateColumns = [&](int32_t y, int32_t delta) {
+        const openktg::core::pixel *row = &in.at(0, y);
+        uint16_t lanes[4];
+
+        for (int32_t j = 0; j < columns; j++)
+        {
+            LoadLanes(lanes, row[hist.texColumn[j]]);
+            uint16_t v = lanes[channel];
+
+            hist.colCoarse[j * 256 + (v >> 8)] += delta;
+            hist.colFine[j * 65536 + v] += delta;
+        }
+    };
+
+    for (int32_t dy = -ry; dy <= ry; dy++)
+        updateColumns(openktg::kernels::WrapCoord(dy, height, clampV), 1);
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        if (y > 0)
+        {
+            updateColumns(openktg::kernels::WrapCoord(y - ry - 1, height, clampV), -1);
+            updateColumns(openktg::kernels::WrapCoord(y + ry, height, clampV), 1);
+        }
+
+        // window histogram for the first output column
+        std::fill(hist.coarse.begin(), hist.coarse.end(), 0);
+        for (int32_t j = 0; j < window; j++)
+            for (int32_t b = 0; b < 256; b++)
+                hist.coarse[b] += hist.colCoarse[j * 256 + b];
+        std::fill(hist.fineAt.begin(), hist.fineAt.end(), -1);
+
+        for (int32_t x = 0; x < count; x++)
+        {
+            if (x > 0)
+            {
+                const uint16_t *add = &hist.colCoarse[(x + window - 1) * 256];
+                const uint16_t *sub = &hist.colCoarse[(x - 1) * 256];
+                for (int32_t b = 0; b < 256; b++)
+                    hist.coarse[b] += add[b] - sub[b];
+            }
+
+            // coarse bin holding the requested rank
+            uint32_t below = 0;
+            int32_t bin = 0;
+            while (below + hist.coarse[bin] <= rank)
+                below += hist.coarse[bin++];
+
+            // bring the fine histogram of that bin up to date
+            uint32_t *fine = &hist.fine[bin * 256];
+            int32_t at = hist.fineAt[bin];
+
+            if (at < 0 || 2 * (x - at) > window) // rebuild from the window's columns
+            {
+                std::fill_n(fine, 256, 0);
+                for (int32_t j = x; j < x + window; j++)
+                {
+                    const uint16_t *col = &hist.colFine[j * 65536 + bin * 256];
+                    for (int32_t v = 0; v < 256; v++)
+                        fine[v] += col[v];
+                }
+            }
+            else // slide it along from where it was last used
+            {
+                for (int32_t s = at + 1; s <= x; s++)
+                {
+                    const uint16_t *add = &hist.colFine[(s + window - 1) * 65536 + bin * 256];
+                    const uint16_t *sub = &hist.colFine[(s - 1) * 65536 + bin * 256];
+                    for (int32_t v = 0; v < 256; v++)
+                        fine[v] += add[v] - sub[v];
+                }
+            }
+            hist.fineAt[bin] = x;
+
+            int32_t v = 0;
+            while (below + fine[v] <= rank)
+                below += fine[v++];
+
+            // replace the channel in the output pixel
+            uint16_t lanes[4];
+            openktg::core::pixel &out = input.at(x0 + x, y);
+            LoadLanes(lanes, out);
+            lanes[channel] = static_cast<uint16_t>((bin << 8) | v);
+            out = StoreLanes(lanes);
+        }
+    }
+
+    // take the last window's rows out again, which touches far fewer bins than clearing them all
+    for (int32_t dy = -ry; dy <= ry; dy++)
+        updateColumns(openktg::kernels::WrapCoord(height - 1 + dy, height, clampV), -1);
+}
+
+// Rank filter on one channel of output rows [y0, y1) with a single window histogram, for windows too
+// wide to keep column histograms of: the window snakes right along one row and left along the next,
+// taking out and adding a column of 2*ry+1 values per step and a row of 2*rx+1 values between rows.
+static void RankRows(openktg::texture &input, const openktg::texture &in, std::vector<uint32_t> &coarse, std::vector<uint32_t> &fine, int32_t channel, int32_t y0,
+                     int32_t y1, int32_t rx, int32_t ry, uint32_t rank, int32_t wrapMode)
+{
+    int32_t width = in.width();
+    int32_t height = in.height();
+    int32_t clampU = (wrapMode & ClampU) ? 1 : 0;
+    int32_t clampV = (wrapMode & ClampV) ? 1 : 0;
+
+    // adds (delta=1) or removes (delta=-1) the pixel at (x, y), wrapped or clamped
+    auto update = [&](int32_t x, int32_t y, int32_t delta) {
+        uint16_t lanes[4];
+        LoadLanes(lanes, in.at(openktg::kernels::WrapCoord(x, width, clampU), openktg::kernels::WrapCoord(y, height, clampV)));
+        uint16_t v = lanes[channel];
+
+        coarse[v >> 8] += delta;
+        fine[v] += delta;
+    };
+    auto updateRow = [&](int32_t x, int32_t y, int32_t delta) {
+        for (int32_t dx = -rx; dx <= rx; dx++)
+            update(x + dx, y, delta);
+    };
+    auto updateColumn = [&](int32_t x, int32_t y, int32_t delta) {
+        for (int32_t dy = -ry; dy <= ry; dy++)
+            update(x, y + dy, delta);
+    };
+
+    std::fill(coarse.begin(), coarse.end(), 0);
+    std::fill(fine.begin(), fine.end(), 0);
+    for (int32_t dy = -ry; dy <= ry; dy++)
+        updateRow(0, y0 + dy, 1);
+
+    int32_t x = 0;
+    for (int32_t y = y0; y < y1; y++)
+    {
+        if (y > y0)
+        {
+            updateRow(x, y - ry - 1, -1);
+            updateRow(x, y + ry, 1);
+        }
+
+        int32_t dir = ((y - y0) & 1) ? -1 : 1;
+        for (int32_t n = 0; n < width; n++)
+        {
+            if (n > 0)
+            {
+                updateColumn(x - dir * rx, y, -1);
+                x += dir;
+                updateColumn(x + dir * rx, y, 1);
+            }
+
+            uint32_t below = 0;
+            int32_t bin = 0;
+            while (below + coarse[bin] <= rank)
+                below += coarse[bin++];
+
+            int32_t v = bin << 8;
+            while (below + fine[v] <= rank)
+                below += fine[v++];
+
+            uint16_t lanes[4];
+            openktg::core::pixel &out = input.at(x, y);
+            LoadLanes(lanes, out);
+            lanes[channel] = static_cast<uint16_t>(v);
+            out = StoreLanes(lanes);
+        }
+    }
+}
+
+void RankFilter(openktg::texture &input, const openktg::texture &inImg, float sizex, float sizey, float rank, int32_t wrapMode)
+{
+    assert(texture_size_matches(input, inImg));
+
+    static const size_t memoryBudget = size_t(64) << 20; // for column histograms of all strips in flight
+    static const size_t columnBytes = (65536 + 256) * sizeof(uint16_t);
+
+    int32_t width = input.width();
+    int32_t height = input.height();
+    int32_t rx = std::clamp(sizex, 0.0f, 1.0f) * width / 2;
+    int32_t ry = std::clamp(sizey, 0.0f, 1.0f) * height / 2;
+    assert(2 * ry + 1 <= 65535); // column histogram counts are 16 bit
+
+    uint32_t count = uint32_t(2 * rx + 1) * uint32_t(2 * ry + 1);
+    uint32_t k = std::lround(std::clamp(rank, 0.0f, 1.0f) * (count - 1));
+
+    // the source has to stay intact while the output is written
+    openktg::texture copy;
+    const openktg::texture *in = &inImg;
+    if (&input == &inImg)
+    {
+        copy = inImg;
+        in = &copy;
+    }
+
+    // windows so wide that even a narrow strip's column histograms exceed the budget slide a
+    // single window histogram instead, at a cost linear in the window height
+    int32_t maxColumns = memoryBudget / columnBytes;
+    if (2 * rx + std::min(width, 64) > maxColumns)
+    {
+        openktg::util::parallel_for(0, height, 64, [&](uint32_t begin, uint32_t end) {
+            std::vector<uint32_t> coarse(256), fine(65536);
+            for (int32_t channel = 0; channel < 4; channel++)
+                RankRows(input, *in, coarse, fine, channel, begin, end, rx, ry, k, wrapMode);
+        });
+        return;
+    }
+
+    // strips at least as wide as the window keep the per-row window setup amortized, as far as
+    // the budget allows
+    int32_t stripWidth = std::min({width, std::max(128, 2 * rx + 1), maxColumns - 2 * rx});
+    int32_t strips = (width + stripWidth - 1) / stripWidth;
+    size_t stripBytes = size_t(stripWidth + 2 * rx) * columnBytes;
+    uint32_t maxChunks = std::max<size_t>(1, memoryBudget / stripBytes);
+    uint32_t grain = (strips + maxChunks - 1) / maxChunks;
+
+    openktg::util::parallel_for(0, strips, grain, [&](uint32_t begin, uint32_t end) {
+        RankHistograms hist(stripWidth + 2 * rx);
+
+        for (int32_t strip = begin; strip < end; strip++)
+        {
+            int32_t x0 = strip * stripWidth;
+            int32_t columns = std::min(stripWidth, width - x0);
+
+            for (int32_t channel = 0; channel < 4; channel++)
+                RankStrip(input, *in, hist, channel, x0, columns, rx, ry, k, wrapMode);
+        }
+    });
+}
+
+void Median(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, int32_t wrapMode)
+{
+    RankFilter(input, in, sizex, sizey, 0.5f, wrapMode);
+}
+
+// Replaces r, g and b through one 65536 entry table each; alpha is kept
+static void ApplyColorTables(openktg::texture &input, const openktg::texture &in, const std::vector<uint16_t> (&tables)[3])
+{
+    const uint16_t *lutR = tables[0].data();
+    const uint16_t *lutG = tables[1].data();
+    const uint16_t *lutB = tables[2].data();
+    const int32_t width = in.width();
+
+    openktg::util::parallel_for(0, in.height(), 16, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t y = begin; y < end; y++)
+        {
+            const openktg::pixel *src = &in.at(0, y);
+            openktg::pixel *dst = &input.at(0, y);
+
+            for (int32_t x = 0; x < width; x++)
+            {
+                openktg::pixel p = src[x];
+                dst[x] = openktg::pixel{static_cast<openktg::red16_t>(lutR[p.r()]), static_cast<openktg::green16_t>(lutG[p.g()]),
+                                        static_cast<openktg::blue16_t>(lutB[p.b()]), static_cast<openktg::alpha16_t>(p.a())};
+                dst[x].clamp_premult();
+            }
+        }
+    });
+}
+
+void AutoLevels(openktg::texture &input, const openktg::texture &in, float clip)
+{
+    assert(texture_size_matches(input, in));
+    assert(clip >= 0.0f && clip < 0.5f);
+
+    openktg::texture_statistics stats(in);
+    const uint32_t n = stats.pixel_count();
+    const uint32_t clipCount = std::min<uint32_t>(clip * n, (n - 1) / 2);
+
+    std::vector<uint16_t> tables[3];
+    for (int32_t c = 0; c < 3; c++)
+    {
+        uint32_t lo = stats.value_at_rank(c, clipCount);
+        uint32_t hi = stats.value_at_rank(c, n - 1 - clipCount);
+        uint32_t range = std::max(hi - lo, 1u);
+
+        tables[c].resize(65536);
+        for (uint32_t v = 0; v < 65536; v++)
+        {
+            uint32_t t = std::clamp(v, lo, lo + range) - lo;
+            tables[c][v] = static_cast<uint16_t>(std::min<uint32_t>((t * 65535ull + range / 2) / range, 65535));
+        }
+    }
+
+    ApplyColorTables(input, in, tables);
+}
+
+void Equalize(openktg::texture &input, const openktg::texture &in)
+{
+    assert(texture_size_matches(input, in));
+
+    openktg::texture_statistics stats(in);
+    const uint64_t n = stats.pixel_count();
+
+    std::vector<uint16_t> tables[3];
+    for (int32_t c = 0; c < 3; c++)
+    {
+        std::span<const uint32_t> hist = stats.histogram(c);
+        const uint64_t first = hist[stats.stats(c).min]; // pixels mapped to 0
+        const uint64_t range = std::max<uint64_t>(n - first, 1);
+
+        tables[c].resize(65536);
+        uint64_t cdf = 0;
+        for (uint32_t v = 0; v < 65536; v++)
+        {
+            cdf += hist[v];
+            uint64_t t = cdf > first ? cdf - first : 0;
+            tables[c][v] = static_cast<uint16_t>((t * 65535 + range / 2) / range);
+        }
+    }
+
+    ApplyColorTables(input, in, tables);
+}
+
+// Resampling filter kernels, support radius in source pixels at scale 1
+static auto ResampleRadius(ResampleFilter filter) -> float
+{
+    return filter == ResampleLanczos3 ? 3.0f : 2.0f;
+}
+
+static auto ResampleKernel(ResampleFilter filter, float x) -> float
+{
+    x = std::abs(x);
+
+    if (filter == ResampleLanczos3)
+    {
+        if (x < 1e-6f)
+            return 1.0f;
+        if (x >= 3.0f)
+            return 0.0f;
+
+        const float pi = 3.14159265358979f;
+        return 3.0f * std::sin(pi * x) * std::sin(pi * x / 3.0f) / (pi * pi * x * x);
+    }
+
+    // Mitchell-Netravali, B = C = 1/3
+    if (x < 1.0f)
+        return (7.0f * x * x * x - 12.0f * x * x + 16.0f / 3.0f) / 6.0f;
+    if (x < 2.0f)
+        return (-7.0f / 3.0f * x * x * x + 12.0f * x * x - 20.0f * x + 32.0f / 3.0f) / 6.0f;
+    return 0.0f;
+}
+
+// Source indices and normalized weights of every output sample along one axis;
+// all samples have the same tap count (padded with zero weights)
+struct ResampleTaps
+{
+    int32_t taps;
+    std::vector<int32_t> index;
+    std::vector<float> weight;
+};
+
+static auto ComputeResampleTaps(int32_t srcSize, int32_t dstSize, ResampleFilter filter, bool clamp) -> ResampleTaps
+{
+    const float scale = float(srcSize) / dstSize;
+    const float stretch = std::max(scale, 1.0f); // widen kernel when minifying
+    const float support = ResampleRadius(filter) * stretch;
+
+    ResampleTaps t;
+    t.taps = int32_t(std::ceil(2.0f * support)) + 1;
+    t.index.resize(dstSize * t.taps);
+    t.weight.resize(dstSize * t.taps);
+
+    for (int32_t i = 0; i < dstSize; i++)
+    {
+        const float center = (i + 0.5f) * scale - 0.5f;
+        const int32_t first = int32_t(std::floor(center - support)) + 1;
+        int32_t *index = &t.index[i * t.taps];
+        float *weight = &t.weight[i * t.taps];
+
+        float sum = 0.0f;
+        for (int32_t k = 0; k < t.taps; k++)
+        {
+            weight[k] = ResampleKernel(filter, (first + k - center) / stretch);
+            index[k] = openktg::kernels::WrapCoord(first + k, srcSize, clamp ? 1 : 0);
+            sum += weight[k];
+        }
+
+        for (int32_t k = 0; k < t.taps; k++)
+            weight[k] /= sum;
+    }
+
+    return t;
+}
+
+void Resample(openktg::texture *outputs, int32_t nOutputs, const openktg::texture &in, ResampleFilter filter, int32_t wrapMode)
+{
+    const int32_t srcW = in.width();
+    const int32_t srcH = in.height();
+
+    for (int32_t o = 0; o < nOutputs; o++)
+    {
+        assert(&outputs[o] != &in);
+
+        // outputs of the same width share one horizontal pass
+        bool done = false;
+        for (int32_t p = 0; p < o; p++)
+            done |= outputs[p].width() == outputs[o].width();
+        if (done)
+            continue;
+
+        // horizontal pass: srcH rows of dstW float pixels
+        const int32_t dstW = outputs[o].width();
+        const ResampleTaps tx = ComputeResampleTaps(srcW, dstW, filter, wrapMode & ClampU);
+        std::vector<float> rows(size_t(srcH) * dstW * 4);
+
+        openktg::util::parallel_for(0, srcH, 16, [&](uint32_t begin, uint32_t end) {
+            std::vector<float> line(srcW * 4);
+
+            for (uint32_t y = begin; y < end; y++)
+            {
+                const openktg::core::pixel *src = &in.at(0, y);
+                for (int32_t x = 0; x < srcW; x++)
+                {
+                    line[x * 4 + 0] = src[x].r();
+                    line[x * 4 + 1] = src[x].g();
+                    line[x * 4 + 2] = src[x].b();
+                    line[x * 4 + 3] = src[x].a();
+                }
+
+                float *dst = &rows[size_t(y) * dstW * 4];
+                for (int32_t x = 0; x < dstW; x++)
+                {
+                    const int32_t *index = &tx.index[x * tx.taps];
+                    const float *weight = &tx.weight[x * tx.taps];
+                    float acc[4] = {};
+
+                    for (int32_t k = 0; k < tx.taps; k++)
+                        for (int32_t c = 0; c < 4; c++)
+                            acc[c] += weight[k] * line[index[k] * 4 + c];
+
+                    std::copy_n(acc, 4, &dst[x * 4]);
+                }
+            }
+        });
+
+        // vertical passes for every output of this width
+        for (int32_t p = o; p < nOutputs; p++)
+        {
+            openktg::texture &out = outputs[p];
+            if (out.width() != uint32_t(dstW))
+                continue;
+
+            const int32_t dstH = out.height();
+            const ResampleTaps ty = ComputeResampleTaps(srcH, dstH, filter, wrapMode & ClampV);
+
+            openktg::util::parallel_for(0, dstH, 16, [&](uint32_t begin, uint32_t end) {
+                std::vector<float> acc(dstW * 4);
+
+                for (uint32_t y = begin; y < end; y++)
+                {
+                    const int32_t *index = &ty.index[y * ty.taps];
+                    const float *weight = &ty.weight[y * ty.taps];
+
+                    std::fill(acc.begin(), acc.end(), 0.0f);
+                    for (int32_t k = 0; k < ty.taps; k++)
+                    {
+                        const float *src = &rows[size_t(index[k]) * dstW * 4];
+                        const float w = weight[k];
+                        for (int32_t i = 0; i < dstW * 4; i++)
+                            acc[i] += w * src[i];
+                    }
+
+                    openktg::core::pixel *dst = &out.at(0, y);
+                    for (int32_t x = 0; x < dstW; x++)
+                    {
+                        const float *a = &acc[x * 4];
+                        dst[x] = openktg::core::pixel{static_cast<openktg::red16_t>(std::clamp(std::lround(a[0]), 0l, 65535l)),
+                                                      static_cast<openktg::green16_t>(std::clamp(std::lround(a[1]), 0l, 65535l)),
+                                                      static_cast<openktg::blue16_t>(std::clamp(std::lround(a[2]), 0l, 65535l)),
+                                                      static_cast<openktg::alpha16_t>(std::clamp(std::lround(a[3]), 0l, 65535l))};
+                        dst[x].clamp_premult(); // negative lobes can push colors above alpha
+                    }
+                }
+            });
+        }
+    }
+}
+
+// Downsampled (x, y, luminance) grid of homogeneous colors (r, g, b, a, weight)
+struct BilateralGrid
+{
+    int32_t w, h, d; // nodes along x, y and luminance
+    std::vector<float> data;
+
+    BilateralGrid(int32_t w, int32_t h, int32_t d) : w(w), h(h), d(d), data(size_t(w) * h * d * 5)
+    {
+    }
+
+    auto at(int32_t x, int32_t y, int32_t z) -> float *
+    {
+        return &data[((size_t(y) * w + x) * d + z) * 5];
+    }
+};
+
+static auto BilateralLuminance(const openktg::core::pixel &p) -> int32_t
+{
+    return (p.r() * 19595u + p.g() * 38470u + p.b() * 7471u) >> 16;
+}
+
+// Blurs the n nodes of one grid line (stride floats apart) with a [1 4 6 4 1]/16 kernel
+static void BlurGridLine(float *line, int32_t n, size_t stride, bool clamp, float *tmp)
+{
+    static const float kernel[5] = {1.0f / 16, 4.0f / 16, 6.0f / 16, 4.0f / 16, 1.0f / 16};
+
+    for (int32_t i = 0; i < n; i++)
+        std::copy_n(line + i * stride, 5, tmp + i * 5);
+
+    for (int32_t i = 0; i < n; i++)
+    {
+        float acc[5] = {};
+        for (int32_t k = -2; k <= 2; k++)
+        {
+            int32_t j = clamp ? std::clamp(i + k, 0, n - 1) : ((i + k) % n + n) % n;
+            for (int32_t c = 0; c < 5; c++)
+                acc[c] += kernel[k + 2] * tmp[j * 5 + c];
+        }
+        std::copy_n(acc, 5, line + i * stride);
+    }
+}
+
+void BilateralSmooth(openktg::texture &input, const openktg::texture &in, float sizex, float sizey, float range, int32_t wrapMode)
+{
+    assert(texture_size_matches(input, in));
+    assert(range > 0.0f);
+
+    const int32_t width = in.width();
+    const int32_t height = in.height();
+    const bool clampX = wrapMode & ClampU;
+    const bool clampY = wrapMode & ClampV;
+
+    // power of two cells, so wrapped grids tile exactly
+    const int32_t shiftX = openktg::util::floor_log_2(std::clamp<int32_t>(std::clamp(sizex, 0.0f, 1.0f) * width / 2, 1, width));
+    const int32_t shiftY = openktg::util::floor_log_2(std::clamp<int32_t>(std::clamp(sizey, 0.0f, 1.0f) * height / 2, 1, height));
+    const int32_t cellX = 1 << shiftX, cellY = 1 << shiftY;
+    const float zScale = 1.0f / (std::min(range, 1.0f) * 65535.0f);
+
+    BilateralGrid grid((width >> shiftX) + clampX, (height >> shiftY) + clampY, int32_t(65535 * zScale) + 2);
+
+    // splat: every pixel goes to its nearest node; slabs of grid rows in parallel
+    openktg::util::parallel_for(0, grid.h, 1, [&](uint32_t begin, uint32_t end) {
+        for (int32_t gy = begin; gy < int32_t(end); gy++)
+        {
+            for (int32_t y = gy * cellY - cellY / 2; y < gy * cellY - cellY / 2 + cellY; y++)
+            {
+                if (clampY && (y < 0 || y >= height))
+                    continue;
+
+                const openktg::core::pixel *src = &in.at(0, y & (height - 1));
+                for (int32_t x = 0; x < width; x++)
+                {
+                    int32_t gx = (x + cellX / 2) >> shiftX;
+                    float *node = grid.at(clampX ? gx : gx & (grid.w - 1), gy, int32_t(BilateralLuminance(src[x]) * zScale + 0.5f));
+
+                    node[0] += src[x].r();
+                    node[1] += src[x].g();
+                    node[2] += src[x].b();
+                    node[3] += src[x].a();
+                    node[4] += 1.0f;
+                }
+            }
+        }
+    });
+
+    // separable blur of the grid
+    openktg::util::parallel_for(0, grid.h, 1, [&](uint32_t begin, uint32_t end) {
+        std::vector<float> tmp(std::max(grid.w, grid.d) * 5);
+        for (int32_t gy = begin; gy < int32_t(end); gy++)
+        {
+            for (int32_t gx = 0; gx < grid.w; gx++)
+                BlurGridLine(grid.at(gx, gy, 0), grid.d, 5, true, tmp.data());
+            for (int32_t gz = 0; gz < grid.d; gz++)
+                BlurGridLine(grid.at(0, gy, gz), grid.w, size_t(grid.d) * 5, clampX, tmp.data());
+        }
+    });
+
+    openktg::util::parallel_for(0, grid.w, 1, [&](uint32_t begin, uint32_t end) {
+        std::vector<float> tmp(grid.h * 5);
+        for (int32_t gx = begin; gx < int32_t(end); gx++)
+            for (int32_t gz = 0; gz < grid.d; gz++)
+                BlurGridLine(grid.at(gx, 0, gz), grid.h, size_t(grid.w) * grid.d * 5, clampY, tmp.data());
+    });
+
+    // slice: trilinear interpolation at every pixel
+    openktg::util::parallel_for(0, height, 16, [&](uint32_t begin, uint32_t end) {
+        std::vector<openktg::core::pixel> row(width);
+
+        for (int32_t y = begin; y < int32_t(end); y++)
+        {
+            const int32_t gy0 = y >> shiftY;
+            const int32_t gy1 = clampY ? std::min(gy0 + 1, grid.h - 1) : (gy0 + 1) & (grid.h - 1);
+            const float fy = float(y & (cellY - 1)) / cellY;
+            const openktg::core::pixel *src = &in.at(0, y);
+
+            for (int32_t x = 0; x < width; x++)
+            {
+                const int32_t gx0 = x >> shiftX;
+                const int32_t gx1 = clampX ? std::min(gx0 + 1, grid.w - 1) : (gx0 + 1) & (grid.w - 1);
+                const float fx = float(x & (cellX - 1)) / cellX;
+
+                const float z = BilateralLuminance(src[x]) * zScale;
+                const int32_t gz0 = int32_t(z);
+                const int32_t gz1 = std::min(gz0 + 1, grid.d - 1);
+                const float fz = z - gz0;
+
+                float acc[5] = {};
+                const int32_t gxs[2] = {gx0, gx1}, gys[2] = {gy0, gy1}, gzs[2] = {gz0, gz1};
+                const float wx[2] = {1.0f - fx, fx}, wy[2] = {1.0f - fy, fy}, wz[2] = {1.0f - fz, fz};
+
+                for (int32_t j = 0; j < 2; j++)
+                    for (int32_t i = 0; i < 2; i++)
+                        for (int32_t k = 0; k < 2; k++)
+                        {
+                            const float *node = grid.at(gxs[i], gys[j], gzs[k]);
+                            const float w = wx[i] * wy[j] * wz[k];
+                            for (int32_t c = 0; c < 5; c++)
+                                acc[c] += w * node[c];
+                        }
+
+                const float inv = 1.0f / acc[4];
+                row[x] = openktg::core::pixel{static_cast<openktg::red16_t>(std::clamp<int32_t>(acc[0] * inv + 0.5f, 0, 65535)),
+                                              static_cast<openktg::green16_t>(std::clamp<int32_t>(acc[1] * inv + 0.5f, 0, 65535)),
+                                              static_cast<openktg::blue16_t>(std::clamp<int32_t>(acc[2] * inv + 0.5f, 0, 65535)),
+                                              static_cast<openktg::alpha16_t>(std::clamp<int32_t>(acc[3] * inv + 0.5f, 0, 65535))};
+                row[x].clamp_premult();
+            }
+
+            std::copy(row.begin(), row.end(), &input.at(0, y));
+        }
+    });
+}
@@ -7,66 +7,12 @@
 #include <openktg/tex/sampling.h>
 #include <openktg/util/utility.h>
 
+#include "kernels.h"
+
 void Noise(openktg::texture &input, const openktg::texture &grad, int32_t freqX, int32_t freqY, int32_t oct, float fadeoff, int32_t seed, int32_t mode)
 {
-    assert(oct > 0);
-
-    seed = PerlinNoise::P(seed);
-
-    int32_t offset;
-    float scaling;
-
-    if (mode & NoiseNormalize)
-        scaling = (fadeoff - 1.0f) / (std::pow(fadeoff, oct) - 1.0f);
-    else
-        scaling = std::min(1.0f, 1.0f / fadeoff);
-
-    if (mode & NoiseAbs) // absolute mode
-    {
-        offset = 0;
-        scaling *= (1 << 24);
-    }
-    else
-    {
-        offset = 1 << 23;
-        scaling *= (1 << 23);
-    }
-
-    int32_t offsX = (1 << (16 - input.shift_x() + freqX)) >> 1;
-    int32_t offsY = (1 << (16 - input.shift_y() + freqY)) >> 1;
-
-    openktg::pixel *out = input.data();
-    for (int32_t y = 0; y < input.height(); y++)
-    {
-        for (int32_t x = 0; x < input.width(); x++)
-        {
-            int32_t n = offset;
-            float s = scaling;
-
-            int32_t px = (x << (16 - input.shift_x() + freqX)) + offsX;
-            int32_t py = (y << (16 - input.shift_y() + freqY)) + offsY;
-            int32_t mx = (1 << freqX) - 1;
-            int32_t my = (1 << freqY) - 1;
-
-            for (int32_t i = 0; i < oct; i++)
-            {
-                float nv = (mode & NoiseBandlimit) ? PerlinNoise::Noise2(px, py, mx, my, seed) : PerlinNoise::GNoise2(px, py, mx, my, seed);
-                if (mode & NoiseAbs)
-                    nv = std::fabs(nv);
-
-                n += nv * s;
-                s *= fadeoff;
-
-                px += px;
-                py += py;
-                mx += mx + 1;
-                my += my + 1;
-            }
-
-            SampleGradient(grad, *out, n);
-            out++;
-        }
-    }
+    const openktg::kernels::NoiseSetup setup = openktg::kernels::SetupNoise(input, freqX, freqY, oct, fadeoff, seed, mode);
+    openktg::kernels::NoisePixels(setup, grad, input.data(), input.width(), 0, 0, input.width() - 1, input.height() - 1);
 }
 
 void GlowRect(openktg::texture &input, const openktg::texture &bgTex, const openktg::texture &grad, float orgx, float orgy, float ux, float uy, float vx,
@@ -80,73 +26,8 @@ void GlowRect(openktg::texture &input, const openktg::texture &bgTex, const open
         input = bgTex;
     }
 
-    // calculate bounding rect
-    int32_t minX = std::max<int32_t>(0, floor((orgx - std::fabs(ux) - std::fabs(vx)) * input.width()));
-    int32_t minY = std::max<int32_t>(0, floor((orgy - std::fabs(uy) - std::fabs(vy)) * input.height()));
-    int32_t maxX = std::min<int32_t>(input.width() - 1, ceil((orgx + std::fabs(ux) + std::fabs(vx)) * input.width()));
-    int32_t maxY = std::min<int32_t>(input.height() - 1, ceil((orgy + std::fabs(uy) + std::fabs(vy)) * input.height()));
-
-    // solve for u0,v0 and deltas (cramer's rule)
-    float detM = ux * vy - uy * vx;
-    if (std::fabs(detM) * input.width() * input.height() < 0.25f) // smaller than a pixel? skip it.
-        return;
-
-    float invM = (1 << 16) / detM;
-    float rmx = (minX + 0.5f) / input.width() - orgx;
-    float rmy = (minY + 0.5f) / input.height() - orgy;
-    int32_t u0 = (rmx * vy - rmy * vx) * invM;
-    int32_t v0 = (ux * rmy - uy * rmx) * invM;
-    int32_t dudx = vy * invM / input.width();
-    int32_t dvdx = -uy * invM / input.width();
-    int32_t dudy = -vx * invM / input.height();
-    int32_t dvdy = ux * invM / input.height();
-    int32_t ruf = std::min<int32_t>(rectu * 65536.0f, 65535);
-    int32_t rvf = std::min<int32_t>(rectv * 65536.0f, 65535);
-    float gus = 1.0f / (65536.0f - ruf);
-    float gvs = 1.0f / (65536.0f - rvf);
-
-    for (int32_t y = minY; y <= maxY; y++)
-    {
-        openktg::pixel *out = &input.at(minX, y); // input.Data[y * input.width() + minX];
-        int32_t u = u0;
-        int32_t v = v0;
-
-        for (int32_t x = minX; x <= maxX; x++)
-        {
-            if (u > -65536 && u < 65536 && v > -65536 && v < 65536)
-            {
-                openktg::pixel col;
-
-                int32_t du = std::max(std::abs(u) - ruf, 0);
-                int32_t dv = std::max(std::abs(v) - rvf, 0);
-
-                if (!du && !dv)
-                {
-                    SampleGradient(grad, col, 0);
-                    *out = compositeROver(*out, col);
-                }
-                else
-                {
-                    float dus = du * gus;
-                    float dvs = dv * gvs;
-                    float dist = dus * dus + dvs * dvs;
-
-                    if (dist < 1.0f)
-                    {
-                        SampleGradient(grad, col, (1 << 24) * std::sqrt(dist));
-                        *out = compositeROver(*out, col);
-                    }
-                }
-            }
-
-            u += dudx;
-            v += dvdx;
-            out++;
-        }
-
-        u0 += dudy;
-        v0 += dvdy;
-    }
+    const openktg::kernels::GlowSetup setup = openktg::kernels::SetupGlow(input, orgx, orgy, ux, uy, vx, vy, rectu, rectv);
+    openktg::kernels::GlowPixels(setup, grad, input.data(), input.width(), 0, 0, input.width() - 1, input.height() - 1);
 }
 
 struct CellPoint
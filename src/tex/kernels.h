@@ -0,0 +1,1355 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include <openktg/core/matrix.h>
+#include <openktg/core/pixel.h>
+#include <openktg/core/texture.h>
+#include <openktg/noise/perlin.h>
+#include <openktg/tex/composite.h>
+#include <openktg/tex/filters.h>
+#include <openktg/tex/generators.h>
+#include <openktg/tex/sampling.h>
+#include <openktg/util/macro.h>
+#include <openktg/util/utility.h>
+
+// Per-pixel kernels shared between operators. Keeping a single copy of each
+// makes fused operators produce exactly the same bits as the operator chains
+// they replace.
+namespace openktg::kernels
+{
+
+/****************************************************************************/
+/***   Sampling                                                           ***/
+/****************************************************************************/
+
+// Size of a texture, for setups that do not need its pixels
+struct Extent
+{
+    int32_t width, height;
+    int32_t shiftX, shiftY; // log2 of the size
+
+    Extent(const texture &tex) : width(tex.width()), height(tex.height()), shiftX(tex.shift_x()), shiftY(tex.shift_y())
+    {
+    }
+    Extent(int32_t width, int32_t height) : width(width), height(height), shiftX(std::countr_zero(uint32_t(width))), shiftY(std::countr_zero(uint32_t(height)))
+    {
+    }
+};
+
+// Window onto a texture that repeats with the texture size: pixel (x, y), for any
+// integer x and y, sits at ((x - x0) mod texture width, (y - y0) mod texture height)
+// in the window. A whole texture is the window at (0, 0).
+struct Region
+{
+    const pixel *data = nullptr;    // pixel (x0, y0)
+    int32_t stride = 0;             // pixels per window row
+    int32_t x0 = 0, y0 = 0;         // window origin
+    int32_t width = 0, height = 0;  // window size
+    int32_t shiftX = 0, shiftY = 0; // log2 of the texture size
+
+    Region() = default;
+    Region(const texture &tex)
+        : data(tex.data()), stride(tex.width()), x0(0), y0(0), width(tex.width()), height(tex.height()), shiftX(tex.shift_x()), shiftY(tex.shift_y())
+    {
+    }
+    Region(const pixel *data, int32_t stride, int32_t x0, int32_t y0, int32_t width, int32_t height, int32_t shiftX, int32_t shiftY)
+        : data(data), stride(stride), x0(x0), y0(y0), width(width), height(height), shiftX(shiftX), shiftY(shiftY)
+    {
+    }
+
+    [[nodiscard]] auto at(int32_t x, int32_t y) const -> const pixel &
+    {
+        int32_t ox = (x - x0) & ((1 << shiftX) - 1);
+        int32_t oy = (y - y0) & ((1 << shiftY) - 1);
+        assert(ox < width && oy < height);
+        return data[oy * stride + ox];
+    }
+
+    // n pixels starting at (x, y); they must not wrap around the window edge
+    [[nodiscard]] auto row(int32_t x, int32_t y, [[maybe_unused]] int32_t n) const -> const pixel *
+    {
+        const pixel *p = &at(x, y);
+        assert(((x - x0) & ((1 << shiftX) - 1)) + n <= width);
+        return p;
+    }
+};
+
+// SampleFiltered reading from a region instead of a texture
+inline void SampleRegion(const Region &in, pixel &result, int32_t x, int32_t y, int32_t filterMode)
+{
+    const int32_t minX = 1 << (23 - in.shiftX);
+    const int32_t minY = 1 << (23 - in.shiftY);
+
+    if (filterMode & ClampU)
+        x = std::clamp<int32_t>(x, minX, 0x1000000 - minX);
+    if (filterMode & ClampV)
+        y = std::clamp<int32_t>(y, minY, 0x1000000 - minY);
+
+    if (filterMode & FilterBilinear)
+    {
+        x = (x - minX) & 0xffffff;
+        y = (y - minY) & 0xffffff;
+
+        int32_t x0 = x >> (24 - in.shiftX);
+        int32_t y0 = y >> (24 - in.shiftY);
+        int32_t fx = static_cast<uint32_t>(x << (in.shiftX + 8)) >> 16;
+        int32_t fy = static_cast<uint32_t>(y << (in.shiftY + 8)) >> 16;
+
+        pixel t0 = lerp(in.at(x0, y0), in.at(x0 + 1, y0), fx);
+        pixel t1 = lerp(in.at(x0, y0 + 1), in.at(x0 + 1, y0 + 1), fx);
+        result = lerp(t0, t1, fy);
+    }
+    else
+        result = in.at((x & 0xffffff) >> (24 - in.shiftX), (y & 0xffffff) >> (24 - in.shiftY));
+}
+
+// Texel(s) and bilinear weight a sampler picks along one axis
+struct AxisTap
+{
+    int32_t i0, i1; // texels
+    int32_t f;      // weight of i1 (0..65535)
+};
+
+// Taps for coordinates c0 + i*step (1.7.24 fixed point), mirroring SampleNearest/SampleBilinear
+inline void ComputeAxisTaps(std::vector<AxisTap> &taps, int32_t c0, int32_t step, int32_t count, int32_t size, int32_t shift, int32_t minC, bool clamp,
+                            bool bilinear)
+{
+    taps.resize(count);
+
+    for (int32_t i = 0; i < count; i++)
+    {
+        int32_t c = static_cast<int32_t>(static_cast<uint32_t>(c0) + static_cast<uint32_t>(i) * static_cast<uint32_t>(step));
+        if (clamp)
+            c = std::clamp<int32_t>(c, minC, 0x1000000 - minC);
+
+        if (bilinear)
+        {
+            c = (c - minC) & 0xffffff;
+            taps[i].i0 = c >> (24 - shift);
+            taps[i].i1 = (taps[i].i0 + 1) & (size - 1);
+            taps[i].f = static_cast<uint32_t>(c << (shift + 8)) >> 16;
+        }
+        else
+        {
+            c &= 0xffffff;
+            taps[i].i0 = taps[i].i1 = c >> (24 - shift);
+            taps[i].f = 0;
+        }
+    }
+}
+
+/****************************************************************************/
+/***   Generators                                                         ***/
+/****************************************************************************/
+
+// Noise parameters derived from the texture size
+struct NoiseSetup
+{
+    int32_t shiftX, shiftY; // log2 of the texture size
+    int32_t freqX, freqY, oct;
+    float fadeoff;
+    int32_t seed, mode;
+    int32_t offset;       // noise value of zero
+    float scaling;        // amplitude of the first octave
+    int32_t offsX, offsY; // half a pixel in noise coordinates
+};
+
+inline auto SetupNoise(const Extent &target, int32_t freqX, int32_t freqY, int32_t oct, float fadeoff, int32_t seed, int32_t mode) -> NoiseSetup
+{
+    assert(oct > 0);
+
+    NoiseSetup s;
+    s.shiftX = target.shiftX;
+    s.shiftY = target.shiftY;
+    s.freqX = freqX;
+    s.freqY = freqY;
+    s.oct = oct;
+    s.fadeoff = fadeoff;
+    s.seed = PerlinNoise::P(seed);
+    s.mode = mode;
+
+    if (mode & NoiseNormalize)
+        s.scaling = (fadeoff - 1.0f) / (std::pow(fadeoff, oct) - 1.0f);
+    else
+        s.scaling = std::min(1.0f, 1.0f / fadeoff);
+
+    if (mode & NoiseAbs) // absolute mode
+    {
+        s.offset = 0;
+        s.scaling *= (1 << 24);
+    }
+    else
+    {
+        s.offset = 1 << 23;
+        s.scaling *= (1 << 23);
+    }
+
+    s.offsX = (1 << (16 - s.shiftX + freqX)) >> 1;
+    s.offsY = (1 << (16 - s.shiftY + freqY)) >> 1;
+
+    return s;
+}
+
+// Noise of the pixels [x0,x1] x [y0,y1]; dst is pixel (x0, y0), rows stride pixels apart
+inline void NoisePixels(const NoiseSetup &s, const texture &grad, pixel *dst, int32_t stride, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    for (int32_t y = y0; y <= y1; y++)
+    {
+        pixel *out = dst + (y - y0) * stride;
+        for (int32_t x = x0; x <= x1; x++)
+        {
+            int32_t n = s.offset;
+            float sc = s.scaling;
+
+            int32_t px = (x << (16 - s.shiftX + s.freqX)) + s.offsX;
+            int32_t py = (y << (16 - s.shiftY + s.freqY)) + s.offsY;
+            int32_t mx = (1 << s.freqX) - 1;
+            int32_t my = (1 << s.freqY) - 1;
+
+            for (int32_t i = 0; i < s.oct; i++)
+            {
+                float nv = (s.mode & NoiseBandlimit) ? PerlinNoise::Noise2(px, py, mx, my, s.seed) : PerlinNoise::GNoise2(px, py, mx, my, s.seed);
+                if (s.mode & NoiseAbs)
+                    nv = std::fabs(nv);
+
+                n += nv * sc;
+                sc *= s.fadeoff;
+
+                px += px;
+                py += py;
+                mx += mx + 1;
+                my += my + 1;
+            }
+
+            SampleGradient(grad, *out, n);
+            out++;
+        }
+    }
+}
+
+// GlowRect placement in the destination
+struct GlowSetup
+{
+    int32_t minX, minY, maxX, maxY; // affected pixels (empty if maxX < minX)
+    int32_t u0, v0;                 // rect coordinates at (minX, minY), 16.16 fixed point
+    int32_t dudx, dvdx, dudy, dvdy; // rect coordinate steps per pixel
+    int32_t ruf, rvf;               // inner rect size
+    float gus, gvs;                 // glow falloff scales
+};
+
+inline auto SetupGlow(const Extent &target, float orgx, float orgy, float ux, float uy, float vx, float vy, float rectu, float rectv) -> GlowSetup
+{
+    GlowSetup s;
+
+    // calculate bounding rect
+    s.minX = std::max<int32_t>(0, floor((orgx - std::fabs(ux) - std::fabs(vx)) * target.width));
+    s.minY = std::max<int32_t>(0, floor((orgy - std::fabs(uy) - std::fabs(vy)) * target.height));
+    s.maxX = std::min<int32_t>(target.width - 1, ceil((orgx + std::fabs(ux) + std::fabs(vx)) * target.width));
+    s.maxY = std::min<int32_t>(target.height - 1, ceil((orgy + std::fabs(uy) + std::fabs(vy)) * target.height));
+
+    // solve for u0,v0 and deltas (cramer's rule)
+    float detM = ux * vy - uy * vx;
+    if (std::fabs(detM) * target.width * target.height < 0.25f) // smaller than a pixel? skip it.
+    {
+        s = GlowSetup{};
+        s.maxX = s.maxY = -1;
+        return s;
+    }
+
+    float invM = (1 << 16) / detM;
+    float rmx = (s.minX + 0.5f) / target.width - orgx;
+    float rmy = (s.minY + 0.5f) / target.height - orgy;
+    s.u0 = (rmx * vy - rmy * vx) * invM;
+    s.v0 = (ux * rmy - uy * rmx) * invM;
+    s.dudx = vy * invM / target.width;
+    s.dvdx = -uy * invM / target.width;
+    s.dudy = -vx * invM / target.height;
+    s.dvdy = ux * invM / target.height;
+    s.ruf = std::min<int32_t>(rectu * 65536.0f, 65535);
+    s.rvf = std::min<int32_t>(rectv * 65536.0f, 65535);
+    s.gus = 1.0f / (65536.0f - s.ruf);
+    s.gvs = 1.0f / (65536.0f - s.rvf);
+
+    return s;
+}
+
+// base + i * step with the wraparound of i repeated additions
+OKTG(always_inline) auto FixedStep(int32_t base, int32_t i, int32_t step) -> int32_t
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(base) + static_cast<uint32_t>(i) * static_cast<uint32_t>(step));
+}
+
+// Glows over the background already in the pixels [x0,x1] x [y0,y1]; dst is pixel (x0, y0), rows stride pixels apart
+inline void GlowPixels(const GlowSetup &s, const texture &grad, pixel *dst, int32_t stride, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    const int32_t minX = std::max(x0, s.minX), maxX = std::min(x1, s.maxX);
+    const int32_t minY = std::max(y0, s.minY), maxY = std::min(y1, s.maxY);
+
+    for (int32_t y = minY; y <= maxY; y++)
+    {
+        pixel *out = dst + (y - y0) * stride + (minX - x0);
+        int32_t u = FixedStep(FixedStep(s.u0, y - s.minY, s.dudy), minX - s.minX, s.dudx);
+        int32_t v = FixedStep(FixedStep(s.v0, y - s.minY, s.dvdy), minX - s.minX, s.dvdx);
+
+        for (int32_t x = minX; x <= maxX; x++)
+        {
+            if (u > -65536 && u < 65536 && v > -65536 && v < 65536)
+            {
+                pixel col;
+
+                int32_t du = std::max(std::abs(u) - s.ruf, 0);
+                int32_t dv = std::max(std::abs(v) - s.rvf, 0);
+
+                if (!du && !dv)
+                {
+                    SampleGradient(grad, col, 0);
+                    *out = compositeROver(*out, col);
+                }
+                else
+                {
+                    float dus = du * s.gus;
+                    float dvs = dv * s.gvs;
+                    float dist = dus * dus + dvs * dvs;
+
+                    if (dist < 1.0f)
+                    {
+                        SampleGradient(grad, col, (1 << 24) * std::sqrt(dist));
+                        *out = compositeROver(*out, col);
+                    }
+                }
+            }
+
+            u += s.dudx;
+            v += s.dvdx;
+            out++;
+        }
+    }
+}
+
+/****************************************************************************/
+/***   Combine                                                            ***/
+/****************************************************************************/
+
+// Combines in into out (as Paste does) for a compile-time operation
+template <CombineOp op> OKTG(always_inline) void CombinePixel(pixel &out, const pixel &in)
+{
+    if constexpr (op == CombineAdd)
+        out += in;
+    else if constexpr (op == CombineSub)
+        out -= in;
+    else if constexpr (op == CombineMulC)
+        out *= in;
+    else if constexpr (op == CombineMin)
+        out &= in;
+    else if constexpr (op == CombineMax)
+        out |= in;
+    else if constexpr (op == CombineSetAlpha)
+        out.set_alpha(static_cast<alpha16_t>(in.r()));
+    else if constexpr (op == CombinePreAlpha)
+    {
+        out = out * in.r();
+        out.set_alpha(static_cast<alpha16_t>(in.g()));
+    }
+    else if constexpr (op == CombineOver)
+        out = combineOver(in, out);
+    else if constexpr (op == CombineMultiply)
+        out = combineMultiply(in, out);
+    else if constexpr (op == CombineScreen)
+        out = combineScreen(in, out);
+    else if constexpr (op == CombineDarken)
+        out = combineDarken(in, out);
+    else if constexpr (op == CombineLighten)
+        out = combineLighten(in, out);
+}
+
+// Calls fn(std::integral_constant<CombineOp, op>{}), so loops can be instantiated per operation
+template <class F> OKTG(always_inline) void WithCombineOp(CombineOp op, F &&fn)
+{
+    switch (op)
+    {
+    case CombineAdd:
+        return fn(std::integral_constant<CombineOp, CombineAdd>{});
+    case CombineSub:
+        return fn(std::integral_constant<CombineOp, CombineSub>{});
+    case CombineMulC:
+        return fn(std::integral_constant<CombineOp, CombineMulC>{});
+    case CombineMin:
+        return fn(std::integral_constant<CombineOp, CombineMin>{});
+    case CombineMax:
+        return fn(std::integral_constant<CombineOp, CombineMax>{});
+    case CombineSetAlpha:
+        return fn(std::integral_constant<CombineOp, CombineSetAlpha>{});
+    case CombinePreAlpha:
+        return fn(std::integral_constant<CombineOp, CombinePreAlpha>{});
+    case CombineOver:
+        return fn(std::integral_constant<CombineOp, CombineOver>{});
+    case CombineMultiply:
+        return fn(std::integral_constant<CombineOp, CombineMultiply>{});
+    case CombineScreen:
+        return fn(std::integral_constant<CombineOp, CombineScreen>{});
+    case CombineDarken:
+        return fn(std::integral_constant<CombineOp, CombineDarken>{});
+    case CombineLighten:
+        return fn(std::integral_constant<CombineOp, CombineLighten>{});
+    }
+}
+
+OKTG(always_inline) void CombinePixel(pixel &out, const pixel &in, CombineOp op)
+{
+    WithCombineOp(op, [&](auto c) { CombinePixel<c()>(out, in); });
+}
+
+// Combines n source pixels into n destination pixels
+inline void CombineRow(pixel *out, const pixel *in, int32_t n, CombineOp op)
+{
+    WithCombineOp(op, [&](auto c) {
+        for (int32_t i = 0; i < n; i++)
+            CombinePixel<c()>(out[i], in[i]);
+    });
+}
+
+/****************************************************************************/
+/***   Color                                                              ***/
+/****************************************************************************/
+
+OKTG(always_inline) auto TernaryPixel(const pixel &in1, const pixel &in2, const pixel &in3, TernaryOp op) -> pixel
+{
+    switch (op)
+    {
+    case TernaryLerp:
+        return (~in3.r() * in1) + (in3.r() * in2);
+
+    case TernarySelect:
+        return (in3.r() >= 32768) ? in2 : in1;
+    }
+
+    return in1;
+}
+
+// 16.16 fixed point copy of a color matrix
+inline auto ColorMatrixFixed(const matrix44<float> &matrix) -> matrix44<int>
+{
+    matrix44<int> m;
+    std::transform(matrix.data.begin(), matrix.data.end(), m.data.begin(), [](const auto &fv) { return fv * 65536.0f; });
+    return m;
+}
+
+OKTG(always_inline) auto ColorMatrixPixel(const matrix44<int> &m, const pixel &in, bool clampPremult) -> pixel
+{
+    // some kind of pixel matrix multiplication
+    int32_t r = util::mul_shift_16(m(0, 0), in.r()) + util::mul_shift_16(m(0, 1), in.g()) + util::mul_shift_16(m(0, 2), in.b()) +
+                util::mul_shift_16(m(0, 3), in.a());
+    int32_t g = util::mul_shift_16(m(1, 0), in.r()) + util::mul_shift_16(m(1, 1), in.g()) + util::mul_shift_16(m(1, 2), in.b()) +
+                util::mul_shift_16(m(1, 3), in.a());
+    int32_t b = util::mul_shift_16(m(2, 0), in.r()) + util::mul_shift_16(m(2, 1), in.g()) + util::mul_shift_16(m(2, 2), in.b()) +
+                util::mul_shift_16(m(2, 3), in.a());
+    int32_t a = util::mul_shift_16(m(3, 0), in.r()) + util::mul_shift_16(m(3, 1), in.g()) + util::mul_shift_16(m(3, 2), in.b()) +
+                util::mul_shift_16(m(3, 3), in.a());
+
+    a = std::clamp<int32_t>(a, 0, 65535);
+    r = std::clamp<int32_t>(r, 0, 65535);
+    g = std::clamp<int32_t>(g, 0, 65535);
+    b = std::clamp<int32_t>(b, 0, 65535);
+
+    pixel out{static_cast<red16_t>(r), static_cast<green16_t>(g), static_cast<blue16_t>(b), static_cast<alpha16_t>(a)};
+
+    if (clampPremult)
+    {
+        out.clamp_premult();
+    }
+
+    return out;
+}
+
+// Reciprocals used to un-premultiply colors: (65535 << 16) / a for a = 1..65535
+inline constexpr auto InvAlphaTable = [] {
+    std::array<uint32_t, 65536> table{};
+    for (uint32_t a = 1; a < table.size(); a++)
+        table[a] = (65535U << 16) / a;
+    return table;
+}();
+
+// Gradient coordinate of a 16 bit channel value of a fully opaque pixel
+OKTG(always_inline) auto RemapCoord(int32_t c) -> int32_t
+{
+    return (c << 8) + ((c + 128) >> 8);
+}
+
+// Gradients of ColorRemap, with per-channel lookups for fully opaque pixels indexed by the 16 bit
+// channel value. The lookups cost as much to build as remapping 65536 pixels directly, so they are
+// only built for remaps of more pixels than that.
+struct ColorRemapTables
+{
+    const texture *mapR, *mapG, *mapB;
+    std::vector<pixel> r, g, b;
+
+    ColorRemapTables(const texture &mapR, const texture &mapG, const texture &mapB, uint64_t pixelCount) : mapR(&mapR), mapG(&mapG), mapB(&mapB)
+    {
+        if (pixelCount <= 65536)
+            return;
+
+        r.resize(65536);
+        g.resize(65536);
+        b.resize(65536);
+        for (int32_t c = 0; c < 65536; c++)
+        {
+            SampleGradient(mapR, r[c], RemapCoord(c));
+            SampleGradient(mapG, g[c], RemapCoord(c));
+            SampleGradient(mapB, b[c], RemapCoord(c));
+        }
+    }
+};
+
+inline auto ColorRemapPixel(const ColorRemapTables &tables, const pixel &in) -> pixel
+{
+    if (in.a() == 65535 && tables.r.empty()) // alpha==1, straight through the gradients
+    {
+        pixel colR, colG, colB;
+
+        SampleGradient(*tables.mapR, colR, RemapCoord(in.r()));
+        SampleGradient(*tables.mapG, colG, RemapCoord(in.g()));
+        SampleGradient(*tables.mapB, colB, RemapCoord(in.b()));
+
+        return pixel(static_cast<red16_t>(std::min(colR.r() + colG.r() + colB.r(), 65535)), static_cast<green16_t>(std::min(colR.g() + colG.g() + colB.g(), 65535)),
+                     static_cast<blue16_t>(std::min(colR.b() + colG.b() + colB.b(), 65535)), static_cast<alpha16_t>(in.a()));
+    }
+    else if (in.a() == 65535) // alpha==1, everything easy.
+    {
+        const pixel &colR = tables.r[in.r()];
+        const pixel &colG = tables.g[in.g()];
+        const pixel &colB = tables.b[in.b()];
+
+        return pixel(static_cast<red16_t>(std::min(colR.r() + colG.r() + colB.r(), 65535)), static_cast<green16_t>(std::min(colR.g() + colG.g() + colB.g(), 65535)),
+                     static_cast<blue16_t>(std::min(colR.b() + colG.b() + colB.b(), 65535)), static_cast<alpha16_t>(in.a()));
+    }
+    else if (in.a()) // alpha!=0
+    {
+        // un-premultiplied coordinates carry more than 16 bits, so these still go through the gradients
+        pixel colR, colG, colB;
+        uint32_t invA = InvAlphaTable[in.a()];
+
+        SampleGradient(*tables.mapR, colR, util::unsigned_mul_shift_8(std::min(in.r(), in.a()), invA));
+        SampleGradient(*tables.mapG, colG, util::unsigned_mul_shift_8(std::min(in.g(), in.a()), invA));
+        SampleGradient(*tables.mapB, colB, util::unsigned_mul_shift_8(std::min(in.b(), in.a()), invA));
+
+        return pixel(static_cast<red16_t>(util::mul_intens(std::min(colR.r() + colG.r() + colB.r(), 65535), in.a())),
+                     static_cast<green16_t>(util::mul_intens(std::min(colR.g() + colG.g() + colB.g(), 65535), in.a())),
+                     static_cast<blue16_t>(util::mul_intens(std::min(colR.b() + colG.b() + colB.b(), 65535), in.a())), static_cast<alpha16_t>(in.a()));
+    }
+    else // alpha==0
+        return in;
+}
+
+// sRGB <-> linear tables over unpremultiplied 16 bit values
+struct ColorSpaceTables
+{
+    std::vector<uint16_t> toLinear, toSRGB;
+
+    ColorSpaceTables() : toLinear(65536), toSRGB(65536)
+    {
+        for (int32_t v = 0; v < 65536; v++)
+        {
+            double c = v / 65535.0;
+            double lin = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            double srgb = c <= 0.0031308 ? c * 12.92 : 1.055 * std::pow(c, 1.0 / 2.4) - 0.055;
+
+            toLinear[v] = static_cast<uint16_t>(std::lround(lin * 65535.0));
+            toSRGB[v] = static_cast<uint16_t>(std::lround(srgb * 65535.0));
+        }
+    }
+
+    static auto get() -> const ColorSpaceTables &
+    {
+        static const ColorSpaceTables tables;
+        return tables;
+    }
+};
+
+// Converts the colors of n pixels through lut, un-premultiplying around the lookup; src may equal dst
+inline void ConvertColorSpace(pixel *dst, const pixel *src, int32_t n, const uint16_t *lut)
+{
+    for (int32_t i = 0; i < n; i++)
+    {
+        const pixel in = src[i];
+        const uint16_t a = in.a();
+
+        if (a == 65535)
+        {
+            dst[i] = pixel{static_cast<red16_t>(lut[in.r()]), static_cast<green16_t>(lut[in.g()]), static_cast<blue16_t>(lut[in.b()]), static_cast<alpha16_t>(a)};
+        }
+        else if (a != 0)
+        {
+            const uint32_t invA = InvAlphaTable[a];
+            auto convert = [&](uint16_t c) { return util::mul_intens(lut[std::min<uint32_t>((std::min(c, a) * invA + 32768) >> 16, 65535)], a); };
+
+            dst[i] = pixel{static_cast<red16_t>(convert(in.r())), static_cast<green16_t>(convert(in.g())), static_cast<blue16_t>(convert(in.b())),
+                           static_cast<alpha16_t>(a)};
+        }
+        else
+            dst[i] = in;
+    }
+}
+
+/****************************************************************************/
+/***   Paste                                                              ***/
+/****************************************************************************/
+
+// Placement of a Paste snippet in the destination
+struct PasteSetup
+{
+    int32_t minX, minY, maxX, maxY; // affected pixels (empty if maxX < minX)
+    int32_t u0, v0;                 // source coordinates at (minX, minY)
+    int32_t dudx, dvdx, dudy, dvdy; // source coordinate steps per pixel
+    bool aligned;                   // one source texel per pixel, sampled at texel centers
+    int32_t firstX, lastX;          // aligned: columns whose u lands inside the source
+};
+
+inline auto SetupPaste(const Extent &target, const texture &inTex, float orgx, float orgy, float ux, float uy, float vx, float vy) -> PasteSetup
+{
+    PasteSetup p;
+
+    // calculate bounding rect
+    p.minX = std::max<int32_t>(0, floor((orgx + std::min(ux, 0.0f) + std::min(vx, 0.0f)) * target.width));
+    p.minY = std::max<int32_t>(0, floor((orgy + std::min(uy, 0.0f) + std::min(vy, 0.0f)) * target.height));
+    p.maxX = std::min<int32_t>(target.width - 1, ceil((orgx + std::max(ux, 0.0f) + std::max(vx, 0.0f)) * target.width));
+    p.maxY = std::min<int32_t>(target.height - 1, ceil((orgy + std::max(uy, 0.0f) + std::max(vy, 0.0f)) * target.height));
+
+    // solve for u0,v0 and deltas (Cramer's rule)
+    float detM = ux * vy - uy * vx;
+    if (fabs(detM) * target.width * target.height < 0.25f) // smaller than a pixel? skip it.
+    {
+        p = PasteSetup{};
+        p.maxX = p.maxY = -1;
+        return p;
+    }
+
+    float invM = (1 << 24) / detM;
+    float rmx = (p.minX + 0.5f) / target.width - orgx;
+    float rmy = (p.minY + 0.5f) / target.height - orgy;
+    p.u0 = (rmx * vy - rmy * vx) * invM;
+    p.v0 = (ux * rmy - uy * rmx) * invM;
+    p.dudx = vy * invM / target.width;
+    p.dvdx = -uy * invM / target.width;
+    p.dudy = -vx * invM / target.height;
+    p.dvdy = ux * invM / target.height;
+
+    const int32_t stepU = 0x1000000 >> inTex.shift_x();
+    const int32_t stepV = 0x1000000 >> inTex.shift_y();
+    p.aligned = p.dudx == stepU && p.dvdy == stepV && p.dvdx == 0 && p.dudy == 0 && (p.u0 & (stepU - 1)) == stepU / 2 && (p.v0 & (stepV - 1)) == stepV / 2;
+    if (p.aligned)
+    {
+        p.firstX = p.minX + (p.u0 < 0 ? (-p.u0 + p.dudx - 1) / p.dudx : 0);
+        p.lastX = p.u0 <= 0xffffff ? std::min(p.maxX, p.minX + (0xffffff - p.u0) / p.dudx) : p.minX - 1;
+    }
+
+    return p;
+}
+
+// Combines the snippet into the pixels of [x0,x1] x [y0,y1] it covers; dst is pixel (x0, y0), rows stride pixels apart
+inline void PasteRect(const PasteSetup &p, pixel *dst, int32_t stride, const texture &inTex, CombineOp op, int32_t mode, int32_t x0, int32_t y0, int32_t x1,
+                      int32_t y1)
+{
+    const int32_t minY = std::max(y0, p.minY);
+    const int32_t maxY = std::min(y1, p.maxY);
+
+    // one source texel per pixel: straight row combines
+    if (p.aligned)
+    {
+        const int32_t minX = std::max(x0, p.firstX);
+        const int32_t maxX = std::min(x1, p.lastX);
+        if (minX > maxX)
+            return;
+
+        for (int32_t y = minY; y <= maxY; y++)
+        {
+            int32_t v = FixedStep(p.v0, y - p.minY, p.dvdy);
+            if (v >= 0 && v < 0x1000000)
+            {
+                int32_t tx = FixedStep(p.u0, minX - p.minX, p.dudx) >> (24 - inTex.shift_x());
+                CombineRow(dst + (y - y0) * stride + (minX - x0), &inTex.at(tx, v >> (24 - inTex.shift_y())), maxX - minX + 1, op);
+            }
+        }
+
+        return;
+    }
+
+    const int32_t minX = std::max(x0, p.minX);
+    const int32_t maxX = std::min(x1, p.maxX);
+    const int32_t filter = ClampU | ClampV | ((mode & 1) ? FilterBilinear : FilterNearest);
+
+    WithCombineOp(op, [&](auto c) {
+        for (int32_t y = minY; y <= maxY; y++)
+        {
+            pixel *out = dst + (y - y0) * stride + (minX - x0);
+            int32_t u = FixedStep(FixedStep(p.u0, y - p.minY, p.dudy), minX - p.minX, p.dudx);
+            int32_t v = FixedStep(FixedStep(p.v0, y - p.minY, p.dvdy), minX - p.minX, p.dvdx);
+
+            for (int32_t x = minX; x <= maxX; x++)
+            {
+                if (u >= 0 && u < 0x1000000 && v >= 0 && v < 0x1000000)
+                {
+                    pixel in;
+
+                    SampleFiltered(inTex, in, u, v, filter);
+                    CombinePixel<c()>(*out, in);
+                }
+
+                u += p.dudx;
+                v += p.dvdx;
+                out++;
+            }
+        }
+    });
+}
+
+// Sample coordinates of CoordMatrixTransform: pixel (x, y) samples u0 + x*dudx + y*dudy, v0 + x*dvdx + y*dvdy
+struct CoordTransformSetup
+{
+    int32_t u0, v0;
+    int32_t dudx, dudy, dvdx, dvdy;
+};
+
+inline auto SetupCoordTransform(const Extent &target, const matrix44<float> &matrix) -> CoordTransformSetup
+{
+    int32_t scaleX = 1 << (24 - target.shiftX);
+    int32_t scaleY = 1 << (24 - target.shiftY);
+
+    CoordTransformSetup s;
+    s.dudx = matrix(0, 0) * scaleX;
+    s.dudy = matrix(0, 1) * scaleY;
+    s.dvdx = matrix(1, 0) * scaleX;
+    s.dvdy = matrix(1, 1) * scaleY;
+
+    s.u0 = matrix(0, 3) * (1 << 24) + ((s.dudx + s.dudy) >> 1);
+    s.v0 = matrix(1, 3) * (1 << 24) + ((s.dvdx + s.dvdy) >> 1);
+
+    return s;
+}
+
+// CoordMatrixTransform of the pixels [x0,x1] x [y0,y1]; dst is pixel (x0, y0), rows stride pixels apart
+inline void CoordTransformPixels(const CoordTransformSetup &s, const Region &in, int32_t mode, pixel *dst, int32_t stride, int32_t x0, int32_t y0, int32_t x1,
+                                 int32_t y1)
+{
+    for (int32_t y = y0; y <= y1; y++)
+    {
+        pixel *out = dst + (y - y0) * stride;
+        int32_t u = FixedStep(FixedStep(s.u0, y, s.dudy), x0, s.dudx);
+        int32_t v = FixedStep(FixedStep(s.v0, y, s.dvdy), x0, s.dvdx);
+
+        for (int32_t x = x0; x <= x1; x++)
+        {
+            SampleRegion(in, *out, u, v, mode);
+
+            u += s.dudx;
+            v += s.dvdx;
+            out++;
+        }
+    }
+}
+
+/****************************************************************************/
+/***   Derive                                                             ***/
+/****************************************************************************/
+
+// Slope from a central difference of heights (h[x+1] - h[x-1]), summed over
+// taps with a total weight of weight
+OKTG(always_inline) auto DeriveSlope(int32_t diff, float strength, int32_t weight = 1) -> float
+{
+    return diff * strength / (2 * weight * 65535.0f);
+}
+
+OKTG(always_inline) auto DeriveGradientPixel(float dx, float dy) -> pixel
+{
+    return pixel{static_cast<red16_t>(std::clamp<int32_t>(dx * 32768.0f + 32768.0f, 0, 65535)),
+                 static_cast<green16_t>(std::clamp<int32_t>(dy * 32768.0f + 32768.0f, 0, 65535)), static_cast<blue16_t>(0), static_cast<alpha16_t>(65535)};
+}
+
+OKTG(always_inline) auto DeriveNormalPixel(float dx, float dy) -> pixel
+{
+    // (1 0 dx)^T x (0 1 dy)^T = (-dx -dy 1)
+    float scale = 32768.0f * util::rsqrt(1.0f + dx * dx + dy * dy);
+
+    return pixel{static_cast<red16_t>(std::clamp<int32_t>(-dx * scale + 32768.0f, 0, 65535)),
+                 static_cast<green16_t>(std::clamp<int32_t>(-dy * scale + 32768.0f, 0, 65535)),
+                 static_cast<blue16_t>(std::clamp<int32_t>(scale + 32768.0f, 0, 65535)), static_cast<alpha16_t>(65535)};
+}
+
+// Heights (red channel) of three consecutive rows with one wrapped column on
+// either side, so neighbours can be read without masking. Rows are loaded
+// once and rotated as the window moves down.
+class HeightWindow
+{
+  public:
+    // Window centered on row y
+    HeightWindow(const texture &height, int32_t y = 0) : HeightWindow(Region(height), 0, height.width(), y)
+    {
+    }
+
+    // Window centered on row y, columns x0..x0+n-1
+    HeightWindow(const Region &height, int32_t x0, int32_t n, int32_t y) : height_(height), x0_(x0), stride_(n + 2), buf_(3 * stride_)
+    {
+        above_ = buf_.data();
+        center_ = above_ + stride_;
+        below_ = center_ + stride_;
+
+        load(above_, y - 1);
+        load(center_, y);
+        load(below_, y + 1);
+        y_ = y;
+    }
+
+    // Advance window so that center() is row y+1
+    void advance()
+    {
+        int32_t *old = above_;
+        above_ = center_;
+        center_ = below_;
+        below_ = old;
+        y_++;
+        load(below_, y_ + 1);
+    }
+
+    // Row pointers are offset by one, so index -1 and width() are valid
+    [[nodiscard]] auto above() const -> const int32_t *
+    {
+        return above_ + 1;
+    }
+    [[nodiscard]] auto center() const -> const int32_t *
+    {
+        return center_ + 1;
+    }
+    [[nodiscard]] auto below() const -> const int32_t *
+    {
+        return below_ + 1;
+    }
+
+  private:
+    void load(int32_t *dst, int32_t y)
+    {
+        for (int32_t i = 0; i < stride_; i++)
+            dst[i] = height_.at(x0_ - 1 + i, y).r();
+    }
+
+    Region height_;
+    int32_t x0_;
+    int32_t stride_;
+    std::vector<int32_t> buf_;
+    int32_t *above_, *center_, *below_;
+    int32_t y_;
+};
+
+// Stencil differences of a row of heights: dx from neighbouring columns, dy from neighbouring rows
+inline void DeriveDifferences(int32_t *dx, int32_t *dy, const HeightWindow &window, int32_t width, DeriveStencil stencil)
+{
+    const int32_t *above = window.above();
+    const int32_t *center = window.center();
+    const int32_t *below = window.below();
+
+    switch (stencil)
+    {
+    case DeriveCentral:
+        for (int32_t x = 0; x < width; x++)
+        {
+            dx[x] = center[x + 1] - center[x - 1];
+            dy[x] = below[x] - above[x];
+        }
+        break;
+
+    case DeriveSobel:
+        for (int32_t x = 0; x < width; x++)
+        {
+            dx[x] = (above[x + 1] - above[x - 1]) + 2 * (center[x + 1] - center[x - 1]) + (below[x + 1] - below[x - 1]);
+            dy[x] = (below[x - 1] - above[x - 1]) + 2 * (below[x] - above[x]) + (below[x + 1] - above[x + 1]);
+        }
+        break;
+
+    case DeriveScharr:
+        for (int32_t x = 0; x < width; x++)
+        {
+            dx[x] = 3 * (above[x + 1] - above[x - 1]) + 10 * (center[x + 1] - center[x - 1]) + 3 * (below[x + 1] - below[x - 1]);
+            dy[x] = 3 * (below[x - 1] - above[x - 1]) + 10 * (below[x] - above[x]) + 3 * (below[x + 1] - above[x + 1]);
+        }
+        break;
+    }
+}
+
+// Derive of the pixels [x0,x1] x [y0,y1]; dst is pixel (x0, y0), rows stride pixels apart
+inline void DerivePixels(const Region &in, DeriveOp op, DeriveStencil stencil, float strength, pixel *dst, int32_t stride, int32_t x0, int32_t y0, int32_t x1, int32_t y1)
+{
+    // total tap weight of the stencil
+    const int32_t weight = stencil == DeriveScharr ? 16 : stencil == DeriveSobel ? 4 : 1;
+    const int32_t width = x1 - x0 + 1;
+
+    HeightWindow window(in, x0, width, y0);
+    std::vector<int32_t> dx(width), dy(width);
+
+    for (int32_t y = y0; y <= y1; y++)
+    {
+        DeriveDifferences(dx.data(), dy.data(), window, width, stencil);
+        pixel *out = dst + (y - y0) * stride;
+
+        if (op == DeriveNormals)
+        {
+            for (int32_t x = 0; x < width; x++)
+                out[x] = DeriveNormalPixel(DeriveSlope(dx[x], strength, weight), DeriveSlope(dy[x], strength, weight));
+        }
+        else
+        {
+            for (int32_t x = 0; x < width; x++)
+                out[x] = DeriveGradientPixel(DeriveSlope(dx[x], strength, weight), DeriveSlope(dy[x], strength, weight));
+        }
+
+        if (y < y1)
+            window.advance();
+    }
+}
+
+/****************************************************************************/
+/***   Blur                                                               ***/
+/****************************************************************************/
+
+// Wrap computation on pixel coordinates
+OKTG(always_inline) auto WrapCoord(int32_t x, int32_t width, int32_t mode) -> int32_t
+{
+    if (mode == 0) // wrap
+        return x & (width - 1);
+    else
+        return std::clamp(x, 0, width - 1);
+}
+
+// Half edge length of the Blur box in pixels, 26.6 fixed point
+OKTG(always_inline) auto BlurSizeFixed(float size, int32_t extent) -> int32_t
+{
+    return std::clamp(size, 0.0f, 1.0f) * 64 * extent / 2;
+}
+
+// One box filter pass over positions x0..x0+n-1 of a line of size pixels, which
+// src(i) returns for i in [0, size). Size is half of edge length in pixels, 26.6
+// fixed point.
+template <class Src> void BlurSpan(pixel *dst, int32_t x0, int32_t n, int32_t size, Src &&src, int32_t sizeFixed, int32_t wrapMode)
+{
+    assert(sizeFixed > 32); // kernel should be wider than one pixel
+    int32_t frac = (sizeFixed - 32) & 63;
+    int32_t offset = (sizeFixed + 32) >> 6;
+
+    assert(((offset - 1) * 64 + frac + 32) == sizeFixed);
+    uint32_t denom = sizeFixed * 2;
+    uint32_t bias = denom / 2;
+
+    // initialize accumulators: the partially covered outer pixels, then the inner part of the filter kernel
+    uint32_t accu[4];
+    const pixel &pl = src(WrapCoord(x0 - offset, size, wrapMode));
+    const pixel &pr = src(WrapCoord(x0 + offset, size, wrapMode));
+    accu[0] = frac * (pl.r() + pr.r()) + bias;
+    accu[1] = frac * (pl.g() + pr.g()) + bias;
+    accu[2] = frac * (pl.b() + pr.b()) + bias;
+    accu[3] = frac * (pl.a() + pr.a()) + bias;
+
+    for (int32_t x = x0 - offset + 1; x <= x0 + offset - 1; x++)
+    {
+        const pixel &pc = src(WrapCoord(x, size, wrapMode));
+
+        accu[0] += pc.r() << 6;
+        accu[1] += pc.g() << 6;
+        accu[2] += pc.b() << 6;
+        accu[3] += pc.a() << 6;
+    }
+
+    // generate output pixels
+    for (int32_t i = 0; i < n; i++)
+    {
+        int32_t x = x0 + i;
+
+        // write out state of accumulator
+        dst[i] = pixel(static_cast<red16_t>(accu[0] / denom), static_cast<green16_t>(accu[1] / denom), static_cast<blue16_t>(accu[2] / denom),
+                       static_cast<alpha16_t>(accu[3] / denom));
+
+        // update accumulator (not past the last position, so only src(x0 - offset)..src(x0 + n - 1 + offset) are read)
+        if (i + 1 == n)
+            break;
+
+        const pixel &l0 = src(WrapCoord(x - offset + 0, size, wrapMode));
+        const pixel &l1 = src(WrapCoord(x - offset + 1, size, wrapMode));
+        const pixel &r0 = src(WrapCoord(x + offset + 0, size, wrapMode));
+        const pixel &r1 = src(WrapCoord(x + offset + 1, size, wrapMode));
+
+        accu[0] += 64 * (r0.r() - l1.r()) + frac * (r1.r() - r0.r() - l0.r() + l1.r());
+        accu[1] += 64 * (r0.g() - l1.g()) + frac * (r1.g() - r0.g() - l0.g() + l1.g());
+        accu[2] += 64 * (r0.b() - l1.b()) + frac * (r1.b() - r0.b() - l0.b() + l1.b());
+        accu[3] += 64 * (r0.a() - l1.a()) + frac * (r1.a() - r0.a() - l0.a() + l1.a());
+    }
+}
+
+// One box filter pass over a whole line
+inline void Blur1DBuffer(pixel *dst, const pixel *src, int32_t width, int32_t sizeFixed, int32_t wrapMode)
+{
+    BlurSpan(dst, 0, width, width, [src](int32_t i) -> const pixel & { return src[i]; }, sizeFixed, wrapMode);
+}
+
+// order box filter passes producing positions p0..p1 of a line; earlier passes
+// only cover the positions later ones read. Intermediate passes ping-pong
+// between the scratch buffers.
+template <class Src>
+void BlurLine(pixel *dst, int32_t p0, int32_t p1, int32_t size, Src &&src, int32_t sizeFixed, int32_t order, int32_t wrapMode, std::vector<pixel> (&scratch)[2])
+{
+    const int32_t offset = (sizeFixed + 32) >> 6;
+    int32_t prevStart = 0;
+
+    for (int32_t k = 1; k <= order; k++)
+    {
+        // positions this pass produces
+        int32_t start = p0 - (order - k) * offset;
+        int32_t end = p1 + (order - k) * offset;
+        if (wrapMode == 0 && end - start + 1 >= size)
+            start = 0, end = size - 1;
+        else if (wrapMode != 0)
+            start = std::max(start, 0), end = std::min(end, size - 1);
+
+        std::vector<pixel> &cur = scratch[k & 1];
+        const std::vector<pixel> &prev = scratch[(k - 1) & 1];
+        pixel *out = (k == order) ? dst : (cur.resize(end - start + 1), cur.data());
+
+        if (k == 1)
+            BlurSpan(out, start, end - start + 1, size, src, sizeFixed, wrapMode);
+        else
+            BlurSpan(out, start, end - start + 1, size, [&](int32_t i) -> const pixel & { return prev[(i - prevStart) & (size - 1)]; }, sizeFixed, wrapMode);
+
+        prevStart = start;
+    }
+}
+
+// Positions p0..p1 of a line of size pixels widened by radius on either side; clamped to the
+// line, or the whole line once wrapping covers it
+inline void BlurReach(int32_t &lo, int32_t &hi, int32_t p0, int32_t p1, int32_t radius, int32_t size, int32_t clamp)
+{
+    lo = p0 - radius;
+    hi = p1 + radius;
+    if (clamp)
+        lo = std::max(lo, 0), hi = std::min(hi, size - 1);
+    else if (hi - lo + 1 >= size)
+        lo = 0, hi = size - 1;
+}
+
+// Blur (BlurSRGB with srgb) of the pixels [x0,x1] x [y0,y1]; dst is pixel (x0, y0), rows stride pixels apart.
+// sRGB pixels are decoded where the first pass loads them and encoded where the last one stores them.
+inline void BlurPixels(const Region &in, float sizex, float sizey, int32_t order, int32_t wrapMode, bool srgb, pixel *dst, int32_t stride, int32_t x0,
+                       int32_t y0, int32_t x1, int32_t y1)
+{
+    const int32_t width = 1 << in.shiftX;
+    const int32_t height = 1 << in.shiftY;
+    const int32_t sizePixX = BlurSizeFixed(sizex, width);
+    const int32_t sizePixY = BlurSizeFixed(sizey, height);
+    const int32_t clampU = (wrapMode & ClampU) ? 1 : 0;
+    const int32_t clampV = (wrapMode & ClampV) ? 1 : 0;
+    const bool blurX = order >= 1 && sizePixX > 32;
+    const bool blurY = order >= 1 && sizePixY > 32;
+    const int32_t n = x1 - x0 + 1;
+    const uint16_t *toLinear = srgb ? ColorSpaceTables::get().toLinear.data() : nullptr;
+    const uint16_t *toSRGB = srgb ? ColorSpaceTables::get().toSRGB.data() : nullptr;
+
+    // source columns and rows the passes read
+    int32_t colLo, colHi, rowLo, rowHi;
+    BlurReach(colLo, colHi, x0, x1, blurX ? order * ((sizePixX + 32) >> 6) : 0, width, clampU);
+    BlurReach(rowLo, rowHi, y0, y1, blurY ? order * ((sizePixY + 32) >> 6) : 0, height, clampV);
+
+    // horizontal passes, straight into dst unless the vertical passes still need the rows
+    std::vector<pixel> scratch[2];
+    std::vector<pixel> rows(blurY ? (rowHi - rowLo + 1) * n : 0);
+    std::vector<pixel> line(colHi - colLo + 1);
+
+    for (int32_t y = rowLo; y <= rowHi; y++)
+    {
+        pixel *out = blurY ? &rows[(y - rowLo) * n] : dst + (y - y0) * stride;
+
+        if (blurX)
+        {
+            for (int32_t i = 0; i < colHi - colLo + 1; i++)
+                line[i] = in.at(colLo + i, y);
+            if (srgb)
+                ConvertColorSpace(line.data(), line.data(), colHi - colLo + 1, toLinear);
+
+            BlurLine(out, x0, x1, width, [&](int32_t i) -> const pixel & { return line[(i - colLo) & (width - 1)]; }, sizePixX, order, clampU, scratch);
+            if (srgb && !blurY)
+                ConvertColorSpace(out, out, n, toSRGB);
+        }
+        else
+        {
+            for (int32_t i = 0; i < n; i++)
+                out[i] = in.at(x0 + i, y);
+            if (srgb && blurY)
+                ConvertColorSpace(out, out, n, toLinear);
+        }
+    }
+
+    if (!blurY)
+        return;
+
+    // vertical passes, one column at a time
+    std::vector<pixel> column(rowHi - rowLo + 1), result(y1 - y0 + 1);
+    for (int32_t x = 0; x < n; x++)
+    {
+        for (int32_t i = 0; i < rowHi - rowLo + 1; i++)
+            column[i] = rows[i * n + x];
+
+        BlurLine(result.data(), y0, y1, height, [&](int32_t i) -> const pixel & { return column[(i - rowLo) & (height - 1)]; }, sizePixY, order, clampV,
+                 scratch);
+        if (srgb)
+            ConvertColorSpace(result.data(), result.data(), y1 - y0 + 1, toSRGB);
+
+        for (int32_t y = 0; y < y1 - y0 + 1; y++)
+            dst[y * stride + x] = result[y];
+    }
+}
+
+/****************************************************************************/
+/***   Bump                                                               ***/
+/****************************************************************************/
+
+// SampleGradient through an exact lookup table for narrow gradients. The result only
+// depends on the top shift+16 bits of the edge-adjusted coordinate, so a gradient
+// of width 2^shift needs 2^(shift+16) entries; wider ones are sampled directly.
+class GradientTable
+{
+  public:
+    GradientTable() = default;
+
+    // samples: expected number of lookups, small jobs are not worth building a table
+    GradientTable(const texture *gradient, uint32_t samples) : gradient_(gradient)
+    {
+        if (!gradient_ || gradient_->shift_x() > 2 || (1u << (16 + gradient_->shift_x())) > samples)
+            return;
+
+        shift_ = gradient_->shift_x();
+        lut_.resize((1 << (16 + shift_)) - (1 << 16) + 1);
+
+        const pixel *data = gradient_->data();
+        for (uint32_t i = 0; i < lut_.size(); i++)
+        {
+            // same steps as SampleGradient
+            int32_t x = i << (8 - shift_);
+            int32_t x0 = x >> (24 - shift_);
+            int32_t x1 = (x0 + 1) & (gradient_->width() - 1);
+            int32_t fx = static_cast<uint32_t>(x << (shift_ + 8)) >> 16;
+
+            lut_[i] = lerp(data[x0], data[x1], fx);
+        }
+    }
+
+    OKTG(always_inline) auto operator()(int32_t x) const -> pixel
+    {
+        if (lut_.empty())
+        {
+            pixel result;
+            SampleGradient(*gradient_, result, x);
+            return result;
+        }
+
+        x = std::clamp(x, 0, 1 << 24);
+        x -= x >> shift_;
+        return lut_[x >> (8 - shift_)];
+    }
+
+  private:
+    const texture *gradient_ = nullptr;
+    int32_t shift_ = 0;
+    std::vector<pixel> lut_;
+};
+
+// Light setup for Bump
+struct BumpSetup
+{
+    float px, py, pz;  // light position (point lights)
+    float dx, dy, dz;  // normalized light direction
+    float L[3], H[3];  // light/halfway vector (directional lights)
+    float invX, invY;  // pixel size
+    const texture *specular;
+    const texture *falloff;
+    pixel ambient, diffuse;
+    bool directional;
+
+    int32_t width;
+    std::vector<float> lx; // per column x part of the (unnormalized) point light vector
+    GradientTable specularLut, falloffLut;
+};
+
+inline auto SetupBump(const Extent &target, const texture *specular, const texture *falloff, float px, float py, float pz, float dx, float dy, float dz,
+                      const pixel &ambient, const pixel &diffuse, bool directional) -> BumpSetup
+{
+    BumpSetup s;
+
+    float scale = util::rsqrt(dx * dx + dy * dy + dz * dz);
+    s.dx = dx * scale;
+    s.dy = dy * scale;
+    s.dz = dz * scale;
+
+    if (directional)
+    {
+        s.L[0] = -s.dx;
+        s.L[1] = -s.dy;
+        s.L[2] = -s.dz;
+
+        scale = util::rsqrt(2.0f + 2.0f * s.L[2]); // 1/sqrt((L + <0,0,1>)^2)
+        s.H[0] = s.L[0] * scale;
+        s.H[1] = s.L[1] * scale;
+        s.H[2] = (s.L[2] + 1.0f) * scale;
+    }
+
+    s.px = px;
+    s.py = py;
+    s.pz = pz;
+    s.invX = 1.0f / target.width;
+    s.invY = 1.0f / target.height;
+    s.specular = specular;
+    s.falloff = falloff;
+    s.ambient = ambient;
+    s.diffuse = diffuse;
+    s.directional = directional;
+
+    s.width = target.width;
+    if (!directional)
+    {
+        s.lx.resize(s.width);
+        for (int32_t x = 0; x < s.width; x++)
+            s.lx[x] = s.px - (x + 0.5f) * s.invX;
+    }
+
+    s.specularLut = GradientTable(specular, target.width * target.height);
+    s.falloffLut = GradientTable(falloff, target.width * target.height);
+
+    return s;
+}
+
+// Per-pixel light vectors and dot products of one row
+struct BumpScratch
+{
+    std::vector<float> L[3], H[3];
+    std::vector<float> NdotL, NdotH, spot;
+
+    explicit BumpScratch(const BumpSetup &s) : NdotL(s.width), NdotH(s.width), spot(s.width)
+    {
+        for (int32_t i = 0; i < 3; i++)
+        {
+            // directional lights are the same everywhere
+            L[i].assign(s.width, s.directional ? s.L[i] : 0.0f);
+            H[i].assign(s.width, s.directional ? s.H[i] : 0.0f);
+        }
+    }
+};
+
+// Lit colors of columns x0..x0+width-1 of row y of the surface with the given normals;
+// out, surf and normal point at column x0
+inline void BumpSpan(const BumpSetup &s, BumpScratch &t, int32_t y, int32_t x0, int32_t width, pixel *out, const pixel *surf, const pixel *normal)
+{
+    assert(x0 >= 0 && x0 + width <= s.width);
+    float *L0 = t.L[0].data(), *L1 = t.L[1].data(), *L2 = t.L[2].data();
+    float *H0 = t.H[0].data(), *H1 = t.H[1].data(), *H2 = t.H[2].data();
+
+    // determine vectors to light; y only changes per row
+    if (!s.directional)
+    {
+        const float ly = s.py - (y + 0.5f) * s.invY;
+        const float *lxs = s.lx.data() + x0;
+
+        for (int32_t x = 0; x < width; x++)
+        {
+            float lx = lxs[x];
+            float scale = util::rsqrt(lx * lx + ly * ly + s.pz * s.pz);
+            L0[x] = lx * scale;
+            L1[x] = ly * scale;
+            L2[x] = s.pz * scale;
+        }
+
+        // determine halfway vector
+        if (s.specular)
+        {
+            for (int32_t x = 0; x < width; x++)
+            {
+                float scale = util::rsqrt(2.0f + 2.0f * L2[x]); // 1/sqrt((L + <0,0,1>)^2)
+                H0[x] = L0[x] * scale;
+                H1[x] = L1[x] * scale;
+                H2[x] = (L2[x] + 1.0f) * scale;
+            }
+        }
+    }
+
+    // dot products, one pass each so the loops stay simple enough to vectorize
+    float *NdotL = t.NdotL.data(), *NdotH = t.NdotH.data(), *spot = t.spot.data();
+    for (int32_t x = 0; x < width; x++)
+    {
+        float N0 = (normal[x].r() - 0x8000) / 32768.0f;
+        float N1 = (normal[x].g() - 0x8000) / 32768.0f;
+        float N2 = (normal[x].b() - 0x8000) / 32768.0f;
+        float d = N0 * L0[x] + N1 * L1[x] + N2 * L2[x];
+        NdotL[x] = d < 0.0f ? 0.0f : d; // max(d, 0)
+    }
+
+    if (s.specular)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            float N0 = (normal[x].r() - 0x8000) / 32768.0f;
+            float N1 = (normal[x].g() - 0x8000) / 32768.0f;
+            float N2 = (normal[x].b() - 0x8000) / 32768.0f;
+            float d = N0 * H0[x] + N1 * H1[x] + N2 * H2[x];
+            NdotH[x] = d < 0.0f ? 0.0f : d;
+        }
+    }
+
+    if (s.falloff)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            float d = s.dx * L0[x] + s.dy * L1[x] + s.dz * L2[x];
+            spot[x] = d < 0.0f ? 0.0f : d;
+        }
+    }
+
+    // lighting calculation
+    for (int32_t x = 0; x < width; x++)
+    {
+        pixel falloff;
+        if (s.falloff)
+            falloff = s.falloffLut(spot[x] * (1 << 24));
+
+        float nl = NdotL[x];
+        pixel ambDiffuse = pixel{static_cast<red16_t>(nl * s.diffuse.r()), static_cast<green16_t>(nl * s.diffuse.g()),
+                                 static_cast<blue16_t>(nl * s.diffuse.b()), static_cast<alpha16_t>(nl * s.diffuse.a())};
+        if (s.falloff)
+        {
+            ambDiffuse = compositeMulC(ambDiffuse, falloff);
+        }
+
+        ambDiffuse = compositeAdd(ambDiffuse, s.ambient);
+        out[x] = surf[x] * ambDiffuse;
+
+        if (s.specular)
+        {
+            pixel addTerm = s.specularLut(NdotH[x] * (1 << 24));
+            if (s.falloff)
+            {
+                addTerm = compositeMulC(addTerm, falloff);
+            }
+
+            auto new_alpha = out[x].a();
+            out[x] += addTerm;
+            out[x].set_alpha(static_cast<alpha16_t>(new_alpha));
+            out[x].clamp_premult();
+        }
+    }
+}
+
+// Lit colors of row y of the surface with the given normals
+inline void BumpRow(const BumpSetup &s, BumpScratch &t, int32_t y, pixel *out, const pixel *surf, const pixel *normal)
+{
+    BumpSpan(s, t, y, 0, s.width, out, surf, normal);
+}
+
+} // namespace openktg::kernels
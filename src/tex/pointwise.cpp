@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include <openktg/core/matrix.h>
+#include <openktg/core/pixel.h>
+#include <openktg/core/texture.h>
+#include <openktg/tex/pointwise.h>
+#include <openktg/util/parallel.h>
+
+#include "kernels.h"
+
+namespace
+{
+
+// Per-stage state that is set up once for the whole texture
+struct PreparedStage
+{
+    const PointwiseStage *stage;
+    openktg::matrix44<int> matrix;                             // PointwiseColorMatrix
+    std::unique_ptr<openktg::kernels::ColorRemapTables> remap; // PointwiseColorRemap
+};
+
+// Applies one stage to the n pixels at block, which start at pixel index first
+void ApplyStage(const PreparedStage &p, openktg::core::pixel *block, int32_t first, int32_t n)
+{
+    const PointwiseStage &s = *p.stage;
+
+    switch (s.Op)
+    {
+    case PointwiseColorMatrix:
+        for (int32_t i = 0; i < n; i++)
+            block[i] = openktg::kernels::ColorMatrixPixel(p.matrix, block[i], s.ClampPremult);
+        break;
+
+    case PointwiseColorRemap:
+        for (int32_t i = 0; i < n; i++)
+            block[i] = openktg::kernels::ColorRemapPixel(*p.remap, block[i]);
+        break;
+
+    case PointwiseTernary: {
+        const openktg::core::pixel *in2 = s.Tex[0]->data() + first;
+        const openktg::core::pixel *in3 = s.Tex[1]->data() + first;
+        for (int32_t i = 0; i < n; i++)
+            block[i] = openktg::kernels::TernaryPixel(block[i], in2[i], in3[i], s.Ternary);
+        break;
+    }
+
+    case PointwiseCombine:
+        openktg::kernels::CombineRow(block, s.Tex[0]->data() + first, n, s.Combine);
+        break;
+
+    case PointwiseClampPremult:
+        for (int32_t i = 0; i < n; i++)
+            block[i].clamp_premult();
+        break;
+    }
+}
+
+} // namespace
+
+void Pointwise(openktg::texture &input, const openktg::texture &in, const PointwiseStage *stages, int32_t nStages)
+{
+    assert(texture_size_matches(input, in));
+
+    std::vector<PreparedStage> prepared(nStages);
+    for (int32_t i = 0; i < nStages; i++)
+    {
+        const PointwiseStage &s = stages[i];
+        PreparedStage &p = prepared[i];
+        p.stage = &s;
+
+        switch (s.Op)
+        {
+        case PointwiseColorMatrix:
+            p.matrix = openktg::kernels::ColorMatrixFixed(*s.Matrix);
+            break;
+
+        case PointwiseColorRemap:
+            assert(s.Tex[0] != &input && s.Tex[1] != &input && s.Tex[2] != &input);
+            p.remap = std::make_unique<openktg::kernels::ColorRemapTables>(*s.Tex[0], *s.Tex[1], *s.Tex[2], in.pixel_count());
+            break;
+
+        case PointwiseTernary:
+            assert(texture_size_matches(in, *s.Tex[0]) && texture_size_matches(in, *s.Tex[1]));
+            assert(s.Tex[0] != &input && s.Tex[1] != &input);
+            break;
+
+        case PointwiseCombine:
+            assert(texture_size_matches(in, *s.Tex[0]));
+            assert(s.Tex[0] != &input);
+            break;
+
+        case PointwiseClampPremult:
+            break;
+        }
+    }
+
+    // blocks small enough that every stage finds them in L1
+    const int32_t blockSize = 256;
+
+    openktg::util::parallel_for(0, in.pixel_count(), 16 * blockSize, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t first = begin; first < end; first += blockSize)
+        {
+            const int32_t n = std::min<uint32_t>(blockSize, end - first);
+            openktg::core::pixel *block = input.data() + first;
+
+            if (&input != &in)
+                std::memcpy(block, in.data() + first, n * sizeof(openktg::core::pixel));
+
+            for (const PreparedStage &p : prepared)
+                ApplyStage(p, block, first, n);
+        }
+    });
+}
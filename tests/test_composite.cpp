@@ -0,0 +1,582 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <openktg/core/pixel.h>
+#include <openktg/core/texture.h>
+#include <openktg/tex/composite.h>
+#include <openktg/tex/filters.h>
+#include <openktg/tex/procedural.h>
+#include <openktg/tex/sampling.h>
+#include <openktg/util/utility.h>
+
+#include "test_textures.h"
+
+using namespace openktg::literals;
+
+namespace
+{
+namespace legacy
+{
+void Paste(openktg::texture &input, const openktg::texture &bgTex, const openktg::texture &inTex, float orgx, float orgy, float ux, float uy, float vx,
+           float vy, CombineOp op, int32_t mode)
+{
+    assert(texture_size_matches(input, bgTex));
+
+    // copy background over (if this image is not the background already)
+    if (&input != &bgTex)
+        input = bgTex;
+
+    // calculate bounding rect
+    int32_t minX = std::max<int32_t>(0, floor((orgx + std::min(ux, 0.0f) + std::min(vx, 0.0f)) * input.width()));
+    int32_t minY = std::max<int32_t>(0, floor((orgy + std::min(uy, 0.0f) + std::min(vy, 0.0f)) * input.height()));
+    int32_t maxX = std::min<int32_t>(input.width() - 1, ceil((orgx + std::max(ux, 0.0f) + std::max(vx, 0.0f)) * input.width()));
+    int32_t maxY = std::min<int32_t>(input.height() - 1, ceil((orgy + std::max(uy, 0.0f) + std::max(vy, 0.0f)) * input.height()));
+
+    // solve for u0,v0 and deltas (Cramer's rule)
+    float detM = ux * vy - uy * vx;
+    if (fabs(detM) * input.width() * input.height() < 0.25f) // smaller than a pixel? skip it.
+        return;
+
+    float invM = (1 << 24) / detM;
+    float rmx = (minX + 0.5f) / input.width() - orgx;
+    float rmy = (minY + 0.5f) / input.height() - orgy;
+    int32_t u0 = (rmx * vy - rmy * vx) * invM;
+    int32_t v0 = (ux * rmy - uy * rmx) * invM;
+    int32_t dudx = vy * invM / input.width();
+    int32_t dvdx = -uy * invM / input.width();
+    int32_t dudy = -vx * invM / input.height();
+    int32_t dvdy = ux * invM / input.height();
+
+    for (int32_t y = minY; y <= maxY; y++)
+    {
+        openktg::pixel *out = &input.at(minX, y);
+        int32_t u = u0;
+        int32_t v = v0;
+
+        for (int32_t x = minX; x <= maxX; x++)
+        {
+            if (u >= 0 && u < 0x1000000 && v >= 0 && v < 0x1000000)
+            {
+                openktg::pixel in;
+
+                SampleFiltered(inTex, in, u, v, ClampU | ClampV | ((mode & 1) ? FilterBilinear : FilterNearest));
+
+                switch (op)
+                {
+                case CombineAdd: {
+                    *out += in;
+                    break;
+                }
+
+                case CombineSub: {
+                    *out -= in;
+                    break;
+                }
+
+                case CombineMulC: {
+                    *out *= in;
+                    break;
+                }
+
+                case CombineMin: {
+                    *out &= in;
+                    break;
+                }
+
+                case CombineMax: {
+                    *out |= in;
+                    break;
+                }
+
+                case CombineSetAlpha: {
+                    out->set_alpha(static_cast<openktg::alpha16_t>(in.r()));
+                    break;
+                }
+
+                case CombinePreAlpha: {
+                    *out = *out * in.r();
+                    out->set_alpha(static_cast<openktg::alpha16_t>(in.g()));
+                    break;
+                }
+
+                case CombineOver: {
+                    *out = openktg::combineOver(in, *out);
+                    break;
+                }
+
+                case CombineMultiply: {
+                    *out = openktg::combineMultiply(in, *out);
+                    break;
+                }
+
+                case CombineScreen: {
+                    *out = openktg::combineScreen(in, *out);
+                    break;
+                }
+
+                case CombineDarken: {
+                    *out = openktg::combineDarken(in, *out);
+                    break;
+                }
+
+                case CombineLighten: {
+                    *out = openktg::combineLighten(in, *out);
+                    break;
+                }
+                }
+            }
+
+            u += dudx;
+            v += dvdx;
+            out++;
+        }
+
+        u0 += dudy;
+        v0 += dvdy;
+    }
+}
+
+void LinearCombine(openktg::texture &input, const openktg::pixel &color, float constWeight, const LinearInput *inputs, int32_t nInputs)
+{
+    int32_t w[256], uo[256], vo[256];
+
+    assert(nInputs <= 255);
+    assert(constWeight >= -127.0f && constWeight <= 127.0f);
+
+    // convert weights and offsets to fixed point
+    for (int32_t i = 0; i < nInputs; i++)
+    {
+        assert(inputs[i].Weight >= -127.0f && inputs[i].Weight <= 127.0f);
+        assert(inputs[i].UShift >= -127.0f && inputs[i].UShift <= 127.0f);
+        assert(inputs[i].VShift >= -127.0f && inputs[i].VShift <= 127.0f);
+
+        w[i] = inputs[i].Weight * 65536.0f;
+        uo[i] = inputs[i].UShift * (1 << 24);
+        vo[i] = inputs[i].VShift * (1 << 24);
+    }
+
+    // compute preweighted constant color
+    int32_t c_r, c_g, c_b, c_a, t;
+
+    t = constWeight * 65536.0f;
+    c_r = openktg::util::mul_shift_16(t, color.r());
+    c_g = openktg::util::mul_shift_16(t, color.g());
+    c_b = openktg::util::mul_shift_16(t, color.b());
+    c_a = openktg::util::mul_shift_16(t, color.a());
+
+    // calculate output image
+    int32_t u0 = input.min_x();
+    int32_t v0 = input.min_y();
+    int32_t stepU = 1 << (24 - input.shift_x());
+    int32_t stepV = 1 << (24 - input.shift_y());
+    openktg::pixel *out = input.data();
+
+    for (int32_t y = 0; y < input.height(); y++)
+    {
+        int32_t u = u0;
+        int32_t v = v0;
+
+        for (int32_t x = 0; x < input.width(); x++)
+        {
+            int32_t acc_r, acc_g, acc_b, acc_a;
+
+            // initialize accumulator with start value
+            acc_r = c_r;
+            acc_g = c_g;
+            acc_b = c_b;
+            acc_a = c_a;
+
+            // accumulate inputs
+            for (int32_t j = 0; j < nInputs; j++)
+            {
+                const LinearInput &in = inputs[j];
+                openktg::pixel inPix;
+
+                SampleFiltered(*in.Tex, inPix, u + uo[j], v + vo[j], in.FilterMode);
+
+                acc_r += openktg::util::mul_shift_16(w[j], inPix.r());
+                acc_g += openktg::util::mul_shift_16(w[j], inPix.g());
+                acc_b += openktg::util::mul_shift_16(w[j], inPix.b());
+                acc_a += openktg::util::mul_shift_16(w[j], inPix.a());
+            }
+
+            // store (with clamping)
+            *out = openktg::pixel{
+                static_cast<openktg::red16_t>(std::clamp(acc_r, 0, 65535)),
+                static_cast<openktg::green16_t>(std::clamp(acc_g, 0, 65535)),
+                static_cast<openktg::blue16_t>(std::clamp(acc_b, 0, 65535)),
+                static_cast<openktg::alpha16_t>(std::clamp(acc_a, 0, 65535)),
+            };
+
+            // advance to next pixel
+            u += stepU;
+            out++;
+        }
+
+        v0 += stepV;
+    }
+}
+
+void Bump(openktg::texture &input, const openktg::texture &surface, const openktg::texture &normals, const openktg::texture *specular,
+          const openktg::texture *falloffMap, float px, float py, float pz, float dx, float dy, float dz, const openktg::pixel &ambient,
+          const openktg::pixel &diffuse, bool directional)
+{
+    float L[3], H[3]; // light/halfway vector
+    float invX, invY;
+
+    float scale = openktg::util::rsqrt(dx * dx + dy * dy + dz * dz);
+    dx *= scale;
+    dy *= scale;
+    dz *= scale;
+
+    if (directional)
+    {
+        L[0] = -dx;
+        L[1] = -dy;
+        L[2] = -dz;
+
+        scale = openktg::util::rsqrt(2.0f + 2.0f * L[2]); // 1/sqrt((L + <0,0,1>)^2)
+        H[0] = L[0] * scale;
+        H[1] = L[1] * scale;
+        H[2] = (L[2] + 1.0f) * scale;
+    }
+
+    invX = 1.0f / input.width();
+    invY = 1.0f / input.height();
+    openktg::pixel *out = input.data();
+    const openktg::pixel *surf = surface.data();
+    const openktg::pixel *normal = normals.data();
+
+    for (int32_t y = 0; y < input.height(); y++)
+    {
+        for (int32_t x = 0; x < input.width(); x++)
+        {
+            // determine vectors to light
+            if (!directional)
+            {
+                L[0] = px - (x + 0.5f) * invX;
+                L[1] = py - (y + 0.5f) * invY;
+                L[2] = pz;
+
+                float scale = openktg::util::rsqrt(L[0] * L[0] + L[1] * L[1] + L[2] * L[2]);
+                L[0] *= scale;
+                L[1] *= scale;
+                L[2] *= scale;
+
+                // determine halfway vector
+                if (specular)
+                {
+                    float scale = openktg::util::rsqrt(2.0f + 2.0f * L[2]); // 1/sqrt((L + <0,0,1>)^2)
+                    H[0] = L[0] * scale;
+                    H[1] = L[1] * scale;
+                    H[2] = (L[2] + 1.0f) * scale;
+                }
+            }
+
+            // fetch normal
+            float N[3];
+            N[0] = (normal->r() - 0x8000) / 32768.0f;
+            N[1] = (normal->g() - 0x8000) / 32768.0f;
+            N[2] = (normal->b() - 0x8000) / 32768.0f;
+
+            // get falloff term if specified
+            openktg::pixel falloff;
+            if (falloffMap)
+            {
+                float spotTerm = std::max<float>(dx * L[0] + dy * L[1] + dz * L[2], 0.0f);
+                SampleGradient(*falloffMap, falloff, spotTerm * (1 << 24));
+            }
+
+            // lighting calculation
+            float NdotL = std::max<float>(N[0] * L[0] + N[1] * L[1] + N[2] * L[2], 0.0f);
+            openktg::pixel ambDiffuse =
+                openktg::pixel{static_cast<openktg::red16_t>(NdotL * diffuse.r()), static_cast<openktg::green16_t>(NdotL * diffuse.g()),
+                                     static_cast<openktg::blue16_t>(NdotL * diffuse.b()), static_cast<openktg::alpha16_t>(NdotL * diffuse.a())};
+            if (falloffMap)
+            {
+                ambDiffuse = openktg::compositeMulC(ambDiffuse, falloff);
+            }
+
+            ambDiffuse = openktg::compositeAdd(ambDiffuse, ambient);
+            *out = *surf * ambDiffuse;
+
+            if (specular)
+            {
+                openktg::pixel addTerm;
+                float NdotH = std::max<float>(N[0] * H[0] + N[1] * H[1] + N[2] * H[2], 0.0f);
+                SampleGradient(*specular, addTerm, NdotH * (1 << 24));
+                if (falloffMap)
+                {
+                    addTerm = openktg::compositeMulC(addTerm, falloff);
+                }
+
+                auto new_alpha = out->a();
+                *out += addTerm;
+                out->set_alpha(static_cast<openktg::alpha16_t>(new_alpha));
+                out->clamp_premult();
+            }
+
+            out++;
+            surf++;
+            normal++;
+        }
+    }
+}
+} // namespace legacy
+} // namespace
+
+TEST(CompositeTest, BumpFromHeightMatchesDeriveAndBump)
+{
+    openktg::texture surface = RandomTexture(64, 32, 7);
+    openktg::texture height = RandomHeightMap(64, 32, 8);
+    openktg::texture specular = LinearGradient(0xff000000, 0xffffffff);
+    openktg::texture falloff = LinearGradient(0xff202020, 0xffe0c0a0);
+    openktg::pixel amb{0xff101010_argb};
+    openktg::pixel diff{0xffc0e0ff_argb};
+
+    const openktg::texture *specs[] = {nullptr, &specular};
+    const openktg::texture *falloffs[] = {nullptr, &falloff};
+
+    for (bool directional : {true, false})
+    {
+        for (const openktg::texture *spec : specs)
+        {
+            for (const openktg::texture *fall : falloffs)
+            {
+                openktg::texture normals(64, 32), expected(64, 32), result(64, 32);
+
+                Derive(normals, height, DeriveNormals, 2.5f);
+                Bump(expected, surface, normals, spec, fall, 0.3f, 0.7f, 0.5f, -2.518f, 0.719f, -3.10f, amb, diff, directional);
+                BumpFromHeight(result, surface, height, 2.5f, spec, fall, 0.3f, 0.7f, 0.5f, -2.518f, 0.719f, -3.10f, amb, diff, directional);
+
+                ExpectTexturesEqual(result, expected);
+            }
+        }
+    }
+}
+
+TEST(CompositeTest, PasteFastPathsMatchSampling)
+{
+    openktg::texture bg = RandomTexture(64, 32, 19);
+    openktg::texture same = RandomTexture(64, 32, 20);
+    openktg::texture half = RandomTexture(32, 16, 21);
+
+    struct Placement
+    {
+        const openktg::texture *in;
+        float orgx, orgy, ux, uy, vx, vy;
+    };
+
+    const Placement placements[] = {
+        {&same, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f},             // identity, full cover
+        {&same, 0.25f, -0.125f, 1.0f, 0.0f, 0.0f, 1.0f},         // integer texel offsets, partly outside
+        {&same, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f},            // mostly outside
+        {&half, 0.125f, 0.25f, 0.5f, 0.0f, 0.0f, 0.5f},          // smaller source, one texel per pixel
+        {&half, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f},             // magnified, generic path
+        {&same, 0.1f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f},             // fractional offset, generic path
+        {&same, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f},            // mirrored, generic path
+        {&same, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f},             // transposed, generic path
+    };
+
+    for (const Placement &p : placements)
+    {
+        for (int32_t op = CombineAdd; op <= CombineLighten; op++)
+        {
+            for (int32_t mode : {0, 1})
+            {
+                openktg::texture expected(64, 32), result(64, 32);
+                legacy::Paste(expected, bg, *p.in, p.orgx, p.orgy, p.ux, p.uy, p.vx, p.vy, CombineOp(op), mode);
+                Paste(result, bg, *p.in, p.orgx, p.orgy, p.ux, p.uy, p.vx, p.vy, CombineOp(op), mode);
+                ExpectTexturesEqual(result, expected);
+            }
+        }
+    }
+
+    // in place on the background, as the demo does
+    openktg::texture expected(64, 32), result = bg;
+    legacy::Paste(expected, bg, same, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, CombineAdd, 0);
+    Paste(result, result, same, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, CombineAdd, 0);
+    ExpectTexturesEqual(result, expected);
+}
+
+TEST(CompositeTest, LinearCombineMatchesPerPixelSampling)
+{
+    openktg::texture textures[] = {RandomTexture(64, 32, 22), RandomTexture(32, 16, 23), RandomTexture(128, 64, 24), RandomTexture(64, 8, 25)};
+
+    std::mt19937 gen(26);
+    std::uniform_int_distribution<int32_t> pick(0, 3), mode(0, 7), texel(-70, 70);
+    std::uniform_real_distribution<float> weight(-1.5f, 1.5f), shift(-2.0f, 2.0f);
+
+    // more inputs than the old 255 limit; integer texel and fractional shifts
+    std::vector<LinearInput> inputs(300);
+    for (size_t i = 0; i < inputs.size(); i++)
+    {
+        LinearInput &in = inputs[i];
+        in.Tex = &textures[pick(gen)];
+        in.Weight = weight(gen) / 40.0f;
+        in.UShift = (i % 2) ? shift(gen) : texel(gen) / 64.0f;
+        in.VShift = (i % 3) ? shift(gen) : texel(gen) / 32.0f;
+        in.FilterMode = mode(gen);
+    }
+
+    openktg::pixel color{0xff406080_argb};
+    for (int32_t n : {0, 1, 4, 255})
+    {
+        openktg::texture expected(64, 32), result(64, 32);
+        legacy::LinearCombine(expected, color, 0.5f, inputs.data(), n);
+        LinearCombine(result, color, 0.5f, inputs.data(), n);
+        ExpectTexturesEqual(result, expected);
+    }
+
+    // beyond the old 255 input limit, against per-pixel sampling
+    openktg::texture result(64, 32);
+    LinearCombine(result, color, 0.5f, inputs.data(), inputs.size());
+
+    for (int32_t y = 0; y < 32; y++)
+    {
+        for (int32_t x = 0; x < 64; x++)
+        {
+            int32_t acc[4] = {};
+            for (const LinearInput &in : inputs)
+            {
+                openktg::pixel p;
+                int32_t w = in.Weight * 65536.0f;
+                SampleFiltered(*in.Tex, p, result.min_x() + (x << (24 - 6)) + int32_t(in.UShift * (1 << 24)),
+                               result.min_y() + (y << (24 - 5)) + int32_t(in.VShift * (1 << 24)), in.FilterMode);
+                acc[0] += openktg::util::mul_shift_16(w, p.r());
+                acc[3] += openktg::util::mul_shift_16(w, p.a());
+            }
+
+            int32_t c = 0.5f * 65536.0f;
+            ASSERT_EQ(result.at(x, y).r(), std::clamp(acc[0] + openktg::util::mul_shift_16(c, color.r()), 0, 65535)) << x << ", " << y;
+            ASSERT_EQ(result.at(x, y).a(), std::clamp(acc[3] + openktg::util::mul_shift_16(c, color.a()), 0, 65535)) << x << ", " << y;
+        }
+    }
+}
+
+TEST(CompositeTest, LinearCombineSaturatesManyHeavyInputs)
+{
+    openktg::texture white(64, 64);
+    std::fill_n(white.data(), white.pixel_count(), openktg::pixel{0xffffffff_argb});
+
+    // 300 inputs of weight 127 sum to about 2.5e9, beyond 32 bit accumulators
+    std::vector<LinearInput> inputs(300, LinearInput{&white, 127.0f, 0.0f, 0.0f, 0});
+
+    openktg::texture result(64, 64);
+    LinearCombine(result, openktg::pixel{0xff000000_argb}, 0.0f, inputs.data(), inputs.size());
+    for (uint32_t i = 0; i < result.pixel_count(); i++)
+        ASSERT_EQ(result.data()[i], openktg::pixel{0xffffffff_argb}) << i;
+
+    // and the other way round
+    for (LinearInput &in : inputs)
+        in.Weight = -in.Weight;
+    LinearCombine(result, openktg::pixel{0xffffffff_argb}, 1.0f, inputs.data(), inputs.size());
+    for (uint32_t i = 0; i < result.pixel_count(); i++)
+        ASSERT_EQ(result.data()[i], openktg::pixel{0x00000000_argb}) << i;
+}
+
+TEST(CompositeTest, BumpMatchesPerPixelLighting)
+{
+    // large enough for gradient lookup tables of width 2 and 4; width 8 is sampled directly
+    openktg::texture surface = RandomTexture(512, 512, 27);
+    openktg::texture normals(512, 512);
+    Derive(normals, RandomHeightMap(512, 512, 28), DeriveNormals, 1.5f);
+
+    openktg::texture narrow = LinearGradient(0xff000000, 0xffffffff);
+    openktg::texture medium = RandomTexture(4, 1, 29), wide = RandomTexture(8, 1, 30);
+    openktg::pixel amb{0xff101010_argb};
+    openktg::pixel diff{0xffc0e0ff_argb};
+
+    const openktg::texture *specs[] = {nullptr, &narrow, &medium, &wide};
+    const openktg::texture *falloffs[] = {nullptr, &narrow, &wide};
+
+    for (bool directional : {true, false})
+    {
+        for (const openktg::texture *spec : specs)
+        {
+            for (const openktg::texture *fall : falloffs)
+            {
+                openktg::texture expected(512, 512), result(512, 512);
+
+                legacy::Bump(expected, surface, normals, spec, fall, 0.3f, 0.7f, 0.5f, -2.518f, 0.719f, -3.10f, amb, diff, directional);
+                Bump(result, surface, normals, spec, fall, 0.3f, 0.7f, 0.5f, -2.518f, 0.719f, -3.10f, amb, diff, directional);
+
+                ExpectTexturesEqual(result, expected);
+            }
+        }
+    }
+}
+
+TEST(CompositeTest, BumpMultiMatchesChainedBumpAndPaste)
+{
+    openktg::texture surface = RandomTexture(256, 256, 31);
+    openktg::texture normals(256, 256);
+    Derive(normals, RandomHeightMap(256, 256, 32), DeriveNormals, 1.5f);
+
+    openktg::texture spec = LinearGradient(0xff000000, 0xffffffff);
+    openktg::texture fall = RandomTexture(8, 1, 33);
+
+    const BumpLight lights[] = {
+        {0.3f, 0.7f, 0.5f, -2.518f, 0.719f, -3.10f, openktg::pixel{0xff101010_argb}, openktg::pixel{0xffc0e0ff_argb}, &spec, nullptr, false},
+        {0.0f, 0.0f, 0.0f, 1.0f, -0.5f, -2.0f, openktg::pixel{0xff000000_argb}, openktg::pixel{0xff804020_argb}, nullptr, nullptr, true},
+        {0.8f, 0.1f, 0.3f, -0.2f, 0.4f, -1.0f, openktg::pixel{0xff202020_argb}, openktg::pixel{0xffffffff_argb}, &spec, &fall, false},
+    };
+
+    openktg::texture expected(256, 256), lit(256, 256), result(256, 256);
+    for (int32_t i = 0; i < 3; i++)
+    {
+        const BumpLight &l = lights[i];
+        Bump(i == 0 ? expected : lit, surface, normals, l.Specular, l.Falloff, l.Px, l.Py, l.Pz, l.Dx, l.Dy, l.Dz, l.Ambient, l.Diffuse, l.Directional);
+        if (i > 0)
+            Paste(expected, expected, lit, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, CombineAdd, 0);
+    }
+
+    BumpMulti(result, surface, normals, lights, 3);
+    ExpectTexturesEqual(result, expected);
+
+    // a single light is plain Bump
+    BumpMulti(result, surface, normals, lights, 1);
+    Bump(expected, surface, normals, &spec, nullptr, 0.3f, 0.7f, 0.5f, -2.518f, 0.719f, -3.10f, lights[0].Ambient, lights[0].Diffuse, false);
+    ExpectTexturesEqual(result, expected);
+}
+
+TEST(CompositeTest, CompositeStackMatchesSequentialPaste)
+{
+    openktg::texture bg = RandomTexture(256, 128, 34);
+    openktg::texture sources[] = {RandomTexture(256, 128, 35), RandomTexture(64, 32, 36), RandomTexture(16, 16, 37)};
+
+    // aligned, scaled, rotated and tiny layers, several crossing tile borders
+    std::mt19937 gen(38);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<CompositeLayer> layers;
+    for (int32_t i = 0; i < 24; i++)
+    {
+        const openktg::texture &src = sources[i % 3];
+        float size = 0.05f + unit(gen) * 0.9f;
+        float angle = (i % 4 == 0) ? 0.0f : unit(gen) * 6.2832f;
+        CompositeLayer l{&src, unit(gen) - 0.2f, unit(gen) - 0.2f, size * std::cos(angle), size * std::sin(angle), -size * std::sin(angle), size * std::cos(angle),
+                         CombineOp(i % (CombineLighten + 1)), i & 1};
+        if (i % 6 == 0) // one texel per pixel at texel centers
+            l = CompositeLayer{&src, (i % 5) / 16.0f, (i % 7) / 16.0f, src.width() / 256.0f, 0.0f, 0.0f, src.height() / 128.0f, CombineOp(i % 4), 0};
+        layers.push_back(l);
+    }
+    layers.push_back(CompositeLayer{&sources[0], 0.3f, 0.3f, 0.0001f, 0.0f, 0.0f, 0.0001f, CombineAdd, 0}); // smaller than a pixel
+
+    openktg::texture expected(256, 128), result(256, 128);
+    expected = bg;
+    for (const CompositeLayer &l : layers)
+        Paste(expected, expected, *l.Tex, l.OrgX, l.OrgY, l.UX, l.UY, l.VX, l.VY, l.Op, l.Mode);
+
+    CompositeStack(result, bg, layers.data(), int32_t(layers.size()));
+    ExpectTexturesEqual(result, expected);
+
+    // in place on the background
+    result = bg;
+    CompositeStack(result, result, layers.data(), int32_t(layers.size()));
+    ExpectTexturesEqual(result, expected);
+}
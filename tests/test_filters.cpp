@@ -0,0 +1,699 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <openktg/core/matrix.h>
+#include <openktg/core/pixel.h>
+#include <openktg/core/summed_area_table.h>
+#include <openktg/core/texture.h>
+#include <openktg/core/texture_statistics.h>
+#include <openktg/tex/filters.h>
+#include <openktg/tex/procedural.h>
+#include <openktg/tex/sampling.h>
+#include <openktg/util/utility.h>
+
+#include "test_textures.h"
+
+using namespace openktg::literals;
+
+namespace
+{
+namespace legacy
+{
+void ColorRemap(openktg::texture &input, const openktg::texture &inTex, const openktg::texture &mapR, const openktg::texture &mapG,
+                const openktg::texture &mapB)
+{
+    for (int32_t i = 0; i < input.pixel_count(); i++)
+    {
+        const openktg::pixel &in = inTex.data()[i];
+        openktg::pixel &out = input.data()[i];
+
+        if (in.a() == 65535)
+        {
+            openktg::pixel colR, colG, colB;
+
+            SampleGradient(mapR, colR, (in.r() << 8) + ((in.r() + 128) >> 8));
+            SampleGradient(mapG, colG, (in.g() << 8) + ((in.g() + 128) >> 8));
+            SampleGradient(mapB, colB, (in.b() << 8) + ((in.b() + 128) >> 8));
+
+            out = openktg::pixel(static_cast<openktg::red16_t>(std::min(colR.r() + colG.r() + colB.r(), 65535)),
+                                 static_cast<openktg::green16_t>(std::min(colR.g() + colG.g() + colB.g(), 65535)),
+                                 static_cast<openktg::blue16_t>(std::min(colR.b() + colG.b() + colB.b(), 65535)), static_cast<openktg::alpha16_t>(in.a()));
+        }
+        else if (in.a())
+        {
+            openktg::pixel colR, colG, colB;
+            uint32_t invA = (65535U << 16) / in.a();
+
+            SampleGradient(mapR, colR, openktg::util::unsigned_mul_shift_8(std::min(in.r(), in.a()), invA));
+            SampleGradient(mapG, colG, openktg::util::unsigned_mul_shift_8(std::min(in.g(), in.a()), invA));
+            SampleGradient(mapB, colB, openktg::util::unsigned_mul_shift_8(std::min(in.b(), in.a()), invA));
+
+            out = openktg::pixel(static_cast<openktg::red16_t>(openktg::util::mul_intens(std::min(colR.r() + colG.r() + colB.r(), 65535), in.a())),
+                                 static_cast<openktg::green16_t>(openktg::util::mul_intens(std::min(colR.g() + colG.g() + colB.g(), 65535), in.a())),
+                                 static_cast<openktg::blue16_t>(openktg::util::mul_intens(std::min(colR.b() + colG.b() + colB.b(), 65535), in.a())),
+                                 static_cast<openktg::alpha16_t>(in.a()));
+        }
+        else
+            out = in;
+    }
+}
+
+void CoordMatrixTransform(openktg::texture &input, const openktg::texture &in, const openktg::matrix44<float> &matrix, int32_t mode)
+{
+    int32_t scaleX = 1 << (24 - input.shift_x());
+    int32_t scaleY = 1 << (24 - input.shift_y());
+
+    int32_t dudx = matrix(0, 0) * scaleX;
+    int32_t dudy = matrix(0, 1) * scaleY;
+    int32_t dvdx = matrix(1, 0) * scaleX;
+    int32_t dvdy = matrix(1, 1) * scaleY;
+
+    int32_t u0 = matrix(0, 3) * (1 << 24) + ((dudx + dudy) >> 1);
+    int32_t v0 = matrix(1, 3) * (1 << 24) + ((dvdx + dvdy) >> 1);
+    openktg::pixel *out = input.data();
+
+    for (int32_t y = 0; y < input.height(); y++)
+    {
+        int32_t u = u0;
+        int32_t v = v0;
+
+        for (int32_t x = 0; x < input.width(); x++)
+        {
+            SampleFiltered(in, *out, u, v, mode);
+
+            u += dudx;
+            v += dvdx;
+            out++;
+        }
+
+        u0 += dudy;
+        v0 += dvdy;
+    }
+}
+
+void Derive(openktg::texture &input, const openktg::texture &in, DeriveOp op, float strength)
+{
+    openktg::core::pixel *out = input.data();
+
+    for (int32_t y = 0; y < input.height(); y++)
+    {
+        for (int32_t x = 0; x < input.width(); x++)
+        {
+            int32_t dx2 = in.at((x + 1) & (input.width() - 1), y).r() - in.at((x - 1) & (input.width() - 1), y).r();
+            int32_t dy2 = in.at(x, (y + 1) & (input.height() - 1)).r() - in.at(x, (y - 1) & (input.height() - 1)).r();
+            float dx = dx2 * strength / (2 * 65535.0f);
+            float dy = dy2 * strength / (2 * 65535.0f);
+
+            switch (op)
+            {
+            case DeriveGradient:
+                *out = openktg::pixel{static_cast<openktg::red16_t>(std::clamp<int32_t>(dx * 32768.0f + 32768.0f, 0, 65535)),
+                                      static_cast<openktg::green16_t>(std::clamp<int32_t>(dy * 32768.0f + 32768.0f, 0, 65535)),
+                                      static_cast<openktg::blue16_t>(0), static_cast<openktg::alpha16_t>(65535)};
+                break;
+
+            case DeriveNormals:
+                float scale = 32768.0f * openktg::util::rsqrt(1.0f + dx * dx + dy * dy);
+                *out = openktg::pixel{static_cast<openktg::red16_t>(std::clamp<int32_t>(-dx * scale + 32768.0f, 0, 65535)),
+                                      static_cast<openktg::green16_t>(std::clamp<int32_t>(-dy * scale + 32768.0f, 0, 65535)),
+                                      static_cast<openktg::blue16_t>(std::clamp<int32_t>(scale + 32768.0f, 0, 65535)),
+                                      static_cast<openktg::alpha16_t>(65535)};
+                break;
+            }
+            out++;
+        }
+    }
+}
+} // namespace legacy
+
+// 2D affine coordinate transform u = m00*x + m01*y + m03, v = m10*x + m11*y + m13
+auto CoordMatrix(float m00, float m01, float m03, float m10, float m11, float m13) -> openktg::matrix44<float>
+{
+    auto m = openktg::matrix44<float>::identity();
+    m(0, 0) = m00;
+    m(0, 1) = m01;
+    m(0, 3) = m03;
+    m(1, 0) = m10;
+    m(1, 1) = m11;
+    m(1, 3) = m13;
+    return m;
+}
+
+// Compares RankFilter against sorting the windows of every step-th pixel in each direction
+void RankFilterCheck(const openktg::texture &in, float sizex, float sizey, float rank, int32_t mode, int32_t step = 1)
+{
+    openktg::texture result(in.width(), in.height());
+    RankFilter(result, in, sizex, sizey, rank, mode);
+
+    int32_t rx = sizex * in.width() / 2;
+    int32_t ry = sizey * in.height() / 2;
+    uint32_t k = std::lround(rank * ((2 * rx + 1) * (2 * ry + 1) - 1));
+
+    for (int32_t y = 0; y < in.height(); y += step)
+    {
+        for (int32_t x = 0; x < in.width(); x += step)
+        {
+            std::vector<uint16_t> values[4];
+
+            for (int32_t j = y - ry; j <= y + ry; j++)
+            {
+                for (int32_t i = x - rx; i <= x + rx; i++)
+                {
+                    int32_t sx = (mode & ClampU) ? std::clamp<int32_t>(i, 0, in.width() - 1) : (i & (in.width() - 1));
+                    int32_t sy = (mode & ClampV) ? std::clamp<int32_t>(j, 0, in.height() - 1) : (j & (in.height() - 1));
+                    values[0].push_back(in.at(sx, sy).r());
+                    values[1].push_back(in.at(sx, sy).g());
+                    values[2].push_back(in.at(sx, sy).b());
+                    values[3].push_back(in.at(sx, sy).a());
+                }
+            }
+
+            for (auto &v : values)
+                std::nth_element(v.begin(), v.begin() + k, v.end());
+
+            openktg::pixel expected{static_cast<openktg::red16_t>(values[0][k]), static_cast<openktg::green16_t>(values[1][k]),
+                                    static_cast<openktg::blue16_t>(values[2][k]), static_cast<openktg::alpha16_t>(values[3][k])};
+            ASSERT_EQ(result.at(x, y), expected) << x << ", " << y << " mode " << mode << " rank " << rank;
+        }
+    }
+}
+} // namespace
+
+TEST(FiltersTest, ColorRemapMatchesSampledGradients)
+{
+    openktg::texture mapR = LinearGradient(0xff000000, 0xffff8020);
+    openktg::texture mapG = LinearGradient(0xff102030, 0xff00ff00);
+    openktg::texture mapB(4, 1);
+    mapB.at(0, 0) = openktg::pixel{0xff000010_argb};
+    mapB.at(1, 0) = openktg::pixel{0xff4000ff_argb};
+    mapB.at(2, 0) = openktg::pixel{0xff000000_argb};
+    mapB.at(3, 0) = openktg::pixel{0xffffffff_argb};
+
+    // sampled directly, and through lookups once there are more pixels than they have entries
+    for (auto [width, height] : {std::pair{128, 64}, std::pair{512, 256}})
+    {
+        openktg::texture in = RandomTexture(width, height, 1);
+        openktg::texture expected(width, height);
+        openktg::texture result(width, height);
+        legacy::ColorRemap(expected, in, mapR, mapG, mapB);
+        ColorRemap(result, in, mapR, mapG, mapB);
+
+        ExpectTexturesEqual(result, expected);
+    }
+}
+
+TEST(FiltersTest, CoordMatrixTransformFastPathsMatchSampling)
+{
+    openktg::texture in = RandomTexture(64, 32, 2);
+
+    const openktg::matrix44<float> matrices[] = {
+        CoordMatrix(1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f),              // identity
+        CoordMatrix(1.0f, 0.0f, 0.25f, 0.0f, 1.0f, -0.125f),          // texel translation
+        CoordMatrix(1.0f, 0.0f, 0.3f, 0.0f, 1.0f, 0.71f),             // subtexel translation
+        CoordMatrix(2.0f, 0.0f, 0.1f, 0.0f, 0.5f, -0.3f),             // axis-aligned scale
+        CoordMatrix(-3.7f, 0.0f, 1.2f, 0.0f, 1.3f, 0.0f),             // mirrored scale
+        CoordMatrix(0.0f, 1.0f, 0.0f, -1.0f, 0.0f, 1.0f),             // 90 degrees
+        CoordMatrix(-1.0f, 0.0f, 1.0f, 0.0f, -1.0f, 1.0f),            // 180 degrees
+        CoordMatrix(0.0f, -1.0f, 1.0f, 1.0f, 0.0f, 0.0f),             // 270 degrees
+        CoordMatrix(0.0f, 0.5f, 0.33f, 2.0f, 0.0f, 0.1f),             // rotated scale
+        CoordMatrix(0.7071f, 0.7071f, 0.2f, -0.7071f, 0.7071f, 0.5f), // generic path
+    };
+
+    for (const auto &m : matrices)
+    {
+        for (int32_t mode = 0; mode < 8; mode++)
+        {
+            openktg::texture expected(in.width(), in.height()), result(in.width(), in.height());
+            legacy::CoordMatrixTransform(expected, in, m, mode);
+            CoordMatrixTransform(result, in, m, mode);
+
+            ExpectTexturesEqual(result, expected);
+        }
+    }
+}
+
+TEST(FiltersTest, SummedAreaTableSums)
+{
+    openktg::texture in = RandomTexture(32, 16, 3);
+    openktg::summed_area_table sat(in);
+
+    for (uint32_t y0 = 0; y0 <= in.height(); y0 += 3)
+    {
+        for (uint32_t x0 = 0; x0 <= in.width(); x0 += 5)
+        {
+            uint32_t x1 = std::min(in.width(), x0 + 7), y1 = std::min(in.height(), y0 + 4);
+            int64_t expected[4] = {0, 0, 0, 0};
+
+            for (uint32_t y = y0; y < y1; y++)
+            {
+                for (uint32_t x = x0; x < x1; x++)
+                {
+                    expected[0] += in.at(x, y).r();
+                    expected[1] += in.at(x, y).g();
+                    expected[2] += in.at(x, y).b();
+                    expected[3] += in.at(x, y).a();
+                }
+            }
+
+            auto sums = sat.sum(x0, y0, x1, y1);
+            for (int c = 0; c < 4; c++)
+                EXPECT_EQ(sums[c], expected[c]);
+        }
+    }
+}
+
+TEST(FiltersTest, VariableBlurMatchesBoxAverage)
+{
+    openktg::texture in = RandomTexture(32, 16, 4);
+    openktg::texture control = RandomTexture(32, 16, 5);
+
+    for (int32_t mode : {WrapU | WrapV, ClampU | WrapV, WrapU | ClampV, ClampU | ClampV})
+    {
+        openktg::texture result(in.width(), in.height());
+        VariableBlur(result, in, control, 0.5f, 0.25f, mode);
+
+        int32_t maxX = 0.5f * in.width() / 2;
+        int32_t maxY = 0.25f * in.height() / 2;
+
+        for (int32_t y = 0; y < in.height(); y++)
+        {
+            for (int32_t x = 0; x < in.width(); x++)
+            {
+                int32_t rx = (control.at(x, y).r() * maxX + 32767) / 65535;
+                int32_t ry = (control.at(x, y).r() * maxY + 32767) / 65535;
+                int64_t acc[4] = {0, 0, 0, 0};
+
+                for (int32_t j = y - ry; j <= y + ry; j++)
+                {
+                    for (int32_t i = x - rx; i <= x + rx; i++)
+                    {
+                        int32_t sx = (mode & ClampU) ? std::clamp<int32_t>(i, 0, in.width() - 1) : (i & (in.width() - 1));
+                        int32_t sy = (mode & ClampV) ? std::clamp<int32_t>(j, 0, in.height() - 1) : (j & (in.height() - 1));
+                        acc[0] += in.at(sx, sy).r();
+                        acc[1] += in.at(sx, sy).g();
+                        acc[2] += in.at(sx, sy).b();
+                        acc[3] += in.at(sx, sy).a();
+                    }
+                }
+
+                int64_t area = int64_t(2 * rx + 1) * (2 * ry + 1);
+                const openktg::pixel &p = result.at(x, y);
+                ASSERT_EQ(p.r(), (acc[0] + area / 2) / area) << x << ", " << y << " mode " << mode;
+                ASSERT_EQ(p.g(), (acc[1] + area / 2) / area) << x << ", " << y << " mode " << mode;
+                ASSERT_EQ(p.b(), (acc[2] + area / 2) / area) << x << ", " << y << " mode " << mode;
+                ASSERT_EQ(p.a(), (acc[3] + area / 2) / area) << x << ", " << y << " mode " << mode;
+            }
+        }
+    }
+}
+
+TEST(FiltersTest, ErodeDilateMatchBruteForce)
+{
+    openktg::texture in = RandomTexture(64, 32, 6);
+
+    for (int32_t mode : {WrapU | WrapV, ClampU | WrapV, WrapU | ClampV, ClampU | ClampV})
+    {
+        for (float size : {0.0f, 0.04f, 0.1f, 0.3f})
+        {
+            openktg::texture eroded(in.width(), in.height()), dilated = in;
+            Erode(eroded, in, size, size * 1.5f, mode);
+            Dilate(dilated, dilated, size, size * 1.5f, mode); // in place
+
+            int32_t rx = size * in.width() / 2;
+            int32_t ry = size * 1.5f * in.height() / 2;
+
+            for (int32_t y = 0; y < in.height(); y++)
+            {
+                for (int32_t x = 0; x < in.width(); x++)
+                {
+                    openktg::pixel lo = in.at(x, y), hi = in.at(x, y);
+
+                    for (int32_t j = y - ry; j <= y + ry; j++)
+                    {
+                        for (int32_t i = x - rx; i <= x + rx; i++)
+                        {
+                            int32_t sx = (mode & ClampU) ? std::clamp<int32_t>(i, 0, in.width() - 1) : (i & (in.width() - 1));
+                            int32_t sy = (mode & ClampV) ? std::clamp<int32_t>(j, 0, in.height() - 1) : (j & (in.height() - 1));
+                            lo &= in.at(sx, sy);
+                            hi |= in.at(sx, sy);
+                        }
+                    }
+
+                    ASSERT_EQ(eroded.at(x, y), lo) << x << ", " << y << " mode " << mode << " size " << size;
+                    ASSERT_EQ(dilated.at(x, y), hi) << x << ", " << y << " mode " << mode << " size " << size;
+                }
+            }
+        }
+    }
+}
+
+TEST(FiltersTest, RankFilterMatchesSortedWindows)
+{
+    openktg::texture in = RandomTexture(32, 16, 9);
+    openktg::texture wide = RandomTexture(512, 8, 10); // several strips
+
+    struct Case
+    {
+        const openktg::texture *in;
+        float sizex, sizey;
+    };
+
+    for (const Case &c : {Case{&in, 0.2f, 0.3f}, Case{&wide, 0.02f, 0.5f}})
+    {
+        for (int32_t mode : {WrapU | WrapV, ClampU | ClampV})
+        {
+            for (float rank : {0.0f, 0.3f, 0.5f, 1.0f})
+            {
+                RankFilterCheck(*c.in, c.sizex, c.sizey, rank, mode);
+            }
+        }
+    }
+
+    // in place median
+    openktg::texture expected(in.width(), in.height()), result = in;
+    Median(expected, in, 0.1f, 0.1f, WrapU | WrapV);
+    Median(result, result, 0.1f, 0.1f, WrapU | WrapV);
+    ExpectTexturesEqual(result, expected);
+}
+
+TEST(FiltersTest, RankFilterHandlesLargeWindows)
+{
+    // few distinct high and low bytes keep the histogram searches short
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<uint32_t> byte(0, 15);
+    auto channel = [&] { return static_cast<uint16_t>(byte(gen) << 8 | byte(gen)); };
+
+    openktg::texture large(1024, 1024);
+    for (uint32_t i = 0; i < large.pixel_count(); i++)
+    {
+        large.data()[i] = openktg::pixel{static_cast<openktg::red16_t>(channel()), static_cast<openktg::green16_t>(channel()),
+                                         static_cast<openktg::blue16_t>(channel()), static_cast<openktg::alpha16_t>(channel())};
+    }
+
+    // a window as wide as the texture, beyond what column histograms fit in
+    RankFilterCheck(large, 1.0f, 0.004f, 0.5f, WrapU | WrapV, 61);
+    RankFilterCheck(large, 1.0f, 0.004f, 0.3f, ClampU | ClampV, 61);
+
+    // a window just within them, in strips narrower than itself
+    openktg::texture wide = RandomTexture(1024, 8, 12);
+    RankFilterCheck(wide, 0.4f, 0.5f, 0.5f, WrapU | ClampV, 5);
+}
+
+TEST(FiltersTest, TextureStatisticsMatchBruteForce)
+{
+    openktg::texture in = RandomTexture(64, 32, 11);
+    openktg::texture_statistics stats(in);
+
+    ASSERT_EQ(stats.pixel_count(), in.pixel_count());
+    for (uint32_t c = 0; c < 4; c++)
+    {
+        std::vector<uint16_t> values;
+        for (uint32_t i = 0; i < in.pixel_count(); i++)
+        {
+            const openktg::pixel &p = in.data()[i];
+            uint16_t v[4] = {p.r(), p.g(), p.b(), p.a()};
+            values.push_back(v[c]);
+        }
+        std::sort(values.begin(), values.end());
+
+        double mean = 0.0, variance = 0.0;
+        for (uint16_t v : values)
+            mean += v;
+        mean /= values.size();
+        for (uint16_t v : values)
+            variance += (v - mean) * (v - mean);
+        variance /= values.size();
+
+        EXPECT_EQ(stats.stats(c).min, values.front());
+        EXPECT_EQ(stats.stats(c).max, values.back());
+        EXPECT_NEAR(stats.stats(c).mean, mean, 1e-6 * mean);
+        EXPECT_NEAR(stats.stats(c).variance, variance, 1e-6 * variance);
+
+        auto hist = stats.histogram(c);
+        for (uint32_t rank = 0; rank < values.size(); rank += 7)
+        {
+            ASSERT_EQ(stats.value_at_rank(c, rank), values[rank]) << "channel " << c << " rank " << rank;
+            ASSERT_EQ(hist[values[rank]], std::count(values.begin(), values.end(), values[rank]));
+        }
+    }
+}
+
+TEST(FiltersTest, AutoLevelsAndEqualizeMatchSortedValues)
+{
+    openktg::texture in = RandomHeightMap(64, 32, 12);
+    const uint32_t n = in.pixel_count();
+
+    openktg::texture levels(in.width(), in.height()), equalized(in.width(), in.height());
+    AutoLevels(levels, in, 0.05f);
+    Equalize(equalized, in);
+
+    std::vector<uint16_t> sorted;
+    for (uint32_t i = 0; i < n; i++)
+        sorted.push_back(in.data()[i].r());
+    std::sort(sorted.begin(), sorted.end());
+
+    uint32_t clipCount = 0.05f * n;
+    uint32_t lo = sorted[clipCount], hi = sorted[n - 1 - clipCount];
+    uint64_t first = std::count(sorted.begin(), sorted.end(), sorted.front());
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        uint32_t v = in.data()[i].r();
+
+        uint32_t t = std::clamp(v, lo, hi) - lo;
+        uint16_t level = (t * 65535ull + (hi - lo) / 2) / (hi - lo);
+        ASSERT_EQ(levels.data()[i].r(), level) << "pixel " << i;
+
+        uint64_t cdf = std::upper_bound(sorted.begin(), sorted.end(), v) - sorted.begin();
+        uint16_t eq = ((cdf - first) * 65535 + (n - first) / 2) / (n - first);
+        ASSERT_EQ(equalized.data()[i].r(), eq) << "pixel " << i;
+
+        ASSERT_EQ(levels.data()[i].a(), 65535);
+        ASSERT_EQ(equalized.data()[i].a(), 65535);
+    }
+
+    // alpha is kept and colors are clamped to it
+    openktg::texture premul = RandomTexture(32, 32, 13), out(32, 32);
+    AutoLevels(out, premul, 0.0f);
+    for (uint32_t i = 0; i < out.pixel_count(); i++)
+    {
+        ASSERT_EQ(out.data()[i].a(), premul.data()[i].a());
+        ASSERT_LE(out.data()[i].r(), out.data()[i].a());
+    }
+}
+
+TEST(FiltersTest, DeriveStencils)
+{
+    openktg::texture height = RandomHeightMap(64, 32, 14);
+
+    // central differences are unchanged
+    for (DeriveOp op : {DeriveGradient, DeriveNormals})
+    {
+        openktg::texture expected(64, 32), result(64, 32);
+        legacy::Derive(expected, height, op, 2.5f);
+        Derive(result, height, op, 2.5f);
+        ExpectTexturesEqual(result, expected);
+    }
+
+    // Sobel and Scharr with a gradient output give the raw weighted differences
+    struct Stencil
+    {
+        DeriveStencil stencil;
+        int32_t side, middle;
+    };
+    for (const Stencil &s : {Stencil{DeriveSobel, 1, 2}, Stencil{DeriveScharr, 3, 10}})
+    {
+        const float strength = 0.5f;
+        const int32_t weight = 2 * s.side + s.middle;
+
+        openktg::texture result(64, 32);
+        Derive(result, height, DeriveGradient, strength, s.stencil);
+
+        auto h = [&](int32_t x, int32_t y) -> int32_t { return height.at(x & 63, y & 31).r(); };
+        for (int32_t y = 0; y < 32; y++)
+        {
+            for (int32_t x = 0; x < 64; x++)
+            {
+                int32_t dx = s.side * (h(x + 1, y - 1) - h(x - 1, y - 1)) + s.middle * (h(x + 1, y) - h(x - 1, y)) + s.side * (h(x + 1, y + 1) - h(x - 1, y + 1));
+                int32_t dy = s.side * (h(x - 1, y + 1) - h(x - 1, y - 1)) + s.middle * (h(x, y + 1) - h(x, y - 1)) + s.side * (h(x + 1, y + 1) - h(x + 1, y - 1));
+                float sx = dx * strength / (2 * weight * 65535.0f);
+                float sy = dy * strength / (2 * weight * 65535.0f);
+
+                ASSERT_EQ(result.at(x, y).r(), std::clamp<int32_t>(sx * 32768.0f + 32768.0f, 0, 65535)) << x << ", " << y;
+                ASSERT_EQ(result.at(x, y).g(), std::clamp<int32_t>(sy * 32768.0f + 32768.0f, 0, 65535)) << x << ", " << y;
+            }
+        }
+
+        // in place
+        openktg::texture expected(64, 32), inplace = height;
+        Derive(expected, height, DeriveNormals, strength, s.stencil);
+        Derive(inplace, inplace, DeriveNormals, strength, s.stencil);
+        ExpectTexturesEqual(inplace, expected);
+    }
+}
+
+TEST(FiltersTest, ResampleMatchesDirectFilter)
+{
+    openktg::texture in = RandomHeightMap(64, 32, 15);
+
+    for (ResampleFilter filter : {ResampleMitchell, ResampleLanczos3})
+    {
+        for (int32_t mode : {WrapU | WrapV, ClampU | ClampV})
+        {
+            openktg::texture outputs[] = {{32, 16}, {32, 32}, {16, 64}, {128, 8}};
+            Resample(outputs, 4, in, filter, mode);
+
+            for (const openktg::texture &out : outputs)
+            {
+                // separable weights evaluated directly in double precision
+                auto weights = [&](int32_t srcSize, int32_t dstSize, int32_t i, bool clamp) {
+                    double scale = double(srcSize) / dstSize, stretch = std::max(scale, 1.0);
+                    double radius = (filter == ResampleLanczos3 ? 3.0 : 2.0) * stretch;
+                    double center = (i + 0.5) * scale - 0.5;
+
+                    std::vector<std::pair<int32_t, double>> w;
+                    double sum = 0.0;
+                    for (int32_t j = int32_t(std::floor(center - radius)); j <= int32_t(std::ceil(center + radius)); j++)
+                    {
+                        double x = std::abs(j - center) / stretch, k = 0.0;
+                        if (filter == ResampleLanczos3)
+                            k = x < 1e-9 ? 1.0 : x < 3.0 ? 3.0 * std::sin(M_PI * x) * std::sin(M_PI * x / 3.0) / (M_PI * M_PI * x * x) : 0.0;
+                        else
+                            k = x < 1.0 ? (7.0 * x * x * x - 12.0 * x * x + 16.0 / 3.0) / 6.0
+                                : x < 2.0 ? (-7.0 / 3.0 * x * x * x + 12.0 * x * x - 20.0 * x + 32.0 / 3.0) / 6.0
+                                          : 0.0;
+                        w.emplace_back(clamp ? std::clamp(j, 0, srcSize - 1) : (j & (srcSize - 1)), k);
+                        sum += k;
+                    }
+                    for (auto &[j, k] : w)
+                        k /= sum;
+                    return w;
+                };
+
+                for (int32_t y = 0; y < out.height(); y++)
+                {
+                    auto wy = weights(in.height(), out.height(), y, mode & ClampV);
+                    for (int32_t x = 0; x < out.width(); x++)
+                    {
+                        auto wx = weights(in.width(), out.width(), x, mode & ClampU);
+                        double acc = 0.0;
+                        for (auto [j, ky] : wy)
+                            for (auto [i, kx] : wx)
+                                acc += ky * kx * in.at(i, j).r();
+
+                        int32_t expected = std::clamp<int32_t>(std::lround(acc), 0, 65535);
+                        ASSERT_NEAR(out.at(x, y).r(), expected, 1) << x << ", " << y << " size " << out.width() << "x" << out.height();
+                        ASSERT_EQ(out.at(x, y).a(), 65535);
+                    }
+                }
+
+                // one output at a time gives the same result as a shared horizontal pass
+                openktg::texture single(out.width(), out.height());
+                Resample(&single, 1, in, filter, mode);
+                ExpectTexturesEqual(single, out);
+            }
+        }
+    }
+}
+
+TEST(FiltersTest, ColorSpaceConversions)
+{
+    openktg::texture in = RandomTexture(64, 32, 16);
+    openktg::texture linear(64, 32), srgb(64, 32);
+
+    ToLinear(linear, in);
+    ToSRGB(srgb, linear);
+
+    for (uint32_t i = 0; i < in.pixel_count(); i++)
+    {
+        const openktg::pixel &p = in.data()[i];
+        const openktg::pixel &l = linear.data()[i];
+        ASSERT_EQ(l.a(), p.a());
+        ASSERT_LE(l.r(), l.a());
+
+        if (p.a() == 65535)
+        {
+            double c = p.r() / 65535.0;
+            double expected = c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+            ASSERT_EQ(l.r(), std::lround(expected * 65535.0));
+
+            // 16 bit linear values lose precision in the darks only
+            if (p.r() > 4096)
+            {
+                ASSERT_NEAR(srgb.data()[i].r(), p.r(), 64);
+            }
+        }
+    }
+}
+
+TEST(FiltersTest, BlurSRGBMatchesLinearChain)
+{
+    openktg::texture in = RandomTexture(64, 32, 17);
+
+    for (auto [sizex, sizey] : {std::pair{0.1f, 0.2f}, std::pair{0.1f, 0.0f}, std::pair{0.0f, 0.2f}})
+    {
+        openktg::texture linear(64, 32), blurred(64, 32), expected(64, 32);
+        ToLinear(linear, in);
+        Blur(blurred, linear, sizex, sizey, 2, WrapU | ClampV);
+        ToSRGB(expected, blurred);
+
+        openktg::texture result(64, 32);
+        BlurSRGB(result, in, sizex, sizey, 2, WrapU | ClampV);
+        ExpectTexturesEqual(result, expected);
+
+        // in place
+        openktg::texture inplace = in;
+        BlurSRGB(inplace, inplace, sizex, sizey, 2, WrapU | ClampV);
+        ExpectTexturesEqual(inplace, expected);
+    }
+}
+
+TEST(FiltersTest, BilateralSmoothPreservesEdges)
+{
+    // two noisy flat regions separated by a vertical edge
+    openktg::texture in(64, 64);
+    std::mt19937 gen(18);
+    std::uniform_int_distribution<int32_t> noise(-2000, 2000);
+    for (int32_t y = 0; y < 64; y++)
+    {
+        for (int32_t x = 0; x < 64; x++)
+        {
+            uint16_t v = static_cast<uint16_t>((x < 32 ? 16000 : 48000) + noise(gen));
+            in.at(x, y) = openktg::pixel{static_cast<openktg::red16_t>(v), static_cast<openktg::green16_t>(v), static_cast<openktg::blue16_t>(v),
+                                         static_cast<openktg::alpha16_t>(65535)};
+        }
+    }
+
+    for (int32_t mode : {WrapU | WrapV, ClampU | ClampV})
+    {
+        openktg::texture result(64, 64), blurred(64, 64);
+        BilateralSmooth(result, in, 0.25f, 0.25f, 0.1f, mode);
+        Blur(blurred, in, 0.25f, 0.25f, 1, mode);
+
+        for (int32_t y = 0; y < 64; y++)
+        {
+            // right next to the edge, a plain blur mixes both sides
+            EXPECT_NEAR(result.at(31, y).r(), 16000, 500);
+            EXPECT_NEAR(result.at(32, y).r(), 48000, 500);
+            EXPECT_GT(std::abs(blurred.at(31, y).r() - 16000), 4000);
+
+            for (int32_t x = 0; x < 64; x++)
+                ASSERT_EQ(result.at(x, y).a(), 65535);
+        }
+    }
+
+    // a constant texture stays constant; in place
+    openktg::texture flat(32, 32);
+    for (uint32_t i = 0; i < flat.pixel_count(); i++)
+        flat.data()[i] = openktg::pixel{static_cast<openktg::red16_t>(10000), static_cast<openktg::green16_t>(20000), static_cast<openktg::blue16_t>(30000),
+                                        static_cast<openktg::alpha16_t>(40000)};
+    openktg::texture expected = flat;
+    BilateralSmooth(flat, flat, 0.3f, 0.1f, 0.05f, ClampU | WrapV);
+    ExpectTexturesEqual(flat, expected);
+}
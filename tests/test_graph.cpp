@@ -0,0 +1,757 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include <openktg/core/matrix.h>
+#include <openktg/core/pixel.h>
+#include <openktg/core/texture.h>
+#include <openktg/graph/batch.h>
+#include <openktg/graph/bytecode.h>
+#include <openktg/graph/cache.h>
+#include <openktg/graph/disk_cache.h>
+#include <openktg/graph/evaluate.h>
+#include <openktg/graph/incremental.h>
+#include <openktg/graph/plan.h>
+#include <openktg/graph/progressive.h>
+#include <openktg/graph/recipe.h>
+#include <openktg/tex/filters.h>
+#include <openktg/tex/generators.h>
+#include <openktg/tex/sampling.h>
+#include <openktg/util/utility.h>
+
+#include "test_textures.h"
+
+using namespace openktg::graph;
+
+// The material of GenerateTexture in test_end_to_end.cpp as a recipe; returns the final node
+static auto MaterialRecipe(recipe &r) -> node_id
+{
+    using namespace openktg;
+    using namespace openktg::util::constants;
+
+    const pixel black{0xFF000000_argb};
+    const pixel white{0xFFFFFFFF_argb};
+
+    node_id gradBW = r.gradient(0xff000000, 0xffffffff);
+    node_id gradWB = r.gradient(0xffffffff, 0xff000000);
+    node_id gradWhite = r.gradient(0xffffffff, 0xffffffff);
+
+    static int32_t voroIntens[4] = {37, 42, 37, 37};
+    static int32_t voroCount[4] = {90, 132, 240, 255};
+    static float voroDist[4] = {0.125f, 0.063f, 0.063f, 0.063f};
+
+    linear_term terms[4];
+    for (int32_t i = 0; i < 4; i++)
+    {
+        node_id voro = r.voronoi(256, 256, gradWhite, voroIntens[i], voroCount[i], voroDist[i], -983260701); // RandomVoronoi's default seed
+        terms[i] = {voro, 1.5f, 0.0f, 0.0f, WrapU | WrapV | FilterNearest};
+    }
+
+    node_id base = r.linear_combine(256, 256, black, 0.0f, terms, 4);
+    base = r.blur(base, 0.0074f, 0.0074f, 1, WrapU | WrapV);
+
+    node_id noiseLayer = r.noise(256, 256, r.gradient(0xff000000, 0xff646464), 4, 4, 5, 0.995f, 3, NoiseDirect | NoiseNormalize | NoiseBandlimit);
+    base = r.paste(base, noiseLayer, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, CombineAdd, 0);
+    base = r.colorize(base, 0xff747d8e, 0xfff1feff);
+
+    matrix44<float> m1 = matrix44<float>::translation(-0.5f, -0.5f, 0.0f);
+    matrix44<float> m2 = matrix44<float>::scale(3.0f * SQRT2F, 3.0f * SQRT2F, 1.0f);
+    matrix44<float> m3 = m2 * m1;
+    m1 = matrix44<float>::rotation_z(0.125f * PI2F);
+    m2 = m1 * m3;
+    m1 = matrix44<float>::translation(0.5f, 0.5f, 0.0f);
+    m3 = m1 * m2;
+
+    node_id rect1 = r.linear_combine(256, 256, black, 1.0f, nullptr, 0);
+    rect1 = r.glow_rect(rect1, gradWB, 0.5f, 0.5f, 0.41f, 0.0f, 0.0f, 0.25f, 0.7805f, 0.64f);
+    node_id rect1n = r.derive(r.coord_matrix(rect1, m3, WrapU | WrapV | FilterBilinear), DeriveNormals, 2.5f);
+
+    node_id lit = r.bump(base, rect1n, no_node, no_node, 0.0f, 0.0f, 0.0f, -2.518f, 0.719f, -3.10f, pixel{0xff101010_argb}, pixel{0xffffffff_argb}, true);
+
+    node_id rect2 = r.linear_combine(256, 256, white, 1.0f, nullptr, 0);
+    rect2 = r.glow_rect(rect2, gradBW, 0.5f, 0.5f, 0.36f, 0.0f, 0.0f, 0.20f, 0.8805f, 0.74f);
+    node_id rect2x = r.coord_matrix(rect2, m3, WrapU | WrapV | FilterBilinear);
+
+    return r.paste(lit, rect2x, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, CombineMultiply, 0);
+}
+
+static void ExpectTiledMatchesFull(const recipe &r, const std::vector<node_id> &outputs, int32_t tileSize)
+{
+    std::vector<openktg::texture> full = evaluate(r);
+    std::vector<openktg::texture> tiled(outputs.size());
+    evaluate_tiled(r, outputs, tiled, tileSize);
+
+    for (uint32_t i = 0; i < outputs.size(); i++)
+    {
+        SCOPED_TRACE(testing::Message() << "node " << outputs[i] << ", tile size " << tileSize);
+        ExpectTexturesEqual(tiled[i], full[outputs[i]]);
+    }
+}
+
+TEST(GraphTest, TiledMatchesFullOnMaterial)
+{
+    recipe r;
+    node_id final = MaterialRecipe(r);
+
+    // the output plus a few intermediates that other nodes read with halos
+    std::vector<node_id> outputs = {final};
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        if (r[id].kind == op::blur || r[id].kind == op::derive || r[id].kind == op::colorize)
+            outputs.push_back(id);
+    }
+
+    for (int32_t tileSize : {16, 64, 100, 256})
+        ExpectTiledMatchesFull(r, outputs, tileSize);
+}
+
+TEST(GraphTest, TiledMatchesFullAcrossEdges)
+{
+    using namespace openktg;
+
+    recipe r;
+    node_id grad = r.gradient(0xff000000, 0xffffffff);
+    node_id warm = r.gradient(0xff200000, 0xffffc080);
+    node_id height = r.noise(64, 32, grad, 1, 1, 4, 0.6f, 7, NoiseBandlimit | NoiseNormalize);
+    node_id detail = r.noise(64, 32, warm, 2, 3, 3, 0.5f, 11, NoiseAbs | NoiseBandlimit);
+
+    // rotated and scaled lookups, clamped and wrapped, pull texels from far away
+    matrix44<float> rot = matrix44<float>::rotation_z(0.3f) * matrix44<float>::scale(1.7f, 0.6f, 1.0f);
+    rot(0, 3) = 0.21f;
+    rot(1, 3) = -0.4f;
+    node_id warped = r.coord_matrix(height, rot, ClampU | WrapV | FilterBilinear);
+    node_id sheared = r.coord_matrix(detail, matrix44<float>::rotation_z(-1.1f), WrapU | WrapV | FilterNearest);
+
+    // ...and slightly rotated ones read from the tile neighbourhood
+    matrix44<float> nudge = matrix44<float>::rotation_z(0.05f) * matrix44<float>::scale(0.8f, 0.9f, 1.0f);
+    nudge(0, 3) = -0.3f;
+    nudge(1, 3) = 0.55f;
+    node_id nudged = r.coord_matrix(detail, nudge, ClampU | ClampV | FilterBilinear);
+    node_id shifted = r.coord_matrix(nudged, matrix44<float>::translation(0.4f, -0.2f, 0.0f), WrapU | WrapV | FilterNearest);
+
+    node_id soft = r.blur(warped, 0.2f, 0.05f, 3, ClampU | WrapV);
+    node_id wide = r.blur(sheared, 0.0f, 0.3f, 2, WrapU | ClampV);
+    node_id normals = r.derive(soft, DeriveNormals, 3.0f, DeriveSobel);
+    node_id slope = r.derive(wide, DeriveGradient, 1.5f, DeriveScharr);
+
+    node_id mixed = r.ternary(shifted, wide, soft, TernaryLerp);
+    node_id mapped = r.color_remap(mixed, warm, grad, r.gradient(0xff0000ff, 0xff000000));
+    node_id glow = r.glow_rect(mapped, warm, 0.9f, 0.1f, 0.3f, 0.1f, -0.05f, 0.25f, 0.2f, 0.4f);
+    node_id pasted = r.paste(glow, slope, 0.7f, 0.8f, 0.5f, 0.2f, -0.2f, 0.6f, CombineOver, 1);
+    node_id lit = r.bump(pasted, normals, grad, warm, 0.3f, 0.6f, 0.5f, -0.2f, -0.4f, -1.0f, pixel{0xff202020_argb}, pixel{0xffe0e0ff_argb}, false);
+
+    const std::vector<node_id> outputs = {lit, slope, normals};
+    for (int32_t tileSize : {1, 8, 24, 64})
+        ExpectTiledMatchesFull(r, outputs, tileSize);
+}
+
+TEST(GraphTest, TiledMatchesFullOnSRGBBlur)
+{
+    recipe r;
+    node_id grad = r.gradient(0xff102030, 0xfff0e0d0);
+    node_id colors = r.noise(64, 64, grad, 2, 2, 3, 0.5f, 5, NoiseBandlimit | NoiseNormalize);
+
+    // both axes, and either one alone, where the single pass decodes and encodes
+    const std::vector<node_id> outputs = {r.blur(colors, 0.1f, 0.2f, 2, WrapU | ClampV, true), r.blur(colors, 0.15f, 0.0f, 3, ClampU, true),
+                                          r.blur(colors, 0.0f, 0.1f, 1, WrapU | WrapV, true)};
+    for (int32_t tileSize : {8, 24, 64})
+        ExpectTiledMatchesFull(r, outputs, tileSize);
+
+    std::vector<openktg::texture> full = evaluate(r);
+    openktg::texture expected(64, 64);
+    BlurSRGB(expected, full[colors], 0.1f, 0.2f, 2, WrapU | ClampV);
+    ExpectTexturesEqual(full[outputs[0]], expected);
+}
+
+TEST(GraphTest, PlannedMatchesFullOnMaterial)
+{
+    recipe r;
+    node_id final = MaterialRecipe(r);
+    const node_id lit = final - 4;
+    ASSERT_EQ(r[lit].kind, op::bump);
+
+    buffer_plan plan = plan_buffers(r, std::vector<node_id>{final});
+    EXPECT_LT(plan.peak_bytes, plan.unplanned_bytes / 2);
+    EXPECT_TRUE(plan.in_place[final]); // pasted over the lit surface
+
+    // unless that is an output too
+    const std::vector<node_id> outputs = {final, lit};
+    plan = plan_buffers(r, outputs);
+    EXPECT_FALSE(plan.in_place[final]);
+
+    std::vector<openktg::texture> full = evaluate(r);
+    std::vector<openktg::texture> planned(outputs.size());
+    evaluate_planned(r, plan, outputs, planned);
+
+    for (uint32_t i = 0; i < outputs.size(); i++)
+        ExpectTexturesEqual(planned[i], full[outputs[i]]);
+}
+
+TEST(GraphTest, PlanReusesBuffersAlongChains)
+{
+    using namespace openktg;
+
+    recipe r;
+    node_id grad = r.gradient(0xff000000, 0xffffffff);
+    node_id height = r.noise(64, 64, grad, 2, 2, 4, 0.5f, 5, NoiseBandlimit | NoiseNormalize);
+    node_id warped = r.coord_matrix(height, matrix44<float>::rotation_z(0.4f), WrapU | WrapV | FilterBilinear);
+    node_id soft = r.blur(warped, 0.05f, 0.05f, 2, WrapU | WrapV);
+    node_id tinted = r.colorize(soft, 0xff102040, 0xffe0f0ff);
+    node_id mixed = r.ternary(tinted, height, warped, TernaryLerp);
+    r.derive(mixed, DeriveNormals, 2.0f); // not an output, so never computed
+
+    const std::vector<node_id> outputs = {mixed, mixed};
+    buffer_plan plan = plan_buffers(r, outputs);
+
+    // the ternary reads the noise and transform again, so the blur needs a third buffer that the rest overwrite
+    EXPECT_FALSE(plan.in_place[soft]);
+    EXPECT_TRUE(plan.in_place[tinted]);
+    EXPECT_TRUE(plan.in_place[mixed]);
+    EXPECT_EQ(plan.buffer_of[mixed], plan.buffer_of[soft]);
+    EXPECT_EQ(plan.buffer_of[grad], 0u);
+    EXPECT_EQ(plan.buffer_of[mixed + 1], no_buffer);
+    EXPECT_EQ(plan.buffers.size(), 4u);
+    EXPECT_EQ(plan.peak_bytes, 3 * 64 * 64 * sizeof(pixel) + 2 * sizeof(pixel));
+
+    std::vector<texture> full = evaluate(r);
+    std::vector<texture> planned(outputs.size());
+    evaluate_planned(r, plan, outputs, planned);
+
+    ExpectTexturesEqual(planned[0], full[mixed]);
+    ExpectTexturesEqual(planned[1], full[mixed]);
+}
+
+// A glow, blurred and tinted, with a noise snippet pasted over and lit by the blurred glow's normals
+struct EditableRecipe
+{
+    float glowX = 0.3f;
+    uint32_t tint = 0xff4080c0;
+    float pasteX = 0.5f;
+
+    node_id glow, soft, tinted, pasted, lit;
+
+    auto build() -> recipe
+    {
+        using namespace openktg;
+
+        recipe r;
+        node_id grad = r.gradient(0xff000000, 0xffffffff);
+        node_id bg = r.linear_combine(64, 64, pixel{0xff000000_argb}, 1.0f, nullptr, 0);
+        glow = r.glow_rect(bg, grad, glowX, 0.5f, 0.1f, 0.0f, 0.0f, 0.1f, 0.5f, 0.5f);
+        soft = r.blur(glow, 0.05f, 0.05f, 1, WrapU | WrapV);
+        node_id normals = r.derive(soft, DeriveNormals, 2.0f);
+        tinted = r.colorize(soft, 0xff000000, tint);
+        node_id snippet = r.noise(16, 16, grad, 2, 2, 3, 0.5f, 9, NoiseBandlimit | NoiseNormalize);
+        pasted = r.paste(tinted, snippet, pasteX, 0.2f, 0.25f, 0.0f, 0.0f, 0.25f, CombineAdd, 0);
+        lit = r.bump(pasted, normals, no_node, no_node, 0.5f, 0.5f, 0.5f, 0.0f, 0.0f, -1.0f, pixel{0xff202020_argb}, pixel{0xffffffff_argb}, false);
+        return r;
+    }
+};
+
+static void ExpectIncrementalMatchesFull(const incremental_evaluator &inc, const recipe &r)
+{
+    std::vector<openktg::texture> full = evaluate(r);
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        SCOPED_TRACE(testing::Message() << "node " << id);
+        ExpectTexturesEqual(inc.result(id), full[id]);
+    }
+}
+
+static auto Area(const rect &a) -> int32_t
+{
+    return a.empty() ? 0 : (a.x1 - a.x0 + 1) * (a.y1 - a.y0 + 1);
+}
+
+TEST(GraphTest, IncrementalRecomputesDirtyRegions)
+{
+    EditableRecipe e;
+    incremental_evaluator inc;
+
+    recipe r = e.build();
+    inc.update(r);
+    ExpectIncrementalMatchesFull(inc, r);
+
+    std::vector<uint64_t> versions(r.size());
+    auto snapshot = [&] {
+        for (node_id id = 0; id < r.size(); id++)
+            versions[id] = inc.version(id);
+    };
+
+    // moving the glow recomputes the area around its old and new bounds downstream
+    snapshot();
+    e.glowX = 0.35f;
+    r = e.build();
+    inc.update(r);
+    ExpectIncrementalMatchesFull(inc, r);
+
+    for (node_id id = 0; id < e.glow; id++)
+        EXPECT_EQ(inc.version(id), versions[id]);
+    EXPECT_GT(Area(inc.dirty(e.glow)), 0);
+    EXPECT_GT(Area(inc.dirty(e.soft)), Area(inc.dirty(e.glow)));
+    EXPECT_LT(Area(inc.dirty(e.lit)), 64 * 64 / 2);
+    EXPECT_EQ(inc.version(e.pasted - 1), versions[e.pasted - 1]); // the snippet
+
+    // new colors rerun the colorize and what reads it
+    snapshot();
+    const uint64_t glowParams = inc.param_version(e.glow);
+    e.tint = 0xffc08040;
+    r = e.build();
+    inc.update(r);
+    ExpectIncrementalMatchesFull(inc, r);
+
+    EXPECT_EQ(inc.param_version(e.glow), glowParams);
+    EXPECT_EQ(inc.version(e.soft), versions[e.soft]);
+    EXPECT_EQ(Area(inc.dirty(e.tinted)), 64 * 64);
+    EXPECT_NE(inc.version(e.lit), versions[e.lit]);
+
+    // moving the snippet only touches the paste and the lighting, on its old and new bounds
+    snapshot();
+    e.pasteX = 0.6f;
+    r = e.build();
+    inc.update(r);
+    ExpectIncrementalMatchesFull(inc, r);
+
+    EXPECT_EQ(inc.version(e.tinted), versions[e.tinted]);
+    const rect moved = inc.dirty(e.pasted);
+    EXPECT_EQ(moved.x0, 32);
+    EXPECT_EQ(moved.x1, 55); // bounds round outwards
+    EXPECT_EQ(inc.dirty(e.lit).x0, moved.x0);
+    EXPECT_EQ(inc.dirty(e.lit).y1, moved.y1);
+
+    // the same recipe again computes nothing
+    snapshot();
+    inc.update(r);
+    for (node_id id = 0; id < r.size(); id++)
+    {
+        EXPECT_EQ(inc.version(id), versions[id]);
+        EXPECT_TRUE(inc.dirty(id).empty());
+    }
+}
+
+TEST(GraphTest, CacheSharesEqualComputations)
+{
+    recipe material;
+    const node_id final = MaterialRecipe(material);
+    std::vector<openktg::texture> full = evaluate(material);
+
+    result_cache cache(64 << 20);
+    cache_counters counters;
+    texture_ptr result[1];
+
+    evaluate_cached(material, std::vector<node_id>{final}, result, cache, &counters);
+    ExpectTexturesEqual(*result[0], full[final]);
+    EXPECT_EQ(counters.hits[final], 0u);
+    EXPECT_EQ(counters.misses[final], 1u);
+
+    // a second run finds the final result and looks nothing else up
+    const uint64_t lookups = cache.hits() + cache.misses();
+    evaluate_cached(material, std::vector<node_id>{final}, result, cache, &counters);
+    ExpectTexturesEqual(*result[0], full[final]);
+    EXPECT_EQ(counters.hits[final], 1u);
+    EXPECT_EQ(cache.hits() + cache.misses(), lookups + 1);
+
+    // a recipe sharing the base layer recomputes just what differs
+    recipe variant;
+    MaterialRecipe(variant);
+    node_id base = 0;
+    while (variant[base].kind != op::colorize)
+        base++;
+    const node_id tinted = variant.colorize(base - 1, 0xff200000, 0xffffe0c0);
+
+    std::vector<openktg::texture> variantFull = evaluate(variant);
+    cache_counters variantCounters;
+    evaluate_cached(variant, std::vector<node_id>{tinted}, result, cache, &variantCounters);
+    ExpectTexturesEqual(*result[0], variantFull[tinted]);
+    EXPECT_EQ(variantCounters.misses[tinted], 1u);
+    EXPECT_EQ(variantCounters.hits[base - 1], 1u);
+    EXPECT_EQ(variantCounters.hits[0] + variantCounters.misses[0], 0u); // the gradient behind the cached paste
+}
+
+TEST(GraphTest, CacheEvictsCheapestPerByte)
+{
+    const cache_key a{1, 1}, b{2, 2}, c{3, 3};
+    const uint64_t bytes = sizeof(openktg::texture) + 64 * 64 * sizeof(openktg::pixel);
+    result_cache cache(2 * bytes);
+
+    cache.insert(a, openktg::texture(64, 64), 1000.0);
+    cache.insert(b, openktg::texture(64, 64), 10.0);
+    EXPECT_EQ(cache.size(), 2u);
+
+    // the cheap one goes, although the costly one was used less recently
+    texture_ptr kept = cache.find(b);
+    cache.insert(c, openktg::texture(64, 64), 10.0);
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_EQ(cache.bytes(), 2 * bytes);
+    EXPECT_NE(cache.find(a), nullptr);
+    EXPECT_EQ(cache.find(b), nullptr);
+    EXPECT_NE(cache.find(c), nullptr);
+    EXPECT_EQ(kept->width(), 64u); // still valid for its holders
+
+    // equal costs: the least recently used goes
+    result_cache lru(2 * bytes);
+    lru.insert(a, openktg::texture(64, 64), 10.0);
+    lru.insert(b, openktg::texture(64, 64), 10.0);
+    lru.find(a);
+    lru.insert(c, openktg::texture(64, 64), 10.0);
+    EXPECT_NE(lru.find(a), nullptr);
+    EXPECT_EQ(lru.find(b), nullptr);
+
+    // too big to cache at all
+    texture_ptr big = cache.insert(cache_key{5, 5}, openktg::texture(256, 256), 1e9);
+    EXPECT_EQ(big->width(), 256u);
+    EXPECT_EQ(cache.find(cache_key{5, 5}), nullptr);
+}
+
+TEST(GraphTest, CacheStaysIntactUnderChurn)
+{
+    // keys that collide in the table, so evictions keep shifting probe runs back
+    const uint64_t bytes = sizeof(openktg::texture) + sizeof(openktg::pixel);
+    result_cache cache(uint64_t(-1), 16);
+    auto key = [](uint64_t i) { return cache_key{(i % 5) * 64 + (i / 5) % 3, i}; };
+
+    for (uint64_t i = 0; i < 20000; i++)
+    {
+        cache.insert(key(i), openktg::texture(1, 1), 1.0);
+        if (i % 7 == 0)
+            cache.find(key(i - i % 16)); // keeps an older one alive
+    }
+
+    EXPECT_EQ(cache.size(), 16u);
+    EXPECT_EQ(cache.bytes(), 16 * bytes);
+
+    uint32_t found = 0;
+    for (uint64_t i = 0; i < 20000; i++)
+        found += cache.find(key(i)) != nullptr;
+    EXPECT_EQ(found, 16u);
+    for (uint64_t i = 20000 - 8; i < 20000; i++)
+        EXPECT_NE(cache.find(key(i)), nullptr) << i;
+}
+
+TEST(GraphTest, CacheSharedBetweenThreads)
+{
+    recipe material;
+    const node_id final = MaterialRecipe(material);
+    std::vector<openktg::texture> full = evaluate(material);
+
+    result_cache cache(64 << 20);
+    texture_ptr results[4];
+    {
+        std::vector<std::jthread> workers;
+        for (uint32_t i = 0; i < 4; i++)
+            workers.emplace_back([&, i] { evaluate_cached(material, std::vector<node_id>{final}, std::span(results + i, 1), cache); });
+    }
+
+    for (const texture_ptr &result : results)
+        ExpectTexturesEqual(*result, full[final]);
+    EXPECT_LE(cache.size(), material.size());
+}
+
+TEST(GraphTest, DiskCachePersistsAcrossRuns)
+{
+    const std::filesystem::path dir = std::filesystem::path(testing::TempDir()) / "openktg_disk_cache";
+    std::filesystem::remove_all(dir);
+
+    recipe material;
+    const node_id final = MaterialRecipe(material);
+    std::vector<openktg::texture> full = evaluate(material);
+    texture_ptr result[1];
+
+    // the first run stores every node it computes
+    {
+        result_cache memory(64 << 20);
+        disk_cache disk(dir, 64 << 20);
+        evaluate_cached(material, std::vector<node_id>{final}, result, memory, nullptr, &disk);
+        ExpectTexturesEqual(*result[0], full[final]);
+        EXPECT_GT(disk.bytes(), 256u * 256 * sizeof(openktg::pixel));
+    }
+
+    // a later run starts with an empty memory cache and finds the final result on disk
+    result_cache memory(64 << 20);
+    disk_cache disk(dir, 64 << 20);
+    cache_counters counters;
+    evaluate_cached(material, std::vector<node_id>{final}, result, memory, &counters, &disk);
+    ExpectTexturesEqual(*result[0], full[final]);
+    EXPECT_EQ(counters.disk_hits[final], 1u);
+    EXPECT_EQ(counters.hits[0] + counters.misses[0], 0u);
+
+    // the mapped pixels are the stored ones
+    std::optional<mapped_texture> mapped = disk.find(node_keys(material)[final]);
+    ASSERT_TRUE(mapped);
+    EXPECT_EQ(mapped->width(), 256u);
+    EXPECT_EQ(mapped->pixels()[1000], full[final].data()[1000]);
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST(GraphTest, DiskCacheEvictsAndRecovers)
+{
+    namespace fs = std::filesystem;
+    using namespace openktg;
+
+    const fs::path dir = fs::path(testing::TempDir()) / "openktg_disk_cache_evict";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    // a temporary left by a crashed writer goes, one still being written stays
+    const auto now = fs::file_time_type::clock::now();
+    std::ofstream(dir / "0.okt.1.0.tmp") << "partial";
+    std::ofstream(dir / "0.okt.1.1.tmp") << "partial";
+    fs::last_write_time(dir / "0.okt.1.0.tmp", now - std::chrono::hours(2));
+
+    const uint64_t fileBytes = 64 + 64 * 64 * sizeof(openktg::pixel);
+    disk_cache disk(dir, 3 * fileBytes);
+    EXPECT_FALSE(fs::exists(dir / "0.okt.1.0.tmp"));
+    EXPECT_TRUE(fs::exists(dir / "0.okt.1.1.tmp"));
+    EXPECT_EQ(disk.bytes(), 0u);
+
+    const cache_key a{1, 1}, b{2, 2}, c{3, 3}, d{4, 4};
+    openktg::texture t(64, 64);
+    t.at(3, 4) = openktg::pixel{0xff102030_argb};
+    disk.store(a, t, 10.0);
+    disk.store(b, t, 10.0);
+    disk.store(c, t, 10.0);
+    EXPECT_EQ(disk.bytes(), 3 * fileBytes);
+
+    // a fourth result overflows the bound, and the least recently used go until 90% of it is left
+    for (const auto &file : fs::directory_iterator(dir))
+    {
+        if (file.path().extension() == ".okt")
+            fs::last_write_time(file.path(), now - std::chrono::seconds(60));
+    }
+    ASSERT_TRUE(disk.find(a));
+    disk.store(d, t, 10.0);
+    EXPECT_EQ(disk.bytes(), 2 * fileBytes);
+    EXPECT_FALSE(disk.find(b));
+    EXPECT_FALSE(disk.find(c));
+
+    // which leaves room for the next one without trimming
+    disk.store(b, t, 10.0);
+    EXPECT_EQ(disk.bytes(), 3 * fileBytes);
+
+    std::optional<mapped_texture> found = disk.find(a);
+    ASSERT_TRUE(found);
+    EXPECT_EQ(found->cost(), 10.0);
+    EXPECT_EQ(found->to_texture().at(3, 4), t.at(3, 4));
+
+    // a file that is not a valid result is a miss, and goes
+    const fs::path path = dir / "00000000000000040000000000000004.okt";
+    ASSERT_TRUE(fs::exists(path));
+    fs::resize_file(path, fileBytes - 8);
+    EXPECT_FALSE(disk.find(d));
+    EXPECT_FALSE(fs::exists(path));
+
+    fs::remove_all(dir);
+}
+
+TEST(GraphTest, BytecodeRoundTrips)
+{
+    recipe material;
+    const node_id final = MaterialRecipe(material);
+    const std::vector<node_id> outputs = {final, final - 4};
+
+    std::vector<uint8_t> code = encode(material, outputs);
+    EXPECT_LT(code.size(), 1024u);
+
+    std::optional<program> prog = decode(code);
+    ASSERT_TRUE(prog);
+    ASSERT_EQ(prog->nodes.size(), material.size());
+    EXPECT_EQ(prog->outputs, outputs);
+    for (node_id id = 0; id < material.size(); id++)
+    {
+        EXPECT_EQ(prog->nodes[id].kind, material[id].kind);
+        EXPECT_EQ(prog->nodes[id].width, material[id].width);
+        EXPECT_EQ(prog->nodes[id].height, material[id].height);
+        EXPECT_EQ(prog->nodes[id].inputs, material[id].inputs);
+        EXPECT_EQ(prog->nodes[id].params, material[id].params);
+    }
+
+    std::vector<openktg::texture> full = evaluate(material);
+    std::optional<std::vector<openktg::texture>> results = interpret(code);
+    ASSERT_TRUE(results);
+    ASSERT_EQ(results->size(), 2u);
+    ExpectTexturesEqual((*results)[0], full[final]);
+    ExpectTexturesEqual((*results)[1], full[final - 4]);
+}
+
+TEST(GraphTest, BytecodeRejectsMalformedCode)
+{
+    recipe r;
+    node_id grad = r.gradient(0xff000000, 0xffffffff);
+    node_id height = r.noise(32, 16, grad, 1, 1, 2, 0.5f, -3, NoiseBandlimit);
+    node_id lit = r.bump(height, r.derive(height, DeriveNormals, 1.0f), no_node, grad, 0.5f, 0.5f, 1.0f, 0.0f, 0.0f, -1.0f, openktg::pixel{},
+                         openktg::pixel{}, false);
+    const std::vector<uint8_t> code = encode(r, std::vector<node_id>{lit});
+    ASSERT_TRUE(decode(code));
+    EXPECT_EQ(decode(code)->nodes[height].param_int(4), -3);
+    EXPECT_EQ(decode(code)->nodes[lit].inputs[2], no_node);
+
+    // every truncation, and trailing bytes
+    for (size_t length = 0; length < code.size(); length++)
+        EXPECT_FALSE(decode(std::span(code.data(), length))) << length;
+
+    std::vector<uint8_t> longer = code;
+    longer.push_back(0);
+    EXPECT_FALSE(decode(longer));
+
+    // an unknown operator, an absent required input, a reference to a later node, a missing output
+    std::vector<uint8_t> bad = code;
+    bad[7] = 0x7f;
+    EXPECT_FALSE(decode(bad));
+
+    const size_t noiseInputs = 7 + 1 + 2 * 4 + 1 + 1; // header, gradient, noise operator and size
+    ASSERT_EQ(code[noiseInputs], 1);
+    bad = code;
+    bad[noiseInputs] = 0;
+    EXPECT_FALSE(decode(bad));
+    bad[noiseInputs] = 2;
+    EXPECT_FALSE(decode(bad));
+
+    bad = code;
+    bad.back() = 9;
+    EXPECT_FALSE(decode(bad));
+}
+
+TEST(GraphTest, BytecodeRejectsHostileParameters)
+{
+    recipe r;
+    node_id grad = r.gradient(0xff000000, 0xffffffff);
+    node_id height = r.noise(32, 16, grad, 1, 1, 2, 0.5f, 7, NoiseBandlimit);
+    node_id cells = r.voronoi(32, 16, grad, 255, 40, 0.1f, 3);
+    node_id blurred = r.blur(cells, 0.1f, 0.1f, 2, ClampU | ClampV);
+    node_id normals = r.derive(blurred, DeriveNormals, 1.0f, DeriveSobel);
+    node_id pasted = r.paste(height, normals, 0.25f, 0.25f, 0.5f, 0.0f, 0.0f, 0.5f, CombineOver, FilterBilinear);
+    node_id mixed = r.ternary(pasted, height, cells, TernarySelect);
+    ASSERT_TRUE(decode(encode(r, std::vector<node_id>{mixed})));
+
+    // a size byte asking for 32768 x 32768
+    std::vector<uint8_t> code = encode(r, std::vector<node_id>{mixed});
+    const size_t noiseSize = 7 + 1 + 2 * 4 + 1; // header, gradient, noise operator
+    ASSERT_EQ(code[noiseSize], 5 | 4 << 4);
+    code[noiseSize] = 0xff;
+    EXPECT_FALSE(decode(code));
+
+    // cell counts beyond the voronoi buffer, noise shifts that overflow its lattice, orders and
+    // enum or flag values the operators do not define, floats that break fixed point conversions
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const param_override hostile[] = {
+        param_override::of_int(cells, 1, 100000),
+        param_override::of_int(cells, 1, 0),
+        param_override::of_int(cells, 0, -1),
+        param_override::of_int(height, 0, 40),
+        param_override::of_int(height, 2, 0),
+        param_override::of_int(height, 2, 16),
+        param_override::of_int(height, 5, 8),
+        param_override::of_float(height, 3, nan),
+        param_override::of_int(blurred, 2, 1 << 30),
+        param_override::of_int(blurred, 3, FilterBilinear),
+        param_override::of_int(normals, 0, 2),
+        param_override::of_int(normals, 2, 3),
+        param_override::of_int(pasted, 6, CombineLighten + 1),
+        param_override::of_int(pasted, 7, -1),
+        param_override::of_float(pasted, 2, 1e9f),
+        param_override::of_float(pasted, 0, std::numeric_limits<float>::infinity()),
+        param_override::of_int(mixed, 0, 2),
+    };
+    for (const param_override &o : hostile)
+    {
+        recipe changed = r;
+        changed.set_param(o.node, o.index, o.value);
+        EXPECT_FALSE(decode(encode(changed, std::vector<node_id>{mixed}))) << o.node << " " << o.index;
+    }
+}
+
+TEST(GraphTest, BatchSharesCommonNodes)
+{
+    recipe material;
+    const node_id final = MaterialRecipe(material);
+    const node_id normals = final - 5;
+    node_id noiseLayer = no_node, colors = no_node;
+    for (node_id id = 0; id < material.size(); id++)
+    {
+        if (material[id].kind == op::noise)
+            noiseLayer = id;
+        if (material[id].kind == op::colorize)
+            colors = id;
+    }
+    ASSERT_EQ(material[normals].kind, op::derive);
+
+    // the base recipe, two seeds that agree, and one with other colors too
+    std::vector<variant> variants(4);
+    variants[1].overrides = {param_override::of_int(noiseLayer, 4, 7)};
+    variants[2].overrides = {param_override::of_int(noiseLayer, 4, 7), {colors, 0, 0xff8e7d74}};
+    variants[3].overrides = {param_override::of_int(noiseLayer, 4, 7)};
+
+    const std::vector<node_id> outputs = {final, normals};
+    std::vector<std::vector<texture_ptr>> results = evaluate_batch(material, outputs, variants);
+    ASSERT_EQ(results.size(), variants.size());
+
+    for (uint32_t v = 0; v < variants.size(); v++)
+    {
+        SCOPED_TRACE(testing::Message() << "variant " << v);
+        recipe r = material;
+        for (const param_override &o : variants[v].overrides)
+            r.set_param(o.node, o.index, o.value);
+
+        std::vector<openktg::texture> full = evaluate(r);
+        ASSERT_EQ(results[v].size(), 2u);
+        ExpectTexturesEqual(*results[v][0], full[final]);
+        ExpectTexturesEqual(*results[v][1], full[normals]);
+
+        // the normals do not depend on any override
+        EXPECT_EQ(results[v][1], results[0][1]);
+    }
+
+    EXPECT_NE(results[0][0], results[1][0]);
+    EXPECT_NE(results[1][0], results[2][0]);
+    EXPECT_EQ(results[1][0], results[3][0]);
+}
+
+TEST(GraphTest, ProgressiveDeliversEachLevel)
+{
+    recipe material;
+    const node_id final = MaterialRecipe(material);
+    const node_id normals = final - 5;
+
+    recipe preview = scale_recipe(material, 64);
+    ASSERT_EQ(preview.size(), material.size());
+    for (node_id id = 0; id < material.size(); id++)
+    {
+        const node &n = preview[id];
+        EXPECT_EQ(n.width, material[id].kind == op::gradient ? material[id].width : material[id].width / 4) << id;
+        if (n.kind == op::noise)
+        {
+            EXPECT_EQ(n.param_int(2), 1);
+        }
+    }
+    EXPECT_FLOAT_EQ(preview[normals].param_float(1), material[normals].param_float(1) / 4.0f);
+
+    // two previews and the full size, each as evaluate has it, sharing the gradients
+    result_cache cache(uint64_t(64) << 20);
+    const std::vector<node_id> outputs = {final};
+    const std::vector<uint32_t> levels = {64, 128, 1024};
+    std::vector<uint32_t> delivered;
+    evaluate_progressive(material, outputs, levels, cache, [&](uint32_t side, std::span<const texture_ptr> results) {
+        delivered.push_back(side);
+        EXPECT_EQ(results[0]->width(), side);
+        ExpectTexturesEqual(*results[0], evaluate(scale_recipe(material, side))[final]);
+        return true;
+    });
+    EXPECT_EQ(delivered, (std::vector<uint32_t>{64, 128, 256}));
+    EXPECT_GT(cache.hits(), 0u);
+
+    // stopping after the first level, with everything cached now
+    const uint64_t misses = cache.misses();
+    delivered.clear();
+    evaluate_progressive(material, outputs, levels, cache, [&](uint32_t side, std::span<const texture_ptr>) {
+        delivered.push_back(side);
+        return false;
+    });
+    EXPECT_EQ(delivered, std::vector<uint32_t>{64});
+    EXPECT_EQ(cache.misses(), misses);
+}
@@ -0,0 +1,57 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#include <openktg/core/matrix.h>
+#include <openktg/core/pixel.h>
+#include <openktg/core/texture.h>
+#include <openktg/tex/composite.h>
+#include <openktg/tex/filters.h>
+#include <openktg/tex/pointwise.h>
+#include <openktg/tex/procedural.h>
+
+#include "test_textures.h"
+
+TEST(PointwiseTest, ChainMatchesOperatorSequence)
+{
+    openktg::texture in = RandomTexture(128, 64, 40);
+    openktg::texture other = RandomTexture(128, 64, 41);
+    openktg::texture mask = RandomHeightMap(128, 64, 42);
+    openktg::texture mapR = LinearGradient(0xff000000, 0xffff8000);
+    openktg::texture mapG = RandomTexture(8, 1, 43);
+    openktg::texture mapB = LinearGradient(0xff0000ff, 0xff000000);
+
+    const openktg::matrix44<float> grade = {1.1f, 0.1f, -0.05f, 0.0f, 0.05f, 0.9f, 0.05f, 0.02f, -0.1f, 0.2f, 1.2f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+
+    for (TernaryOp ternary : {TernaryLerp, TernarySelect})
+    {
+        for (int32_t combine = CombineAdd; combine <= CombineLighten; combine++)
+        {
+            const PointwiseStage stages[] = {
+                {PointwiseColorMatrix, &grade, false, {}, TernaryLerp, CombineAdd},
+                {PointwiseColorRemap, nullptr, false, {&mapR, &mapG, &mapB}, TernaryLerp, CombineAdd},
+                {PointwiseTernary, nullptr, false, {&other, &mask}, ternary, CombineAdd},
+                {PointwiseCombine, nullptr, false, {&other}, TernaryLerp, CombineOp(combine)},
+                {PointwiseColorMatrix, &grade, true, {}, TernaryLerp, CombineAdd},
+                {PointwiseClampPremult, nullptr, false, {}, TernaryLerp, CombineAdd},
+            };
+
+            openktg::texture expected(128, 64), result(128, 64);
+            ColorMatrixTransform(expected, in, grade, false);
+            ColorRemap(expected, expected, mapR, mapG, mapB);
+            Ternary(expected, expected, other, mask, ternary);
+            Paste(expected, expected, other, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f, CombineOp(combine), 0);
+            ColorMatrixTransform(expected, expected, grade, true);
+            for (uint32_t i = 0; i < expected.pixel_count(); i++)
+                expected.data()[i].clamp_premult();
+
+            Pointwise(result, in, stages, 6);
+            ExpectTexturesEqual(result, expected);
+
+            // in place
+            result = in;
+            Pointwise(result, result, stages, 6);
+            ExpectTexturesEqual(result, expected);
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <random>
+
+#include <openktg/core/pixel.h>
+#include <openktg/core/texture.h>
+
+// Random premultiplied texture; every fourth pixel is fully opaque, some are fully transparent
+inline auto RandomTexture(uint32_t width, uint32_t height, uint32_t seed) -> openktg::texture
+{
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<uint32_t> dist(0, 65535);
+
+    openktg::texture tex(width, height);
+    for (uint32_t i = 0; i < tex.pixel_count(); i++)
+    {
+        uint32_t a = (i % 4 == 0) ? 65535 : dist(gen);
+        if (i % 16 == 1)
+            a = 0;
+
+        tex.data()[i] = openktg::pixel{static_cast<openktg::red16_t>(dist(gen) % (a + 1)), static_cast<openktg::green16_t>(dist(gen) % (a + 1)),
+                                       static_cast<openktg::blue16_t>(dist(gen) % (a + 1)), static_cast<openktg::alpha16_t>(a)};
+    }
+
+    return tex;
+}
+
+// Random opaque texture with smooth-ish red channel, usable as a height map
+inline auto RandomHeightMap(uint32_t width, uint32_t height, uint32_t seed) -> openktg::texture
+{
+    std::mt19937 gen(seed);
+    std::uniform_int_distribution<uint32_t> dist(0, 4095);
+
+    openktg::texture tex(width, height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint16_t h = static_cast<uint16_t>(((x * 977 + y * 331) & 0xffff) ^ dist(gen));
+            tex.at(x, y) = openktg::pixel{static_cast<openktg::red16_t>(h), static_cast<openktg::green16_t>(h), static_cast<openktg::blue16_t>(h),
+                                          static_cast<openktg::alpha16_t>(65535)};
+        }
+    }
+
+    return tex;
+}
+
+inline void ExpectTexturesEqual(const openktg::texture &a, const openktg::texture &b)
+{
+    ASSERT_TRUE(texture_size_matches(a, b));
+    for (uint32_t i = 0; i < a.pixel_count(); i++)
+    {
+        ASSERT_EQ(a.data()[i], b.data()[i]) << "pixel " << (i & (a.width() - 1)) << ", " << (i >> a.shift_x());
+    }
+}
@@ -1,7 +1,10 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <random>
+#include <vector>
 
+#include <openktg/util/parallel.h>
 #include <openktg/util/utility.h>
 
 using namespace openktg;
@@ -88,4 +91,27 @@ TEST(UtilsTest, MulIntensRandom)
         EXPECT_EQ(static_cast<std::uint16_t>(legacy::MulIntens(a, b)), util::mul_intens(a, b));
         EXPECT_EQ(util::mul_intens(a, b), util::mul_intens(b, a));
     }
-}
\ No newline at end of file
+}
+
+TEST(UtilsTest, ParallelLoopsNest)
+{
+    using namespace openktg::util;
+
+    // inner loops run inline as one chunk, and every element is visited once
+    std::vector<std::atomic<uint32_t>> visits(64 * 100);
+    parallel_for(0, 64, 1, [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++)
+        {
+            if (chunk_count(0, 64, 1) > 1)
+                ADD_FAILURE() << "nested loop split into chunks";
+
+            parallel_for(0, 100, 1, [&](uint32_t innerBegin, uint32_t innerEnd) {
+                for (uint32_t j = innerBegin; j < innerEnd; j++)
+                    visits[i * 100 + j]++;
+            });
+        }
+    });
+
+    for (const std::atomic<uint32_t> &v : visits)
+        EXPECT_EQ(v.load(), 1u);
+}